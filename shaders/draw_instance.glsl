@@ -0,0 +1,21 @@
+// one surface of the draw table, same layout as GPUDrawInstance in draw_table.hpp (std430)
+
+struct DrawInstance {
+	mat4 worldMatrix;
+	// buffer device addresses of the vertices and colors
+	uvec2 vertexBuffer;
+	uvec2 colorBuffer;
+	vec3 positionOrigin;
+	uint vertexFlags;
+	vec3 positionExtent;
+	uint materialIndex;
+	// world space bounds
+	vec3 boundsOrigin;
+	uint indexCount;
+	vec3 boundsExtents;
+	uint firstIndex;
+};
+
+layout(buffer_reference, std430) readonly buffer DrawInstanceBuffer {
+	DrawInstance instances[];
+};
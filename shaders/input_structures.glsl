@@ -7,10 +7,12 @@ layout(set = 0, binding = 0) uniform SceneData{
 	vec4 sunlightColor;
 } sceneData;
 
-layout(set = 1, binding = 0) uniform GLTFMaterialData {   
-	vec4 colorFactors;
-	vec4 metal_rough_factors;
-} materialData;
+#include "material.glsl"
 
-layout(set = 1, binding = 1) uniform sampler2D colorTex;
-layout(set = 1, binding = 2) uniform sampler2D metalRoughTex;
+// the engine's material table, indexed by the material index of the draw
+layout(std430, set = 1, binding = 0) readonly buffer MaterialBuffer {
+	GPUMaterial materials[];
+};
+
+layout(set = 1, binding = 1) uniform sampler materialSamplers[];
+layout(set = 1, binding = 2) uniform texture2D materialTextures[];
@@ -0,0 +1,42 @@
+// packed material record, same layout as GPUMaterial in material_table.hpp (std430)
+struct GPUMaterial {
+	// rgba8 unorm base color factor
+	uint baseColor;
+	// half float emission rg
+	uint emissionRG;
+	// half float emission b, unorm8 metallic and roughness
+	uint emissionBMetalRough;
+	// base color and metallic roughness texture indices, 16 bits each
+	uint textures;
+	// their sampler indices, 16 bits each
+	uint samplers;
+};
+
+vec4 material_base_color(GPUMaterial material) {
+	return unpackUnorm4x8(material.baseColor);
+}
+
+vec3 material_emission(GPUMaterial material) {
+	return vec3(unpackHalf2x16(material.emissionRG), unpackHalf2x16(material.emissionBMetalRough).x);
+}
+
+// metallic in x, roughness in y
+vec2 material_metal_rough(GPUMaterial material) {
+	return unpackUnorm4x8(material.emissionBMetalRough).zw;
+}
+
+uint material_base_color_texture(GPUMaterial material) {
+	return material.textures & 0xffff;
+}
+
+uint material_metal_rough_texture(GPUMaterial material) {
+	return material.textures >> 16;
+}
+
+uint material_base_color_sampler(GPUMaterial material) {
+	return material.samplers & 0xffff;
+}
+
+uint material_metal_rough_sampler(GPUMaterial material) {
+	return material.samplers >> 16;
+}
@@ -2,42 +2,36 @@
 
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_EXT_nonuniform_qualifier : require
 
 #include "input_structures.glsl"
+#include "mesh_vertex.glsl"
 
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outUV;
-
-struct Vertex {
-
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
-}; 
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer { 
-	Vertex vertices[];
-};
+layout (location = 3) flat out uint outMaterial;
 
 //push constants block
 layout( push_constant ) uniform constants {
 	mat4 render_matrix;
 	VertexBuffer vertexBuffer;
+	ColorBuffer colorBuffer;
+	vec3 positionOrigin;
+	uint vertexFlags;
+	vec3 positionExtent;
+	uint materialIndex;
 } PushConstants;
 
 void main() 
 {
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
-	
-	vec4 position = vec4(v.position, 1.0f);
+	MeshVertex v = fetch_vertex(PushConstants.vertexBuffer, PushConstants.colorBuffer, PushConstants.vertexFlags,
+		PushConstants.positionOrigin, PushConstants.positionExtent, gl_VertexIndex);
 
-	gl_Position = sceneData.viewproj * PushConstants.render_matrix * position;
+	gl_Position = sceneData.viewproj * PushConstants.render_matrix * vec4(v.position, 1.0f);
 
 	outNormal = (PushConstants.render_matrix * vec4(v.normal, 0.f)).xyz;
-	outColor = v.color.xyz * materialData.colorFactors.xyz;	
-	outUV.x = v.uv_x;
-	outUV.y = v.uv_y;
+	outColor = v.color.xyz * material_base_color(materials[PushConstants.materialIndex]).xyz;
+	outMaterial = PushConstants.materialIndex;
+	outUV = v.uv;
 }
@@ -0,0 +1,35 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "input_structures.glsl"
+#include "mesh_vertex.glsl"
+#include "draw_instance.glsl"
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) flat out uint outMaterial;
+
+// the indirect draws of the draw table carry their instance in firstInstance
+layout( push_constant ) uniform constants {
+	DrawInstanceBuffer instanceBuffer;
+} PushConstants;
+
+void main() 
+{
+	DrawInstance instance = PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+
+	MeshVertex v = fetch_vertex(VertexBuffer(instance.vertexBuffer), ColorBuffer(instance.colorBuffer), instance.vertexFlags,
+		instance.positionOrigin, instance.positionExtent, gl_VertexIndex);
+
+	gl_Position = sceneData.viewproj * instance.worldMatrix * vec4(v.position, 1.0f);
+
+	outNormal = (instance.worldMatrix * vec4(v.normal, 0.f)).xyz;
+	outColor = v.color.xyz * material_base_color(materials[instance.materialIndex]).xyz;
+	outMaterial = instance.materialIndex;
+	outUV = v.uv;
+}
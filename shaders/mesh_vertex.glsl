@@ -0,0 +1,57 @@
+// vertex fetch of the mesh shaders from the geometry pool, needs GL_EXT_buffer_reference
+
+#include "vertex_format.glsl"
+
+struct Vertex {
+
+	vec3 position;
+	float uv_x;
+	vec3 normal;
+	float uv_y;
+	vec4 color;
+}; 
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer { 
+	Vertex vertices[];
+};
+
+layout(buffer_reference, std430) readonly buffer CompressedVertexBuffer { 
+	CompressedVertex compressedVertices[];
+};
+
+// rgba8 vertex colors of a compressed mesh
+layout(buffer_reference, std430) readonly buffer ColorBuffer { 
+	uint colors[];
+};
+
+struct MeshVertex {
+	vec3 position;
+	vec3 normal;
+	vec2 uv;
+	vec4 color;
+};
+
+// the format is the same for the whole draw, so the branch does not diverge
+MeshVertex fetch_vertex(VertexBuffer vertexBuffer, ColorBuffer colorBuffer, uint vertexFlags, vec3 positionOrigin, vec3 positionExtent, uint index) {
+	MeshVertex result;
+	result.color = vec4(1.0);
+
+	if ((vertexFlags & VERTEX_COMPRESSED) != 0) {
+		CompressedVertex v = CompressedVertexBuffer(vertexBuffer).compressedVertices[index];
+		result.position = decode_position(v.positionXY, v.positionZ, positionOrigin, positionExtent);
+		result.normal = decode_normal(v.normal);
+		result.uv = decode_uv(v.uv);
+		if ((vertexFlags & VERTEX_COLORS) != 0) {
+			result.color = unpackUnorm4x8(colorBuffer.colors[index]);
+		}
+	}
+	else {
+		Vertex v = vertexBuffer.vertices[index];
+		result.position = v.position;
+		result.normal = v.normal;
+		result.uv = vec2(v.uv_x, v.uv_y);
+		result.color = v.color;
+	}
+
+	return result;
+}
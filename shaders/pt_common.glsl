@@ -0,0 +1,150 @@
+// shared by the wavefront path tracing stages, every stage uses the same pipeline layout
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "tracer_scene.glsl"
+
+layout(rgba16f, set = 0, binding = 0) uniform image2D image;
+layout(rgba32f, set = 0, binding = 1) uniform image2D accumulation;
+// running sum of the squared sample luminance, the variance estimate of adaptive sampling
+layout(r32f, set = 0, binding = 2) uniform image2D luminanceMoment;
+// blue noise ranks that decorrelate the sample sequences of neighbouring pixels
+layout(set = 0, binding = 3) uniform usampler2D blueNoise;
+
+layout(set = 1, binding = 0) uniform SceneData {
+	mat4 view;
+	mat4 proj;
+	mat4 viewproj;
+	vec4 ambientColor;
+	vec4 sunlightDirection;
+	vec4 sunlightColor;
+} sceneData;
+
+// pixel origins of the tiles traced this frame
+layout(buffer_reference, std430) readonly buffer TileList {
+	uvec2 tileOrigins[];
+};
+
+// error estimate per entry of the tile list, read back by the tile scheduler
+layout(buffer_reference, std430) writeonly buffer TileErrors {
+	float tileErrors[];
+};
+
+layout(push_constant) uniform constants {
+	uvec4 frame; // x: completed passes, y: frame number, zw: draw extent
+	uvec4 wave; // x: bounce, y: dispatch pass, z: queue capacity, w: max depth
+	TileList tileList;
+	uint tileCount;
+	uint sampleOffset; // added to the per pixel sample counts
+	TileErrors tileErrors;
+	uint minSamples;
+	uint padding2;
+} PushConstants;
+
+struct PathState {
+	vec3 origin;
+	uint pixel;
+	vec3 direction;
+	uint depth;
+	vec3 throughput;
+	// index of the pixel sample this path belongs to, the sampler derives all its random numbers from it
+	uint sampleIndex;
+	// solid angle density of the sampled direction, needed to weight emission found by it
+	float bsdfPdf;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+struct ShadowRay {
+	vec3 origin;
+	uint pixel;
+	vec3 direction;
+	float tMax;
+	vec3 contribution;
+	uint padding;
+};
+
+layout(std430, set = 3, binding = 0) buffer QueueCounters {
+	uint rayCount[2];
+	uint shadowRayCount;
+	uint counterPadding;
+	uint extendDispatch[3];
+	uint shadowDispatch[3];
+};
+
+// two ray queues of PushConstants.wave.z entries each
+layout(std430, set = 3, binding = 1) buffer PathQueue {
+	PathState paths[];
+};
+
+layout(std430, set = 3, binding = 2) buffer HitQueue {
+	hitrecord hits[];
+};
+
+layout(std430, set = 3, binding = 3) buffer ShadowRayQueue {
+	ShadowRay shadowRays[];
+};
+
+layout(std430, set = 3, binding = 4) buffer RadianceBuffer {
+	vec4 radiance[];
+};
+
+// same as TRACER_TILE_SIZE on the CPU
+#define TILE_SIZE 64
+#define WAVEFRONT_GROUP_SIZE 64
+#define PREPARE_EXTEND 0
+#define PREPARE_CONNECT 1
+#define PI 3.14159265359
+
+// pixel handled by an invocation of the tiled stages, which dispatch one z slice of 16x16 groups per tile
+ivec2 tile_pixel() {
+	uvec2 tileOrigin = PushConstants.tileList.tileOrigins[gl_WorkGroupID.z];
+	return ivec2(tileOrigin + gl_WorkGroupID.xy * gl_WorkGroupSize.xy + gl_LocalInvocationID.xy);
+}
+
+// the queue read by the current bounce, the next bounce is appended to the other one
+uint current_queue() {
+	return PushConstants.wave.x & 1u;
+}
+
+uint path_slot(uint queue, uint index) {
+	return queue * PushConstants.wave.z + index;
+}
+
+// pcg hash, see "Hash Functions for GPU Rendering" (Jarzynski, Olano)
+uint pcg_hash(uint value) {
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+#include "pt_sampler.glsl"
+
+// sampler coordinates of the pixel a path belongs to
+uvec2 path_pixel(PathState path) {
+	return uvec2(path.pixel % PushConstants.frame.z, path.pixel / PushConstants.frame.z);
+}
+
+float luminance(vec3 color) {
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec3 sky_color(vec3 direction) {
+	vec3 unit_direction = normalize(direction);
+	float a = 0.5 * (unit_direction.y + 1.0);
+	return (1.0-a) * vec3(1.0, 1.0, 1.0) + a * vec3(0.5, 0.7, 1.0);
+}
+
+// cosine weighted direction around the normal
+vec3 sample_hemisphere(vec3 normal, vec2 u) {
+	float phi = 2.0 * PI * u.x;
+	float r2 = u.y;
+	float r = sqrt(r2);
+
+	vec3 helper = abs(normal.x) > 0.9 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+	vec3 tangent = normalize(cross(helper, normal));
+	vec3 bitangent = cross(normal, tangent);
+
+	return normalize(tangent * (cos(phi) * r) + bitangent * (sin(phi) * r) + normal * sqrt(1.0 - r2));
+}
@@ -0,0 +1,48 @@
+// next event estimation for the sun and the emissive triangles, needs pt_common.glsl
+
+// chance of connecting to the sun instead of an emissive triangle
+float sun_probability() {
+	bool hasSun = sceneData.sunlightColor.w > 0.0;
+	if (lights.length() == 0) {
+		return hasSun ? 1.0 : 0.0;
+	}
+	return hasSun ? 0.5 : 0.0;
+}
+
+float power_heuristic(float pdf, float otherPdf) {
+	float weight = pdf * pdf;
+	return weight / (weight + otherPdf * otherPdf);
+}
+
+// solid angle density of picking a point on an emissive triangle through light sampling.
+// Triangles are chosen proportionally to area times luminance, so the area cancels out.
+float light_pdf(vec3 emission, float distance, float lightCosine) {
+	float totalPower = lights[lights.length() - 1].cumulativePower;
+	return (1.0 - sun_probability()) * luminance(emission) / totalPower * distance * distance / lightCosine;
+}
+
+// binary search in the cumulative power of the lights
+uint select_light(float u) {
+	float target = u * lights[lights.length() - 1].cumulativePower;
+
+	uint low = 0;
+	uint high = uint(lights.length()) - 1;
+	while (low < high) {
+		uint middle = (low + high) / 2;
+		if (lights[middle].cumulativePower <= target) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+// uniformly distributed point on a triangle
+vec3 sample_triangle(vec3 v0, vec3 v1, vec3 v2, vec2 u) {
+	float r1 = sqrt(u.x);
+	float r2 = u.y;
+	return v0 * (1.0 - r1) + v1 * (r1 * (1.0 - r2)) + v2 * (r1 * r2);
+}
@@ -0,0 +1,101 @@
+// low discrepancy samples for the path tracer, needs pt_common.glsl.
+// Owen scrambled and shuffled Sobol points, see "Practical Hash-based Owen Scrambling" (Burley). Every pixel
+// walks the same sequence shifted by a blue noise mask, so the error of neighbouring pixels stays decorrelated
+// at low sample counts, see "Blue-noise dithered sampling" (Georgiev, Fajardo).
+
+// direction numbers of the second to fourth Sobol dimension (Joe, Kuo), the first one is the bit reversal
+const uint SOBOL_DIRECTIONS[3][32] = uint[3][32](
+	uint[32](
+		0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+		0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+		0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+		0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu),
+	uint[32](
+		0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u, 0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+		0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u, 0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+		0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u, 0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+		0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u, 0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u),
+	uint[32](
+		0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u, 0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+		0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u, 0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+		0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u, 0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+		0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u, 0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u)
+);
+
+// same as BLUE_NOISE_SIZE on the CPU
+#define BLUE_NOISE_SIZE 64
+
+// dimensions are handed out as 4d sets: one for the camera, then two per bounce
+#define SAMPLER_CAMERA 0
+
+// x: sun or triangle, y: which triangle, zw: point on the triangle
+uint light_dimensions(uint depth) {
+	return 1 + 2 * depth;
+}
+
+// xy: direction, z: russian roulette
+uint bsdf_dimensions(uint depth) {
+	return 2 + 2 * depth;
+}
+
+uint sobol(uint index, uint dimension) {
+	if (dimension == 0) {
+		return bitfieldReverse(index);
+	}
+
+	uint result = 0;
+	for (uint bit = 0; index != 0; bit++, index >>= 1) {
+		if ((index & 1u) != 0) {
+			result ^= SOBOL_DIRECTIONS[dimension - 1][bit];
+		}
+	}
+	return result;
+}
+
+uint laine_karras_permutation(uint x, uint seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+// owen scrambling of all bits, higher bits decide the permutation of lower ones
+uint nested_uniform_scramble(uint x, uint seed) {
+	return bitfieldReverse(laine_karras_permutation(bitfieldReverse(x), seed));
+}
+
+uint hash_combine(uint seed, uint value) {
+	return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+vec4 shuffled_scrambled_sobol(uint index, uint seed) {
+	index = nested_uniform_scramble(index, seed);
+
+	vec4 result;
+	for (uint dimension = 0; dimension < 4; dimension++) {
+		uint x = nested_uniform_scramble(sobol(index, dimension), hash_combine(seed, dimension));
+		// top 24 bits so the result is exactly representable and stays below 1
+		result[dimension] = float(x >> 8) * (1.0 / 16777216.0);
+	}
+	return result;
+}
+
+// toroidal shift per pixel, every component reads the mask at a different offset
+vec4 blue_noise_shift(uvec2 pixel, uint dimensions) {
+	vec4 shift;
+	for (uint component = 0; component < 4; component++) {
+		uint offset = pcg_hash(dimensions * 4 + component);
+		uvec2 texel = (pixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+		uint rank = texelFetch(blueNoise, ivec2(texel), 0).r;
+		shift[component] = (float(rank) + 0.5) / float(BLUE_NOISE_SIZE * BLUE_NOISE_SIZE);
+	}
+	return shift;
+}
+
+// 4d sample of a set of dimensions for the sample index of a pixel
+vec4 sample_dimensions(uvec2 pixel, uint sampleIndex, uint dimensions) {
+	vec4 u = shuffled_scrambled_sobol(sampleIndex, pcg_hash(dimensions));
+	return fract(u + blue_noise_shift(pixel, dimensions));
+}
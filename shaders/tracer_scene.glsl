@@ -0,0 +1,399 @@
+#include "material.glsl"
+#include "vertex_format.glsl"
+
+struct Vertex {
+	vec3 position;
+	float uv_x;
+	vec3 normal;
+	float uv_y;
+	vec4 color;
+};
+
+struct TracerInstance {
+	mat4 objectToWorld;
+	mat4 worldToObject;
+	uint nodeOffset;
+	uint primitiveOffset;
+	uint indexOffset;
+	uint vertexOffset;
+	vec3 positionOrigin;
+	uint vertexFlags;
+	vec3 positionExtent;
+	uint colorOffset;
+	uint vertexDataOffset;
+	uint poolIndexOffset;
+	uint padding0;
+	uint padding1;
+};
+
+struct TracerLight {
+	vec3 v0;
+	float cumulativePower;
+	vec3 v1;
+	float padding0;
+	vec3 v2;
+	float padding1;
+	vec3 emission;
+	float padding2;
+};
+
+struct BVHNode {
+	vec3 aabbMin;
+	uint leftFirst;
+	vec3 aabbMax;
+	uint primitiveCount;
+};
+
+// the geometry pool vertex arena, per mesh either Vertex records or compressed vertices and their colors
+layout(std430, set = 2, binding = 0) readonly buffer VertexBuffer {
+	uint vertexData[];
+};
+
+// the geometry pool index arena, indices are local to their mesh
+layout(std430, set = 2, binding = 1) readonly buffer IndexBuffer {
+	uint indices[];
+};
+
+layout(std430, set = 2, binding = 2) readonly buffer NodeBuffer {
+	BVHNode nodes[];
+};
+
+layout(std430, set = 2, binding = 3) readonly buffer PrimitiveBuffer {
+	uint primitives[];
+};
+
+layout(std430, set = 2, binding = 4) readonly buffer InstanceBuffer {
+	TracerInstance instances[];
+};
+
+// material index per triangle of the index buffer
+layout(std430, set = 2, binding = 5) readonly buffer TriangleMaterialBuffer {
+	uint triangleMaterials[];
+};
+
+// the engine's material table
+layout(std430, set = 2, binding = 6) readonly buffer MaterialBuffer {
+	GPUMaterial materials[];
+};
+
+// emissive triangles in world space with their cumulative power
+layout(std430, set = 2, binding = 7) readonly buffer LightBuffer {
+	TracerLight lights[];
+};
+
+// bindless tables indexed by the materials, entry 0 is a white texture and a linear sampler
+layout(set = 2, binding = 8) uniform sampler sceneSamplers[];
+layout(set = 2, binding = 9) uniform texture2D sceneTextures[];
+
+// BVH_MAX_DEPTH in bvh.hpp
+#define BVH_STACK_SIZE 64
+#define NO_HIT 1e30
+
+struct ray {
+	vec3 origin;
+	vec3 direction;
+};
+
+struct hitrecord {
+	float t;
+	uint instance;
+	// triangle index local to the instanced mesh
+	uint primitive;
+	vec2 barycentrics;
+};
+
+struct surfacerecord {
+	vec3 position;
+	// shading normal and geometric normal in world space, both facing the incoming ray
+	vec3 normal;
+	vec3 geometricNormal;
+	vec4 color;
+	vec2 uv;
+	uint material;
+	// log2 of the uv footprint of a ray cone of unit spread angle, see surface_at
+	float uvFootprint;
+};
+
+// base color of a material at a surface point. The index is divergent across the wave, compute shaders
+// have no derivatives so the mip level comes from the ray cone, spreadAngle is its log2 spread angle
+vec3 sample_base_color(GPUMaterial material, vec2 uv, float uvFootprint, float spreadAngle) {
+	uint textureIndex = material_base_color_texture(material);
+	uint samplerIndex = material_base_color_sampler(material);
+	vec2 size = vec2(textureSize(sampler2D(sceneTextures[nonuniformEXT(textureIndex)], sceneSamplers[nonuniformEXT(samplerIndex)]), 0));
+	float lod = uvFootprint + spreadAngle + 0.5 * log2(size.x * size.y);
+
+	vec4 texel = textureLod(sampler2D(sceneTextures[nonuniformEXT(textureIndex)], sceneSamplers[nonuniformEXT(samplerIndex)]), uv, lod);
+	return material_base_color(material).rgb * texel.rgb;
+}
+
+// Möller-Trumbore, returns the distance along the ray or NO_HIT
+float intersect_triangle(ray r, vec3 v0, vec3 v1, vec3 v2, out vec2 barycentrics) {
+	vec3 edge1 = v1 - v0;
+	vec3 edge2 = v2 - v0;
+	vec3 h = cross(r.direction, edge2);
+	float a = dot(edge1, h);
+	if (abs(a) < 1e-10) {
+		return NO_HIT;
+	}
+
+	float f = 1.0 / a;
+	vec3 s = r.origin - v0;
+	float u = f * dot(s, h);
+	if (u < 0.0 || u > 1.0) {
+		return NO_HIT;
+	}
+
+	vec3 q = cross(s, edge1);
+	float v = f * dot(r.direction, q);
+	if (v < 0.0 || u + v > 1.0) {
+		return NO_HIT;
+	}
+
+	float t = f * dot(edge2, q);
+	barycentrics = vec2(u, v);
+	return t > 0.0 ? t : NO_HIT;
+}
+
+// slab test, returns the entry distance or NO_HIT
+float intersect_aabb(ray r, vec3 invDirection, vec3 aabbMin, vec3 aabbMax, float tMax) {
+	vec3 t0 = (aabbMin - r.origin) * invDirection;
+	vec3 t1 = (aabbMax - r.origin) * invDirection;
+	vec3 tSmall = min(t0, t1);
+	vec3 tBig = max(t0, t1);
+	float tNear = max(max(tSmall.x, tSmall.y), tSmall.z);
+	float tFar = min(min(tBig.x, tBig.y), tBig.z);
+	return (tNear <= tFar && tFar > 0.0 && tNear < tMax) ? tNear : NO_HIT;
+}
+
+// the root of an empty BVH has inverted bounds and neither primitives nor children, the slab test
+// above would accept it
+bool empty_bvh(uint root) {
+	return any(greaterThan(nodes[root].aabbMin, nodes[root].aabbMax));
+}
+
+vec3 safe_inverse(vec3 direction) {
+	// avoid 0 * inf = nan in the slab test for axis aligned rays
+	vec3 safeDirection = mix(direction, vec3(1e-20), equal(direction, vec3(0.0)));
+	return 1.0 / safeDirection;
+}
+
+uint triangle_index(TracerInstance instance, uint primitive, uint corner) {
+	return indices[instance.poolIndexOffset + 3 * primitive + corner];
+}
+
+// only the position, traversal reads nothing else
+vec3 triangle_position(TracerInstance instance, uint primitive, uint corner) {
+	uint index = triangle_index(instance, primitive, corner);
+	if ((instance.vertexFlags & VERTEX_COMPRESSED) != 0) {
+		uint base = instance.vertexDataOffset + 4 * index;
+		return decode_position(vertexData[base], vertexData[base + 1], instance.positionOrigin, instance.positionExtent);
+	}
+
+	uint base = instance.vertexDataOffset + 12 * index;
+	return uintBitsToFloat(uvec3(vertexData[base], vertexData[base + 1], vertexData[base + 2]));
+}
+
+Vertex triangle_vertex(TracerInstance instance, uint primitive, uint corner) {
+	uint index = triangle_index(instance, primitive, corner);
+	Vertex v;
+	if ((instance.vertexFlags & VERTEX_COMPRESSED) != 0) {
+		uint base = instance.vertexDataOffset + 4 * index;
+		v.position = decode_position(vertexData[base], vertexData[base + 1], instance.positionOrigin, instance.positionExtent);
+		v.normal = decode_normal(vertexData[base + 2]);
+		vec2 uv = decode_uv(vertexData[base + 3]);
+		v.uv_x = uv.x;
+		v.uv_y = uv.y;
+		v.color = (instance.vertexFlags & VERTEX_COLORS) != 0 ? unpackUnorm4x8(vertexData[instance.colorOffset + index]) : vec4(1.0);
+		return v;
+	}
+
+	uint base = instance.vertexDataOffset + 12 * index;
+	v.position = uintBitsToFloat(uvec3(vertexData[base], vertexData[base + 1], vertexData[base + 2]));
+	v.uv_x = uintBitsToFloat(vertexData[base + 3]);
+	v.normal = uintBitsToFloat(uvec3(vertexData[base + 4], vertexData[base + 5], vertexData[base + 6]));
+	v.uv_y = uintBitsToFloat(vertexData[base + 7]);
+	v.color = uintBitsToFloat(uvec4(vertexData[base + 8], vertexData[base + 9], vertexData[base + 10], vertexData[base + 11]));
+	return v;
+}
+
+// nearest-child-first traversal of one bottom level BVH with a ray in object space
+void intersect_instance(ray objectRay, uint instanceIndex, inout hitrecord hit, inout bool found) {
+	TracerInstance instance = instances[instanceIndex];
+	vec3 invDirection = safe_inverse(objectRay.direction);
+
+	uint stack[BVH_STACK_SIZE];
+	uint stackSize = 0;
+	uint nodeIndex = instance.nodeOffset;
+
+	if (empty_bvh(nodeIndex) || intersect_aabb(objectRay, invDirection, nodes[nodeIndex].aabbMin, nodes[nodeIndex].aabbMax, hit.t) == NO_HIT) {
+		return;
+	}
+
+	while (true) {
+		BVHNode node = nodes[nodeIndex];
+
+		if (node.primitiveCount > 0) {
+			for (uint i = 0; i < node.primitiveCount; i++) {
+				uint primitive = primitives[instance.primitiveOffset + node.leftFirst + i];
+				vec3 v0 = triangle_position(instance, primitive, 0);
+				vec3 v1 = triangle_position(instance, primitive, 1);
+				vec3 v2 = triangle_position(instance, primitive, 2);
+
+				vec2 barycentrics;
+				float t = intersect_triangle(objectRay, v0, v1, v2, barycentrics);
+				if (t < hit.t) {
+					hit.t = t;
+					hit.instance = instanceIndex;
+					hit.primitive = primitive;
+					hit.barycentrics = barycentrics;
+					found = true;
+				}
+			}
+
+			if (stackSize == 0) {
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+			continue;
+		}
+
+		uint nearChild = instance.nodeOffset + node.leftFirst;
+		uint farChild = nearChild + 1;
+		float nearDistance = intersect_aabb(objectRay, invDirection, nodes[nearChild].aabbMin, nodes[nearChild].aabbMax, hit.t);
+		float farDistance = intersect_aabb(objectRay, invDirection, nodes[farChild].aabbMin, nodes[farChild].aabbMax, hit.t);
+
+		if (nearDistance > farDistance) {
+			uint tmpIndex = nearChild;
+			nearChild = farChild;
+			farChild = tmpIndex;
+
+			float tmpDistance = nearDistance;
+			nearDistance = farDistance;
+			farDistance = tmpDistance;
+		}
+
+		if (nearDistance == NO_HIT) {
+			if (stackSize == 0) {
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+		}
+		else {
+			nodeIndex = nearChild;
+			if (farDistance != NO_HIT && stackSize < BVH_STACK_SIZE) {
+				stack[stackSize++] = farChild;
+			}
+		}
+	}
+}
+
+// closest hit, walks the top level BVH over the instances and transforms the ray into object space
+// for every instance leaf. The direction is not renormalized, so distances are the same in both spaces.
+bool intersect_scene(ray r, float tMax, out hitrecord hit) {
+	vec3 invDirection = safe_inverse(r.direction);
+
+	hit.t = tMax;
+	bool found = false;
+
+	if (empty_bvh(0) || intersect_aabb(r, invDirection, nodes[0].aabbMin, nodes[0].aabbMax, tMax) == NO_HIT) {
+		return false;
+	}
+
+	uint stack[BVH_STACK_SIZE];
+	uint stackSize = 0;
+	uint nodeIndex = 0;
+
+	while (true) {
+		BVHNode node = nodes[nodeIndex];
+
+		if (node.primitiveCount > 0) {
+			for (uint i = 0; i < node.primitiveCount; i++) {
+				uint instanceIndex = primitives[node.leftFirst + i];
+				mat4 worldToObject = instances[instanceIndex].worldToObject;
+
+				ray objectRay;
+				objectRay.origin = (worldToObject * vec4(r.origin, 1.0)).xyz;
+				objectRay.direction = mat3(worldToObject) * r.direction;
+
+				intersect_instance(objectRay, instanceIndex, hit, found);
+			}
+
+			if (stackSize == 0) {
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+			continue;
+		}
+
+		uint nearChild = node.leftFirst;
+		uint farChild = node.leftFirst + 1;
+		float nearDistance = intersect_aabb(r, invDirection, nodes[nearChild].aabbMin, nodes[nearChild].aabbMax, hit.t);
+		float farDistance = intersect_aabb(r, invDirection, nodes[farChild].aabbMin, nodes[farChild].aabbMax, hit.t);
+
+		if (nearDistance > farDistance) {
+			uint tmpIndex = nearChild;
+			nearChild = farChild;
+			farChild = tmpIndex;
+
+			float tmpDistance = nearDistance;
+			nearDistance = farDistance;
+			farDistance = tmpDistance;
+		}
+
+		if (nearDistance == NO_HIT) {
+			if (stackSize == 0) {
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+		}
+		else {
+			nodeIndex = nearChild;
+			if (farDistance != NO_HIT && stackSize < BVH_STACK_SIZE) {
+				stack[stackSize++] = farChild;
+			}
+		}
+	}
+
+	return found;
+}
+
+// interpolated surface attributes at a hit, transformed to world space
+surfacerecord surface_at(ray r, hitrecord hit) {
+	TracerInstance instance = instances[hit.instance];
+	Vertex v0 = triangle_vertex(instance, hit.primitive, 0);
+	Vertex v1 = triangle_vertex(instance, hit.primitive, 1);
+	Vertex v2 = triangle_vertex(instance, hit.primitive, 2);
+	vec3 weights = vec3(1.0 - hit.barycentrics.x - hit.barycentrics.y, hit.barycentrics);
+
+	// normals transform with the inverse transpose
+	mat3 normalTransform = transpose(mat3(instance.worldToObject));
+
+	surfacerecord result;
+	result.position = r.origin + hit.t * r.direction;
+	result.geometricNormal = normalize(normalTransform * cross(v1.position - v0.position, v2.position - v0.position));
+	result.normal = normalize(normalTransform * (weights.x * v0.normal + weights.y * v1.normal + weights.z * v2.normal));
+	result.color = weights.x * v0.color + weights.y * v1.color + weights.z * v2.color;
+	result.uv = weights.x * vec2(v0.uv_x, v0.uv_y) + weights.y * vec2(v1.uv_x, v1.uv_y) + weights.z * vec2(v2.uv_x, v2.uv_y);
+	result.material = triangleMaterials[instance.indexOffset / 3 + hit.primitive];
+
+	// surfaces are treated as two sided
+	if (dot(result.geometricNormal, r.direction) > 0.0) {
+		result.geometricNormal = -result.geometricNormal;
+	}
+	if (dot(result.normal, result.geometricNormal) < 0.0) {
+		result.normal = -result.normal;
+	}
+
+	// ray cone texture LOD (Akenine-Möller et al. 2019): uv area per world area of the triangle, grown by
+	// the distance and the slope the ray meets it at
+	vec2 uv0 = vec2(v0.uv_x, v0.uv_y);
+	vec2 uvEdge1 = vec2(v1.uv_x, v1.uv_y) - uv0;
+	vec2 uvEdge2 = vec2(v2.uv_x, v2.uv_y) - uv0;
+	float uvArea = abs(uvEdge1.x * uvEdge2.y - uvEdge1.y * uvEdge2.x);
+	mat3 objectToWorld = mat3(instance.objectToWorld);
+	float worldArea = length(cross(objectToWorld * (v1.position - v0.position), objectToWorld * (v2.position - v0.position)));
+	float cosine = max(abs(dot(result.geometricNormal, r.direction)), 1e-4);
+	result.uvFootprint = 0.5 * log2(max(uvArea, 1e-20) / max(worldArea, 1e-20)) + log2(hit.t / cosine);
+
+	return result;
+}
@@ -0,0 +1,31 @@
+// compressed vertex format, same layout as CompressedVertex in vk_types.hpp (std430)
+
+#define VERTEX_COMPRESSED 1u
+#define VERTEX_COLORS 2u
+
+struct CompressedVertex {
+	// unorm16 position inside the mesh bounds, x and y then z and padding
+	uint positionXY;
+	uint positionZ;
+	// octahedral unit normal, snorm16 x and y
+	uint normal;
+	// half float u and v
+	uint uv;
+};
+
+vec3 decode_position(uint positionXY, uint positionZ, vec3 origin, vec3 extent) {
+	return origin + vec3(unpackUnorm2x16(positionXY), unpackUnorm2x16(positionZ).x) * extent;
+}
+
+vec3 decode_normal(uint encoded) {
+	vec2 octahedral = unpackSnorm2x16(encoded);
+	vec3 normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+	float fold = max(-normal.z, 0.0);
+	normal.x += normal.x >= 0.0 ? -fold : fold;
+	normal.y += normal.y >= 0.0 ? -fold : fold;
+	return normalize(normal);
+}
+
+vec2 decode_uv(uint encoded) {
+	return unpackHalf2x16(encoded);
+}
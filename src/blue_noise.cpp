@@ -0,0 +1,132 @@
+#include "blue_noise.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+
+// gaussian splat energy on a torus, updated incrementally whenever a pixel is toggled
+struct EnergyField {
+	uint32_t size;
+	std::vector<float> kernel;
+	std::vector<float> energy;
+
+	EnergyField(uint32_t size, float sigma) : size(size), kernel(size * size), energy(size * size, 0.f)
+	{
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				float dx = static_cast<float>(std::min(x, size - x));
+				float dy = static_cast<float>(std::min(y, size - y));
+				kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.f * sigma * sigma));
+			}
+		}
+	}
+
+	void splat(uint32_t pixel, float sign)
+	{
+		uint32_t px = pixel % size;
+		uint32_t py = pixel / size;
+		for (uint32_t y = 0; y < size; y++) {
+			uint32_t ky = (y + size - py) % size;
+			for (uint32_t x = 0; x < size; x++) {
+				uint32_t kx = (x + size - px) % size;
+				energy[y * size + x] += sign * kernel[ky * size + kx];
+			}
+		}
+	}
+
+	// minority pixel in the densest neighbourhood
+	uint32_t tightestCluster(const std::vector<uint8_t>& pattern) const
+	{
+		uint32_t best = 0;
+		float bestEnergy = -std::numeric_limits<float>::max();
+		for (uint32_t i = 0; i < pattern.size(); i++) {
+			if (pattern[i] && energy[i] > bestEnergy) {
+				bestEnergy = energy[i];
+				best = i;
+			}
+		}
+		return best;
+	}
+
+	// majority pixel in the emptiest neighbourhood
+	uint32_t largestVoid(const std::vector<uint8_t>& pattern) const
+	{
+		uint32_t best = 0;
+		float bestEnergy = std::numeric_limits<float>::max();
+		for (uint32_t i = 0; i < pattern.size(); i++) {
+			if (!pattern[i] && energy[i] < bestEnergy) {
+				bestEnergy = energy[i];
+				best = i;
+			}
+		}
+		return best;
+	}
+};
+
+}
+
+std::vector<uint32_t> generateBlueNoise(uint32_t size, uint32_t seed)
+{
+	const uint32_t pixelCount = size * size;
+	constexpr float sigma = 1.9f;
+
+	// random initial pattern with a tenth of the pixels set
+	std::mt19937 random(seed);
+	std::vector<uint32_t> shuffled(pixelCount);
+	for (uint32_t i = 0; i < pixelCount; i++) {
+		shuffled[i] = i;
+	}
+	std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+	const uint32_t initialCount = std::max(1u, pixelCount / 10);
+	std::vector<uint8_t> initialPattern(pixelCount, 0);
+	EnergyField field(size, sigma);
+	for (uint32_t i = 0; i < initialCount; i++) {
+		initialPattern[shuffled[i]] = 1;
+		field.splat(shuffled[i], 1.f);
+	}
+
+	// move pixels from the tightest cluster into the largest void until the pattern is stable
+	while (true) {
+		uint32_t cluster = field.tightestCluster(initialPattern);
+		initialPattern[cluster] = 0;
+		field.splat(cluster, -1.f);
+
+		uint32_t hole = field.largestVoid(initialPattern);
+		initialPattern[hole] = 1;
+		field.splat(hole, 1.f);
+
+		if (hole == cluster) {
+			break;
+		}
+	}
+
+	std::vector<uint32_t> ranks(pixelCount);
+
+	// the initial pixels are ranked by removing them cluster first
+	{
+		std::vector<uint8_t> pattern = initialPattern;
+		EnergyField removal = field;
+		for (uint32_t rank = initialCount; rank-- > 0;) {
+			uint32_t cluster = removal.tightestCluster(pattern);
+			pattern[cluster] = 0;
+			removal.splat(cluster, -1.f);
+			ranks[cluster] = rank;
+		}
+	}
+
+	// the rest fill the largest voids. Past half the mask the roles of set and unset pixels swap, but the
+	// tightest cluster of unset pixels is exactly the largest void, so the same search keeps working
+	std::vector<uint8_t> pattern = initialPattern;
+	for (uint32_t rank = initialCount; rank < pixelCount; rank++) {
+		uint32_t hole = field.largestVoid(pattern);
+		pattern[hole] = 1;
+		field.splat(hole, 1.f);
+		ranks[hole] = rank;
+	}
+
+	return ranks;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+// same as BLUE_NOISE_SIZE in pt_sampler.glsl
+constexpr uint32_t BLUE_NOISE_SIZE = 64;
+
+// size x size blue noise mask built with void and cluster, see "The void-and-cluster method for dither
+// array generation" (Ulichney). Every pixel holds its rank, a permutation of 0 .. size * size - 1.
+std::vector<uint32_t> generateBlueNoise(uint32_t size, uint32_t seed = 0);
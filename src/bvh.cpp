@@ -0,0 +1,192 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+// number of buckets the centroid range is split into when evaluating the SAH
+constexpr int BVH_BINS = 16;
+// cost of visiting a node relative to a primitive intersection
+constexpr float BVH_TRAVERSAL_COST = 1.f;
+
+void AABB::grow(const glm::vec3& point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void AABB::grow(const AABB& other)
+{
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+glm::vec3 AABB::center() const
+{
+	return (min + max) * 0.5f;
+}
+
+float AABB::area() const
+{
+	glm::vec3 extent = max - min;
+	if (extent.x < 0.f) {
+		return 0.f;
+	}
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+void BVH::build(std::span<const AABB> primitiveBounds)
+{
+	const uint32_t primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+
+	nodes.clear();
+	primitiveIndices.resize(primitiveCount);
+	std::iota(primitiveIndices.begin(), primitiveIndices.end(), 0);
+
+	std::vector<glm::vec3> centroids(primitiveCount);
+	for (uint32_t i = 0; i < primitiveCount; i++) {
+		centroids[i] = primitiveBounds[i].center();
+	}
+
+	// a binary tree over n primitives never has more than 2n - 1 nodes
+	nodes.reserve(primitiveCount > 0 ? 2 * primitiveCount - 1 : 1);
+
+	BVHNode& root = nodes.emplace_back();
+	root.leftFirst = 0;
+	root.primitiveCount = primitiveCount;
+
+	// an empty scene keeps a root with inverted bounds. The slab test accepts those, traversal has to
+	// check for an empty root itself
+	if (primitiveCount == 0) {
+		AABB empty;
+		root.aabbMin = empty.min;
+		root.aabbMax = empty.max;
+		return;
+	}
+
+	updateBounds(0, primitiveBounds);
+	subdivide(0, primitiveBounds, centroids, 0);
+
+	nodes.shrink_to_fit();
+}
+
+void BVH::buildTriangles(std::span<const Vertex> vertices, std::span<const uint32_t> indices)
+{
+	std::vector<AABB> triangleBounds(indices.size() / 3);
+	for (size_t i = 0; i < triangleBounds.size(); i++) {
+		triangleBounds[i].grow(vertices[indices[3 * i + 0]].position);
+		triangleBounds[i].grow(vertices[indices[3 * i + 1]].position);
+		triangleBounds[i].grow(vertices[indices[3 * i + 2]].position);
+	}
+
+	build(triangleBounds);
+}
+
+void BVH::updateBounds(uint32_t nodeIndex, std::span<const AABB> primitiveBounds)
+{
+	BVHNode& node = nodes[nodeIndex];
+
+	AABB bounds;
+	for (uint32_t i = 0; i < node.primitiveCount; i++) {
+		bounds.grow(primitiveBounds[primitiveIndices[node.leftFirst + i]]);
+	}
+
+	node.aabbMin = bounds.min;
+	node.aabbMax = bounds.max;
+}
+
+void BVH::subdivide(uint32_t nodeIndex, std::span<const AABB> primitiveBounds, std::span<const glm::vec3> centroids, uint32_t depth)
+{
+	const uint32_t first = nodes[nodeIndex].leftFirst;
+	const uint32_t count = nodes[nodeIndex].primitiveCount;
+
+	// inner nodes end one level above the limit, the traversal stacks get at most one entry per inner level
+	if (count <= 1 || depth + 1 >= BVH_MAX_DEPTH) {
+		return;
+	}
+
+	AABB centroidBounds;
+	for (uint32_t i = 0; i < count; i++) {
+		centroidBounds.grow(centroids[primitiveIndices[first + i]]);
+	}
+
+	// binned SAH, see "On fast Construction of SAH-based Bounding Volume Hierarchies" (Wald)
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	int bestSplit = 0;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float boundsMin = centroidBounds.min[axis];
+		float boundsMax = centroidBounds.max[axis];
+		if (boundsMin == boundsMax) {
+			continue;
+		}
+
+		AABB binBounds[BVH_BINS];
+		uint32_t binCount[BVH_BINS] = {};
+		float scale = BVH_BINS / (boundsMax - boundsMin);
+
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t primitive = primitiveIndices[first + i];
+			int bin = std::min(BVH_BINS - 1, static_cast<int>((centroids[primitive][axis] - boundsMin) * scale));
+			binCount[bin]++;
+			binBounds[bin].grow(primitiveBounds[primitive]);
+		}
+
+		// sweep from both sides to get the cost of every split plane in linear time
+		float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+		uint32_t leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+		AABB leftBox, rightBox;
+		uint32_t leftSum = 0, rightSum = 0;
+
+		for (int i = 0; i < BVH_BINS - 1; i++) {
+			leftSum += binCount[i];
+			leftCount[i] = leftSum;
+			leftBox.grow(binBounds[i]);
+			leftArea[i] = leftBox.area();
+
+			rightSum += binCount[BVH_BINS - 1 - i];
+			rightCount[BVH_BINS - 2 - i] = rightSum;
+			rightBox.grow(binBounds[BVH_BINS - 1 - i]);
+			rightArea[BVH_BINS - 2 - i] = rightBox.area();
+		}
+
+		for (int i = 0; i < BVH_BINS - 1; i++) {
+			float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+			if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	AABB nodeBounds{ nodes[nodeIndex].aabbMin, nodes[nodeIndex].aabbMax };
+	float leafCost = count * nodeBounds.area();
+	if (bestAxis == -1 || BVH_TRAVERSAL_COST * nodeBounds.area() + bestCost >= leafCost) {
+		return;
+	}
+
+	float boundsMin = centroidBounds.min[bestAxis];
+	float scale = BVH_BINS / (centroidBounds.max[bestAxis] - boundsMin);
+
+	auto middle = std::partition(primitiveIndices.begin() + first, primitiveIndices.begin() + first + count,
+		[&](uint32_t primitive) {
+			int bin = std::min(BVH_BINS - 1, static_cast<int>((centroids[primitive][bestAxis] - boundsMin) * scale));
+			return bin <= bestSplit;
+		});
+
+	uint32_t leftPrimitiveCount = static_cast<uint32_t>(middle - (primitiveIndices.begin() + first));
+
+	uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+	nodes.push_back(BVHNode{ .leftFirst = first, .primitiveCount = leftPrimitiveCount });
+	nodes.push_back(BVHNode{ .leftFirst = first + leftPrimitiveCount, .primitiveCount = count - leftPrimitiveCount });
+
+	nodes[nodeIndex].leftFirst = leftIndex;
+	nodes[nodeIndex].primitiveCount = 0;
+
+	updateBounds(leftIndex, primitiveBounds);
+	updateBounds(leftIndex + 1, primitiveBounds);
+
+	subdivide(leftIndex, primitiveBounds, centroids, depth + 1);
+	subdivide(leftIndex + 1, primitiveBounds, centroids, depth + 1);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <limits>
+
+#include "vk_types.hpp"
+
+struct AABB {
+	glm::vec3 min{ std::numeric_limits<float>::max() };
+	glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+	void grow(const glm::vec3& point);
+	void grow(const AABB& other);
+	glm::vec3 center() const;
+	float area() const;
+};
+
+// subdivision stops at this depth, so a nearest-first traversal never holds more far children on its stack
+constexpr uint32_t BVH_MAX_DEPTH = 64;
+
+// same layout as BVHNode in the tracer shaders (std430)
+struct BVHNode {
+	glm::vec3 aabbMin;
+	// index of the left child for inner nodes (the right child follows it), first primitive for leaves
+	uint32_t leftFirst;
+	glm::vec3 aabbMax;
+	// zero for inner nodes
+	uint32_t primitiveCount;
+};
+
+struct BVH {
+	std::vector<BVHNode> nodes;
+	// leaves reference ranges of this array, which maps back to the input primitive order
+	std::vector<uint32_t> primitiveIndices;
+
+	void build(std::span<const AABB> primitiveBounds);
+	// one primitive per indexed triangle
+	void buildTriangles(std::span<const Vertex> vertices, std::span<const uint32_t> indices);
+
+private:
+	void subdivide(uint32_t nodeIndex, std::span<const AABB> primitiveBounds, std::span<const glm::vec3> centroids, uint32_t depth);
+	void updateBounds(uint32_t nodeIndex, std::span<const AABB> primitiveBounds);
+};
@@ -0,0 +1,501 @@
+#include "bvh8.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BVH8_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC compiles intrinsics of any instruction set without extra flags
+#define BVH8_AVX2
+#else
+// only the kernels get AVX2 code, the rest of the binary still runs on any x86-64 CPU
+#define BVH8_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define BVH8_X86 0
+#endif
+
+namespace {
+
+// every visited level pushes at most seven more entries than it pops, and a wide level spans at least one
+// binary level
+constexpr uint32_t BVH8_STACK_SIZE = (BVH8_WIDTH - 1) * BVH_MAX_DEPTH + 1;
+
+struct RayData {
+	float origin[3];
+	float direction[3];
+	float invDirection[3];
+};
+
+struct ScalarKernels {
+	// bit i is set if the ray enters child i before tMax, distances receives the entry distances
+	static inline uint32_t intersectChildren(const BVH8Node& node, const RayData& ray, float tMax, float* distances)
+	{
+		uint32_t hitMask = 0;
+		for (uint32_t i = 0; i < node.childCount; i++) {
+			const float boxMin[3] = { node.minX[i], node.minY[i], node.minZ[i] };
+			const float boxMax[3] = { node.maxX[i], node.maxY[i], node.maxZ[i] };
+
+			float tNear = -std::numeric_limits<float>::max();
+			float tFar = std::numeric_limits<float>::max();
+			for (int axis = 0; axis < 3; axis++) {
+				float t0 = (boxMin[axis] - ray.origin[axis]) * ray.invDirection[axis];
+				float t1 = (boxMax[axis] - ray.origin[axis]) * ray.invDirection[axis];
+				tNear = std::max(tNear, std::min(t0, t1));
+				tFar = std::min(tFar, std::max(t0, t1));
+			}
+
+			distances[i] = tNear;
+			if (tNear <= tFar && tFar > 0.f && tNear < tMax) {
+				hitMask |= 1u << i;
+			}
+		}
+		return hitMask;
+	}
+
+	// Möller-Trumbore on every lane, returns true and shortens tMax if a lane hits before it
+	static inline bool intersectTriangles(const BVH8TriangleBlock& block, const RayData& ray, float& tMax, uint32_t& lane, float& u, float& v)
+	{
+		bool found = false;
+		for (uint32_t i = 0; i < BVH8_WIDTH; i++) {
+			float edge1[3] = { block.edge1X[i], block.edge1Y[i], block.edge1Z[i] };
+			float edge2[3] = { block.edge2X[i], block.edge2Y[i], block.edge2Z[i] };
+			const float* d = ray.direction;
+
+			float h[3] = { d[1] * edge2[2] - d[2] * edge2[1], d[2] * edge2[0] - d[0] * edge2[2], d[0] * edge2[1] - d[1] * edge2[0] };
+			float a = edge1[0] * h[0] + edge1[1] * h[1] + edge1[2] * h[2];
+			if (std::abs(a) < 1e-10f) {
+				continue;
+			}
+
+			float f = 1.f / a;
+			float s[3] = { ray.origin[0] - block.v0X[i], ray.origin[1] - block.v0Y[i], ray.origin[2] - block.v0Z[i] };
+			float laneU = f * (s[0] * h[0] + s[1] * h[1] + s[2] * h[2]);
+			if (laneU < 0.f || laneU > 1.f) {
+				continue;
+			}
+
+			float q[3] = { s[1] * edge1[2] - s[2] * edge1[1], s[2] * edge1[0] - s[0] * edge1[2], s[0] * edge1[1] - s[1] * edge1[0] };
+			float laneV = f * (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]);
+			if (laneV < 0.f || laneU + laneV > 1.f) {
+				continue;
+			}
+
+			float t = f * (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]);
+			if (t > 0.f && t < tMax) {
+				tMax = t;
+				lane = i;
+				u = laneU;
+				v = laneV;
+				found = true;
+			}
+		}
+		return found;
+	}
+};
+
+#if BVH8_X86
+struct AVX2Kernels {
+	BVH8_AVX2 static inline uint32_t intersectChildren(const BVH8Node& node, const RayData& ray, float tMax, float* distances)
+	{
+		__m256 originX = _mm256_set1_ps(ray.origin[0]);
+		__m256 originY = _mm256_set1_ps(ray.origin[1]);
+		__m256 originZ = _mm256_set1_ps(ray.origin[2]);
+		__m256 invX = _mm256_set1_ps(ray.invDirection[0]);
+		__m256 invY = _mm256_set1_ps(ray.invDirection[1]);
+		__m256 invZ = _mm256_set1_ps(ray.invDirection[2]);
+
+		__m256 t0X = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minX), originX), invX);
+		__m256 t1X = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxX), originX), invX);
+		__m256 t0Y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minY), originY), invY);
+		__m256 t1Y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxY), originY), invY);
+		__m256 t0Z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minZ), originZ), invZ);
+		__m256 t1Z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxZ), originZ), invZ);
+
+		__m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0X, t1X), _mm256_min_ps(t0Y, t1Y)), _mm256_min_ps(t0Z, t1Z));
+		__m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0X, t1X), _mm256_max_ps(t0Y, t1Y)), _mm256_max_ps(t0Z, t1Z));
+
+		__m256 hit = _mm256_and_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ), _mm256_cmp_ps(tFar, _mm256_setzero_ps(), _CMP_GT_OQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(tNear, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+		_mm256_storeu_ps(distances, tNear);
+		uint32_t validMask = (1u << node.childCount) - 1;
+		return static_cast<uint32_t>(_mm256_movemask_ps(hit)) & validMask;
+	}
+
+	BVH8_AVX2 static inline bool intersectTriangles(const BVH8TriangleBlock& block, const RayData& ray, float& tMax, uint32_t& lane, float& u, float& v)
+	{
+		__m256 dX = _mm256_set1_ps(ray.direction[0]);
+		__m256 dY = _mm256_set1_ps(ray.direction[1]);
+		__m256 dZ = _mm256_set1_ps(ray.direction[2]);
+		__m256 edge1X = _mm256_load_ps(block.edge1X);
+		__m256 edge1Y = _mm256_load_ps(block.edge1Y);
+		__m256 edge1Z = _mm256_load_ps(block.edge1Z);
+		__m256 edge2X = _mm256_load_ps(block.edge2X);
+		__m256 edge2Y = _mm256_load_ps(block.edge2Y);
+		__m256 edge2Z = _mm256_load_ps(block.edge2Z);
+
+		__m256 hX = _mm256_sub_ps(_mm256_mul_ps(dY, edge2Z), _mm256_mul_ps(dZ, edge2Y));
+		__m256 hY = _mm256_sub_ps(_mm256_mul_ps(dZ, edge2X), _mm256_mul_ps(dX, edge2Z));
+		__m256 hZ = _mm256_sub_ps(_mm256_mul_ps(dX, edge2Y), _mm256_mul_ps(dY, edge2X));
+		__m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge1X, hX), _mm256_mul_ps(edge1Y, hY)), _mm256_mul_ps(edge1Z, hZ));
+
+		__m256 absA = _mm256_andnot_ps(_mm256_set1_ps(-0.f), a);
+		__m256 mask = _mm256_cmp_ps(absA, _mm256_set1_ps(1e-10f), _CMP_GE_OQ);
+
+		__m256 f = _mm256_div_ps(_mm256_set1_ps(1.f), a);
+		__m256 sX = _mm256_sub_ps(_mm256_set1_ps(ray.origin[0]), _mm256_load_ps(block.v0X));
+		__m256 sY = _mm256_sub_ps(_mm256_set1_ps(ray.origin[1]), _mm256_load_ps(block.v0Y));
+		__m256 sZ = _mm256_sub_ps(_mm256_set1_ps(ray.origin[2]), _mm256_load_ps(block.v0Z));
+		__m256 laneU = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sX, hX), _mm256_mul_ps(sY, hY)), _mm256_mul_ps(sZ, hZ)));
+
+		__m256 qX = _mm256_sub_ps(_mm256_mul_ps(sY, edge1Z), _mm256_mul_ps(sZ, edge1Y));
+		__m256 qY = _mm256_sub_ps(_mm256_mul_ps(sZ, edge1X), _mm256_mul_ps(sX, edge1Z));
+		__m256 qZ = _mm256_sub_ps(_mm256_mul_ps(sX, edge1Y), _mm256_mul_ps(sY, edge1X));
+		__m256 laneV = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dX, qX), _mm256_mul_ps(dY, qY)), _mm256_mul_ps(dZ, qZ)));
+		__m256 t = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge2X, qX), _mm256_mul_ps(edge2Y, qY)), _mm256_mul_ps(edge2Z, qZ)));
+
+		__m256 zero = _mm256_setzero_ps();
+		__m256 one = _mm256_set1_ps(1.f);
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(laneU, zero, _CMP_GE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(laneU, one, _CMP_LE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(laneV, zero, _CMP_GE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(laneU, laneV), one, _CMP_LE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+		uint32_t hitMask = static_cast<uint32_t>(_mm256_movemask_ps(mask));
+		if (hitMask == 0) {
+			return false;
+		}
+
+		alignas(32) float distances[BVH8_WIDTH];
+		alignas(32) float us[BVH8_WIDTH];
+		alignas(32) float vs[BVH8_WIDTH];
+		_mm256_store_ps(distances, t);
+		_mm256_store_ps(us, laneU);
+		_mm256_store_ps(vs, laneV);
+
+		// the closest of the hit lanes, ties go to the lower lane like in the scalar kernel
+		lane = std::countr_zero(hitMask);
+		for (uint32_t bits = hitMask & (hitMask - 1); bits != 0; bits &= bits - 1) {
+			uint32_t i = std::countr_zero(bits);
+			if (distances[i] < distances[lane]) {
+				lane = i;
+			}
+		}
+
+		tMax = distances[lane];
+		u = us[lane];
+		v = vs[lane];
+		return true;
+	}
+};
+#endif
+
+// closest hit traversal, children are visited front to back and leaves are intersected as soon as their
+// parent is, so they shorten tMax before the inner siblings are pushed
+template<typename Kernels>
+inline bool traverse(const BVH8& bvh, const RayData& ray, float& tMax, uint32_t& primitive, glm::vec2& barycentrics)
+{
+	struct StackEntry {
+		uint32_t node;
+		float distance;
+	};
+
+	StackEntry stack[BVH8_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, 0.f };
+	bool found = false;
+
+	while (stackSize > 0) {
+		StackEntry entry = stack[--stackSize];
+		// a closer hit was found after the node was pushed
+		if (entry.distance >= tMax) {
+			continue;
+		}
+
+		const BVH8Node& node = bvh.nodes[entry.node];
+		float distances[BVH8_WIDTH];
+		uint32_t hitMask = Kernels::intersectChildren(node, ray, tMax, distances);
+
+		// insertion sort of the hit children by entry distance
+		uint32_t order[BVH8_WIDTH];
+		uint32_t hitCount = 0;
+		for (; hitMask != 0; hitMask &= hitMask - 1) {
+			uint32_t child = std::countr_zero(hitMask);
+			uint32_t slot = hitCount++;
+			while (slot > 0 && distances[order[slot - 1]] > distances[child]) {
+				order[slot] = order[slot - 1];
+				slot--;
+			}
+			order[slot] = child;
+		}
+
+		for (uint32_t i = 0; i < hitCount; i++) {
+			uint32_t child = order[i];
+			if (node.blockCount[child] == 0 || distances[child] >= tMax) {
+				continue;
+			}
+
+			for (uint32_t block = 0; block < node.blockCount[child]; block++) {
+				const BVH8TriangleBlock& triangles = bvh.triangleBlocks[node.child[child] + block];
+				uint32_t lane = 0;
+				float u = 0.f;
+				float v = 0.f;
+				if (Kernels::intersectTriangles(triangles, ray, tMax, lane, u, v)) {
+					primitive = triangles.primitive[lane];
+					barycentrics = glm::vec2(u, v);
+					found = true;
+				}
+			}
+		}
+
+		// back to front, so the nearest inner child is popped first
+		for (uint32_t i = hitCount; i-- > 0;) {
+			uint32_t child = order[i];
+			if (node.blockCount[child] == 0 && distances[child] < tMax) {
+				stack[stackSize++] = { node.child[child], distances[child] };
+			}
+		}
+	}
+
+	return found;
+}
+
+bool intersectScalar(const BVH8& bvh, const RayData& ray, float& tMax, uint32_t& primitive, glm::vec2& barycentrics)
+{
+	return traverse<ScalarKernels>(bvh, ray, tMax, primitive, barycentrics);
+}
+
+#if BVH8_X86
+// the attribute lets the compiler inline the AVX2 kernels into the traversal
+BVH8_AVX2 bool intersectAVX2(const BVH8& bvh, const RayData& ray, float& tMax, uint32_t& primitive, glm::vec2& barycentrics)
+{
+	return traverse<AVX2Kernels>(bvh, ray, tMax, primitive, barycentrics);
+}
+#endif
+
+bool cpuSupportsAVX2()
+{
+#if BVH8_X86 && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	// the operating system also has to preserve the upper halves of the ymm registers
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif BVH8_X86
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+using IntersectFunction = bool (*)(const BVH8& bvh, const RayData& ray, float& tMax, uint32_t& primitive, glm::vec2& barycentrics);
+
+struct KernelSelection {
+	IntersectFunction intersect;
+	const char* name;
+};
+
+const KernelSelection& selectedKernels()
+{
+#if BVH8_X86
+	static const KernelSelection selection = cpuSupportsAVX2()
+		? KernelSelection{ intersectAVX2, "avx2" }
+		: KernelSelection{ intersectScalar, "scalar" };
+#else
+	static const KernelSelection selection{ intersectScalar, "scalar" };
+#endif
+	return selection;
+}
+
+struct CollapseInput {
+	const BVH& bvh;
+	// triangles below every binary node
+	std::span<const uint32_t> triangleCounts;
+	std::span<const Vertex> vertices;
+	std::span<const uint32_t> indices;
+};
+
+// subtrees that fit into one triangle block become a single leaf, so the blocks are mostly full
+bool isWideLeaf(const CollapseInput& input, uint32_t binaryNode)
+{
+	return input.bvh.nodes[binaryNode].primitiveCount > 0 || input.triangleCounts[binaryNode] <= BVH8_WIDTH;
+}
+
+void gatherTriangles(const CollapseInput& input, uint32_t binaryNode, std::vector<uint32_t>& triangles)
+{
+	const BVHNode& node = input.bvh.nodes[binaryNode];
+	if (node.primitiveCount > 0) {
+		for (uint32_t i = 0; i < node.primitiveCount; i++) {
+			triangles.push_back(input.bvh.primitiveIndices[node.leftFirst + i]);
+		}
+		return;
+	}
+
+	gatherTriangles(input, node.leftFirst, triangles);
+	gatherTriangles(input, node.leftFirst + 1, triangles);
+}
+
+// writes the triangles below binaryNode into new blocks and returns their count
+uint32_t addTriangles(BVH8& wide, const CollapseInput& input, uint32_t binaryNode)
+{
+	std::vector<uint32_t> triangles;
+	gatherTriangles(input, binaryNode, triangles);
+
+	uint32_t blockCount = (static_cast<uint32_t>(triangles.size()) + BVH8_WIDTH - 1) / BVH8_WIDTH;
+	size_t firstBlock = wide.triangleBlocks.size();
+	wide.triangleBlocks.resize(firstBlock + blockCount);
+
+	for (uint32_t i = 0; i < triangles.size(); i++) {
+		uint32_t primitive = triangles[i];
+		glm::vec3 v0 = input.vertices[input.indices[3 * primitive + 0]].position;
+		glm::vec3 edge1 = input.vertices[input.indices[3 * primitive + 1]].position - v0;
+		glm::vec3 edge2 = input.vertices[input.indices[3 * primitive + 2]].position - v0;
+
+		BVH8TriangleBlock& block = wide.triangleBlocks[firstBlock + i / BVH8_WIDTH];
+		uint32_t lane = i % BVH8_WIDTH;
+		block.v0X[lane] = v0.x;
+		block.v0Y[lane] = v0.y;
+		block.v0Z[lane] = v0.z;
+		block.edge1X[lane] = edge1.x;
+		block.edge1Y[lane] = edge1.y;
+		block.edge1Z[lane] = edge1.z;
+		block.edge2X[lane] = edge2.x;
+		block.edge2Y[lane] = edge2.y;
+		block.edge2Z[lane] = edge2.z;
+		block.primitive[lane] = primitive;
+	}
+
+	return blockCount;
+}
+
+// turns the binary subtree at binaryNode into a wide node and returns its index
+uint32_t collapse(BVH8& wide, const CollapseInput& input, uint32_t binaryNode)
+{
+	const BVH& bvh = input.bvh;
+
+	uint32_t children[BVH8_WIDTH];
+	uint32_t childCount = 0;
+	if (isWideLeaf(input, binaryNode)) {
+		children[childCount++] = binaryNode;
+	}
+	else {
+		children[childCount++] = bvh.nodes[binaryNode].leftFirst;
+		children[childCount++] = bvh.nodes[binaryNode].leftFirst + 1;
+	}
+
+	// opens the inner child with the largest surface area until the node is full, the largest boxes are
+	// the ones most likely to be entered by a ray
+	while (childCount < BVH8_WIDTH) {
+		int largest = -1;
+		float largestArea = -1.f;
+		for (uint32_t i = 0; i < childCount; i++) {
+			const BVHNode& child = bvh.nodes[children[i]];
+			float area = AABB{ child.aabbMin, child.aabbMax }.area();
+			if (!isWideLeaf(input, children[i]) && area > largestArea) {
+				largest = static_cast<int>(i);
+				largestArea = area;
+			}
+		}
+
+		if (largest == -1) {
+			break;
+		}
+
+		uint32_t opened = children[largest];
+		children[largest] = bvh.nodes[opened].leftFirst;
+		children[childCount++] = bvh.nodes[opened].leftFirst + 1;
+	}
+
+	uint32_t wideIndex = static_cast<uint32_t>(wide.nodes.size());
+	wide.nodes.emplace_back();
+
+	for (uint32_t i = 0; i < childCount; i++) {
+		uint32_t childIndex;
+		uint32_t blockCount = 0;
+		if (isWideLeaf(input, children[i])) {
+			childIndex = static_cast<uint32_t>(wide.triangleBlocks.size());
+			blockCount = addTriangles(wide, input, children[i]);
+		}
+		else {
+			childIndex = collapse(wide, input, children[i]);
+		}
+
+		// the recursion may have reallocated the nodes
+		const BVHNode& child = bvh.nodes[children[i]];
+		BVH8Node& wideNode = wide.nodes[wideIndex];
+		wideNode.minX[i] = child.aabbMin.x;
+		wideNode.minY[i] = child.aabbMin.y;
+		wideNode.minZ[i] = child.aabbMin.z;
+		wideNode.maxX[i] = child.aabbMax.x;
+		wideNode.maxY[i] = child.aabbMax.y;
+		wideNode.maxZ[i] = child.aabbMax.z;
+		wideNode.child[i] = childIndex;
+		wideNode.blockCount[i] = blockCount;
+	}
+
+	wide.nodes[wideIndex].childCount = childCount;
+	return wideIndex;
+}
+
+}
+
+void BVH8::build(const BVH& bvh, std::span<const Vertex> vertices, std::span<const uint32_t> indices)
+{
+	nodes.clear();
+	triangleBlocks.clear();
+
+	// an empty mesh keeps a root without children
+	if (bvh.nodes.empty() || indices.empty()) {
+		nodes.emplace_back();
+		return;
+	}
+
+	// children are stored after their parents, so a reverse pass sees them first
+	std::vector<uint32_t> triangleCounts(bvh.nodes.size(), 0);
+	for (size_t i = bvh.nodes.size(); i-- > 0;) {
+		const BVHNode& node = bvh.nodes[i];
+		if (node.primitiveCount > 0) {
+			triangleCounts[i] = node.primitiveCount;
+		}
+		else if (node.leftFirst > i) {
+			triangleCounts[i] = triangleCounts[node.leftFirst] + triangleCounts[node.leftFirst + 1];
+		}
+	}
+
+	CollapseInput input{
+		.bvh = bvh,
+		.triangleCounts = triangleCounts,
+		.vertices = vertices,
+		.indices = indices,
+	};
+	collapse(*this, input, 0);
+}
+
+bool BVH8::intersect(const glm::vec3& origin, const glm::vec3& direction, float& tMax, uint32_t& primitive, glm::vec2& barycentrics) const
+{
+	RayData ray;
+	for (int axis = 0; axis < 3; axis++) {
+		ray.origin[axis] = origin[axis];
+		ray.direction[axis] = direction[axis];
+		// avoid 0 * inf = nan in the slab test for axis aligned rays
+		ray.invDirection[axis] = 1.f / (direction[axis] == 0.f ? 1e-20f : direction[axis]);
+	}
+
+	return selectedKernels().intersect(*this, ray, tMax, primitive, barycentrics);
+}
+
+const char* bvh8KernelName()
+{
+	return selectedKernels().name;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vk_types.hpp"
+#include "bvh.hpp"
+
+constexpr uint32_t BVH8_WIDTH = 8;
+
+// up to eight children with their bounds stored per axis, so one ray is tested against all of them
+// with a single 8-wide slab test
+struct alignas(32) BVH8Node {
+	float minX[BVH8_WIDTH];
+	float minY[BVH8_WIDTH];
+	float minZ[BVH8_WIDTH];
+	float maxX[BVH8_WIDTH];
+	float maxY[BVH8_WIDTH];
+	float maxZ[BVH8_WIDTH];
+	// node index for inner children, first triangle block for leaves
+	uint32_t child[BVH8_WIDTH];
+	// triangle blocks of leaf children, 0 for inner children
+	uint32_t blockCount[BVH8_WIDTH];
+	// children are packed into the first slots
+	uint32_t childCount;
+};
+
+// eight triangles prepared for Möller-Trumbore, unused lanes have zero edges and never hit
+struct alignas(32) BVH8TriangleBlock {
+	float v0X[BVH8_WIDTH];
+	float v0Y[BVH8_WIDTH];
+	float v0Z[BVH8_WIDTH];
+	float edge1X[BVH8_WIDTH];
+	float edge1Y[BVH8_WIDTH];
+	float edge1Z[BVH8_WIDTH];
+	float edge2X[BVH8_WIDTH];
+	float edge2Y[BVH8_WIDTH];
+	float edge2Z[BVH8_WIDTH];
+	// triangle index in the mesh index buffer
+	uint32_t primitive[BVH8_WIDTH];
+};
+
+// 8-wide BVH for CPU ray tracing, collapsed from the binary SAH BVH of a mesh. Traversal runs AVX2 kernels
+// when the CPU has them and scalar kernels with the same results otherwise.
+struct BVH8 {
+	std::vector<BVH8Node> nodes;
+	std::vector<BVH8TriangleBlock> triangleBlocks;
+
+	void build(const BVH& bvh, std::span<const Vertex> vertices, std::span<const uint32_t> indices);
+
+	// closest hit before tMax, which is shortened to the hit distance. The ray is in the space of the vertices.
+	bool intersect(const glm::vec3& origin, const glm::vec3& direction, float& tMax, uint32_t& primitive, glm::vec2& barycentrics) const;
+};
+
+// name of the traversal kernels selected for this CPU
+const char* bvh8KernelName();
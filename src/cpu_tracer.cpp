@@ -0,0 +1,408 @@
+#include "cpu_tracer.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include <glm/gtc/packing.hpp>
+
+namespace {
+
+constexpr float NO_HIT = 1e30f;
+constexpr uint32_t BVH_STACK_SIZE = BVH_MAX_DEPTH;
+constexpr float PI = 3.14159265359f;
+
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+struct Hit {
+	float t;
+	uint32_t instance;
+	// triangle index local to the instanced mesh
+	uint32_t primitive;
+	glm::vec2 barycentrics;
+};
+
+struct Surface {
+	glm::vec3 position;
+	// shading normal and geometric normal in world space, both facing the incoming ray
+	glm::vec3 normal;
+	glm::vec3 geometricNormal;
+	glm::vec4 color;
+	uint32_t material;
+};
+
+// pcg hash, see "Hash Functions for GPU Rendering" (Jarzynski, Olano)
+uint32_t pcgHash(uint32_t value)
+{
+	uint32_t state = value * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float randomFloat(uint32_t& state)
+{
+	state = pcgHash(state);
+	// top 24 bits so the result is exactly representable and stays below 1
+	return static_cast<float>(state >> 8) * (1.f / 16777216.f);
+}
+
+float luminance(const glm::vec3& color)
+{
+	return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+glm::vec3 skyColor(const glm::vec3& direction)
+{
+	float a = 0.5f * (glm::normalize(direction).y + 1.f);
+	return (1.f - a) * glm::vec3(1.f) + a * glm::vec3(0.5f, 0.7f, 1.f);
+}
+
+// cosine weighted direction around the normal
+glm::vec3 sampleHemisphere(const glm::vec3& normal, uint32_t& rngState)
+{
+	float phi = 2.f * PI * randomFloat(rngState);
+	float r2 = randomFloat(rngState);
+	float r = std::sqrt(r2);
+
+	glm::vec3 helper = std::abs(normal.x) > 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+	glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+
+	return glm::normalize(tangent * (std::cos(phi) * r) + bitangent * (std::sin(phi) * r) + normal * std::sqrt(1.f - r2));
+}
+
+float powerHeuristic(float pdf, float otherPdf)
+{
+	float weight = pdf * pdf;
+	return weight / (weight + otherPdf * otherPdf);
+}
+
+// slab test, returns the entry distance or NO_HIT
+float intersectAABB(const Ray& ray, const glm::vec3& invDirection, const BVHNode& node, float tMax)
+{
+	glm::vec3 t0 = (node.aabbMin - ray.origin) * invDirection;
+	glm::vec3 t1 = (node.aabbMax - ray.origin) * invDirection;
+	glm::vec3 tSmall = glm::min(t0, t1);
+	glm::vec3 tBig = glm::max(t0, t1);
+	float tNear = std::max(std::max(tSmall.x, tSmall.y), tSmall.z);
+	float tFar = std::min(std::min(tBig.x, tBig.y), tBig.z);
+	return (tNear <= tFar && tFar > 0.f && tNear < tMax) ? tNear : NO_HIT;
+}
+
+glm::vec3 safeInverse(glm::vec3 direction)
+{
+	// avoid 0 * inf = nan in the slab test for axis aligned rays
+	for (int axis = 0; axis < 3; axis++) {
+		if (direction[axis] == 0.f) {
+			direction[axis] = 1e-20f;
+		}
+	}
+	return 1.f / direction;
+}
+
+// nearest-child-first traversal of the BVH rooted at nodeOffset, child indices are relative to it.
+// Calls leaf(node) for every leaf the ray enters before tMax, which the leaf function may shorten.
+template<typename LeafFunction>
+void traverse(const TracerScene& scene, uint32_t nodeOffset, const Ray& ray, const float& tMax, LeafFunction&& leaf)
+{
+	glm::vec3 invDirection = safeInverse(ray.direction);
+
+	// the root of an empty BVH is a node without primitives or children
+	const BVHNode& root = scene.nodes[nodeOffset];
+	if (glm::any(glm::greaterThan(root.aabbMin, root.aabbMax))) {
+		return;
+	}
+
+	if (intersectAABB(ray, invDirection, root, tMax) == NO_HIT) {
+		return;
+	}
+
+	uint32_t stack[BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = nodeOffset;
+
+	while (true) {
+		const BVHNode& node = scene.nodes[nodeIndex];
+
+		if (node.primitiveCount > 0) {
+			leaf(node);
+
+			if (stackSize == 0) {
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+			continue;
+		}
+
+		uint32_t nearChild = nodeOffset + node.leftFirst;
+		uint32_t farChild = nearChild + 1;
+		float nearDistance = intersectAABB(ray, invDirection, scene.nodes[nearChild], tMax);
+		float farDistance = intersectAABB(ray, invDirection, scene.nodes[farChild], tMax);
+
+		if (nearDistance > farDistance) {
+			std::swap(nearChild, farChild);
+			std::swap(nearDistance, farDistance);
+		}
+
+		if (nearDistance == NO_HIT) {
+			if (stackSize == 0) {
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+		}
+		else {
+			nodeIndex = nearChild;
+			// only BVHs deeper than BVH_MAX_DEPTH, like ones of an older scene cache, can fill the stack
+			if (farDistance != NO_HIT && stackSize < BVH_STACK_SIZE) {
+				stack[stackSize++] = farChild;
+			}
+		}
+	}
+}
+
+const Vertex& triangleVertex(const TracerScene& scene, const TracerInstance& instance, uint32_t primitive, uint32_t corner)
+{
+	return scene.vertices[instance.vertexOffset + scene.indices[instance.indexOffset + 3 * primitive + corner]];
+}
+
+// closest hit through the top level BVH, rays are transformed into object space for every instance leaf.
+// The direction is not renormalized, so distances are the same in both spaces.
+bool intersectScene(const TracerScene& scene, const Ray& ray, float tMax, Hit& hit)
+{
+	hit.t = tMax;
+	bool found = false;
+
+	traverse(scene, 0, ray, hit.t, [&](const BVHNode& topLevelLeaf) {
+		for (uint32_t i = 0; i < topLevelLeaf.primitiveCount; i++) {
+			uint32_t instanceIndex = scene.primitives[topLevelLeaf.leftFirst + i];
+			const TracerInstance& instance = scene.instances[instanceIndex];
+
+			Ray objectRay{
+				.origin = glm::vec3(instance.worldToObject * glm::vec4(ray.origin, 1.f)),
+				.direction = glm::mat3(instance.worldToObject) * ray.direction,
+			};
+
+			const BVH8& bottomLevel = scene.wideBottomLevels[scene.instanceWideBottomLevels[instanceIndex]];
+			uint32_t primitive;
+			glm::vec2 barycentrics;
+			if (bottomLevel.intersect(objectRay.origin, objectRay.direction, hit.t, primitive, barycentrics)) {
+				hit.instance = instanceIndex;
+				hit.primitive = primitive;
+				hit.barycentrics = barycentrics;
+				found = true;
+			}
+		}
+	});
+
+	return found;
+}
+
+// interpolated surface attributes at a hit, transformed to world space
+Surface surfaceAt(const TracerScene& scene, const Ray& ray, const Hit& hit)
+{
+	const TracerInstance& instance = scene.instances[hit.instance];
+	const Vertex& v0 = triangleVertex(scene, instance, hit.primitive, 0);
+	const Vertex& v1 = triangleVertex(scene, instance, hit.primitive, 1);
+	const Vertex& v2 = triangleVertex(scene, instance, hit.primitive, 2);
+	glm::vec3 weights(1.f - hit.barycentrics.x - hit.barycentrics.y, hit.barycentrics.x, hit.barycentrics.y);
+
+	// normals transform with the inverse transpose
+	glm::mat3 normalTransform = glm::transpose(glm::mat3(instance.worldToObject));
+
+	Surface result;
+	result.position = ray.origin + hit.t * ray.direction;
+	result.geometricNormal = glm::normalize(normalTransform * glm::cross(v1.position - v0.position, v2.position - v0.position));
+	result.normal = glm::normalize(normalTransform * (weights.x * v0.normal + weights.y * v1.normal + weights.z * v2.normal));
+	result.color = weights.x * v0.color + weights.y * v1.color + weights.z * v2.color;
+	result.material = scene.triangleMaterials[instance.indexOffset / 3 + hit.primitive];
+
+	// surfaces are treated as two sided
+	if (glm::dot(result.geometricNormal, ray.direction) > 0.f) {
+		result.geometricNormal = -result.geometricNormal;
+	}
+	if (glm::dot(result.normal, result.geometricNormal) < 0.f) {
+		result.normal = -result.normal;
+	}
+
+	return result;
+}
+
+}
+
+void CpuTracer::reset()
+{
+	sampleIndex = 0;
+	std::fill(accumulation.begin(), accumulation.end(), glm::vec4(0.f));
+}
+
+std::span<const uint64_t> CpuTracer::renderPass(JobSystem& jobs, const TracerScene& tracerScene, const GPUSceneData& tracerSceneData, VkExtent2D passExtent)
+{
+	if (passExtent.width != extent.width || passExtent.height != extent.height) {
+		extent = passExtent;
+		accumulation.assign(extent.width * extent.height, glm::vec4(0.f));
+		pixels.assign(extent.width * extent.height, 0);
+		sampleIndex = 0;
+	}
+
+	auto start = std::chrono::system_clock::now();
+
+	scene = &tracerScene;
+	sceneData = &tracerSceneData;
+	tilesX = (extent.width + CPU_TRACER_TILE_SIZE - 1) / CPU_TRACER_TILE_SIZE;
+	uint32_t tileCount = tilesX * ((extent.height + CPU_TRACER_TILE_SIZE - 1) / CPU_TRACER_TILE_SIZE);
+	std::atomic<uint64_t> passRays = 0;
+
+	// one job per tile, threads that got cheap tiles simply take more of them
+	jobs.parallelFor(tileCount, 1, [&](uint32_t firstTile, uint32_t endTile) {
+		uint64_t rays = 0;
+		for (uint32_t tile = firstTile; tile < endTile; tile++) {
+			traceTile(tile, rays);
+		}
+		passRays += rays;
+	});
+
+	sampleIndex++;
+
+	auto end = std::chrono::system_clock::now();
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+	rayCount = passRays;
+	raysPerSecond = elapsed.count() > 0 ? rayCount * 1'000'000.f / elapsed.count() : 0.f;
+
+	return pixels;
+}
+
+void CpuTracer::traceTile(uint32_t tile, uint64_t& rays)
+{
+	uint32_t originX = (tile % tilesX) * CPU_TRACER_TILE_SIZE;
+	uint32_t originY = (tile / tilesX) * CPU_TRACER_TILE_SIZE;
+	uint32_t endX = std::min(originX + CPU_TRACER_TILE_SIZE, extent.width);
+	uint32_t endY = std::min(originY + CPU_TRACER_TILE_SIZE, extent.height);
+
+	// the view matrix is a rigid transform, so its inverse rotation is the transpose
+	glm::mat3 cameraRotation = glm::transpose(glm::mat3(sceneData->view));
+	glm::vec3 cameraCenter = -(cameraRotation * glm::vec3(sceneData->view[3]));
+
+	for (uint32_t y = originY; y < endY; y++) {
+		for (uint32_t x = originX; x < endX; x++) {
+			uint32_t pixel = y * extent.width + x;
+			uint32_t rngState = pcgHash(pixel + pcgHash(sampleIndex));
+
+			// jittered position inside the pixel in normalized device coordinates
+			float ndcX = (x + randomFloat(rngState)) / extent.width * 2.f - 1.f;
+			float ndcY = (y + randomFloat(rngState)) / extent.height * 2.f - 1.f;
+			glm::vec3 direction = glm::normalize(cameraRotation
+				* glm::vec3(ndcX / sceneData->projection[0][0], ndcY / sceneData->projection[1][1], -1.f));
+
+			glm::vec3 radiance = tracePath(cameraCenter, direction, rngState, rays);
+
+			accumulation[pixel] += glm::vec4(radiance, 1.f);
+			pixels[pixel] = glm::packHalf4x16(glm::vec4(glm::vec3(accumulation[pixel]) / accumulation[pixel].w, 1.f));
+		}
+	}
+}
+
+glm::vec3 CpuTracer::tracePath(glm::vec3 origin, glm::vec3 direction, uint32_t& rngState, uint64_t& rays) const
+{
+	const TracerScene& tracerScene = *scene;
+
+	bool hasSun = sceneData->sunlightColor.w > 0.f;
+	float sunProbability = tracerScene.lights.empty() ? (hasSun ? 1.f : 0.f) : (hasSun ? 0.5f : 0.f);
+	float totalPower = tracerScene.lights.empty() ? 0.f : tracerScene.lights.back().cumulativePower;
+
+	// solid angle density of reaching a point on an emissive triangle through light sampling
+	auto lightPdf = [&](const glm::vec3& emission, float distance, float lightCosine) {
+		return (1.f - sunProbability) * luminance(emission) / totalPower * distance * distance / lightCosine;
+	};
+
+	auto occluded = [&](const Ray& shadowRay, float tMax) {
+		Hit shadowHit;
+		rays++;
+		return intersectScene(tracerScene, shadowRay, tMax, shadowHit);
+	};
+
+	glm::vec3 radiance(0.f);
+	glm::vec3 throughput(1.f);
+	float bsdfPdf = 0.f;
+	Ray ray{ origin, direction };
+
+	for (uint32_t depth = 0; depth < maxDepth; depth++) {
+		Hit hit;
+		rays++;
+		if (!intersectScene(tracerScene, ray, NO_HIT, hit)) {
+			radiance += throughput * skyColor(ray.direction);
+			break;
+		}
+
+		Surface surface = surfaceAt(tracerScene, ray, hit);
+		const GPUMaterial& material = tracerScene.materialTable->materials[surface.material];
+		glm::vec3 emission = unpackEmission(material);
+		glm::vec3 hitOrigin = surface.position + surface.geometricNormal * 1e-4f;
+
+		// emission reached by the sampled direction, weighted against sampling the same triangle as a light
+		if (luminance(emission) > 0.f) {
+			float weight = 1.f;
+			if (depth > 0) {
+				float lightCosine = glm::dot(surface.geometricNormal, -ray.direction);
+				weight = powerHeuristic(bsdfPdf, lightPdf(emission, hit.t, lightCosine));
+			}
+			radiance += throughput * emission * weight;
+		}
+
+		glm::vec3 albedo = glm::vec3(unpackBaseColor(material)) * glm::vec3(surface.color);
+		glm::vec3 brdf = albedo / PI;
+
+		// one light sample per hit, like the GPU tracer
+		if (randomFloat(rngState) < sunProbability) {
+			glm::vec3 sunDirection = glm::normalize(glm::vec3(sceneData->sunlightDrection));
+			float cosine = glm::dot(surface.normal, sunDirection);
+			if (cosine > 0.f && glm::dot(surface.geometricNormal, sunDirection) > 0.f && !occluded(Ray{ hitOrigin, sunDirection }, NO_HIT)) {
+				glm::vec3 sunRadiance = glm::vec3(sceneData->sunlightColor) * sceneData->sunlightColor.w;
+				radiance += throughput * brdf * sunRadiance * cosine / sunProbability;
+			}
+		}
+		else if (!tracerScene.lights.empty()) {
+			float target = randomFloat(rngState) * totalPower;
+			auto selected = std::upper_bound(tracerScene.lights.begin(), tracerScene.lights.end(), target,
+				[](float value, const TracerLight& light) { return value < light.cumulativePower; });
+			const TracerLight& light = selected == tracerScene.lights.end() ? tracerScene.lights.back() : *selected;
+
+			float r1 = std::sqrt(randomFloat(rngState));
+			float r2 = randomFloat(rngState);
+			glm::vec3 lightPoint = light.v0 * (1.f - r1) + light.v1 * (r1 * (1.f - r2)) + light.v2 * (r1 * r2);
+
+			glm::vec3 toLight = lightPoint - hitOrigin;
+			float distance = glm::length(toLight);
+			glm::vec3 lightDirection = toLight / distance;
+
+			float cosine = glm::dot(surface.normal, lightDirection);
+			float lightCosine = std::abs(glm::dot(glm::normalize(glm::cross(light.v1 - light.v0, light.v2 - light.v0)), lightDirection));
+
+			// stops short of the light so it does not shadow itself
+			if (cosine > 0.f && glm::dot(surface.geometricNormal, lightDirection) > 0.f && lightCosine > 0.f
+				&& !occluded(Ray{ hitOrigin, lightDirection }, distance * 0.999f)) {
+				float pdf = lightPdf(light.emission, distance, lightCosine);
+				float weight = powerHeuristic(pdf, cosine / PI);
+				radiance += throughput * brdf * light.emission * cosine * weight / pdf;
+			}
+		}
+
+		throughput *= albedo;
+
+		// russian roulette once the path had a few bounces
+		if (depth + 1 > 3) {
+			float survival = std::clamp(std::max({ throughput.x, throughput.y, throughput.z }), 0.05f, 1.f);
+			if (randomFloat(rngState) > survival) {
+				break;
+			}
+			throughput /= survival;
+		}
+
+		ray.origin = hitOrigin;
+		ray.direction = sampleHemisphere(surface.normal, rngState);
+		bsdfPdf = std::max(glm::dot(surface.normal, ray.direction), 0.f) / PI;
+	}
+
+	return radiance;
+}
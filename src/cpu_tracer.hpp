@@ -0,0 +1,39 @@
+#pragma once
+
+#include "vk_types.hpp"
+#include "tracer_scene.hpp"
+#include "job_system.hpp"
+
+// edge length of the tiles the worker threads pull, small enough to balance uneven tiles
+constexpr uint32_t CPU_TRACER_TILE_SIZE = 16;
+
+// reference path tracer on the CPU. It traces the TracerScene arrays the GPU stages are uploaded from with
+// the same light transport as pt_shade (diffuse surfaces, sky, next event estimation with MIS), so its
+// images can be compared against the GPU tracer and it can render on machines without a GPU.
+struct CpuTracer {
+	uint32_t maxDepth = 8;
+	// completed passes, every pass adds one sample to every pixel
+	uint32_t sampleIndex = 0;
+	// rays of the last pass, shadow rays included, and the rate they were traced at
+	uint64_t rayCount = 0;
+	float raysPerSecond = 0.f;
+
+	void reset();
+	// traces one sample per pixel on the job system and returns the mean radiance as rgba16f in the layout
+	// of the draw image
+	std::span<const uint64_t> renderPass(JobSystem& jobs, const TracerScene& scene, const GPUSceneData& sceneData, VkExtent2D extent);
+
+private:
+	// inputs of the running pass
+	const TracerScene* scene = nullptr;
+	const GPUSceneData* sceneData = nullptr;
+	VkExtent2D extent{ 0, 0 };
+	uint32_t tilesX = 0;
+
+	// rgb radiance sum and sample count per pixel
+	std::vector<glm::vec4> accumulation;
+	std::vector<uint64_t> pixels;
+
+	void traceTile(uint32_t tile, uint64_t& rays);
+	glm::vec3 tracePath(glm::vec3 origin, glm::vec3 direction, uint32_t& rngState, uint64_t& rays) const;
+};
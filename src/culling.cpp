@@ -0,0 +1,125 @@
+#include "culling.hpp"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CULLING_SSE 1
+#include <xmmintrin.h>
+#else
+#define CULLING_SSE 0
+#endif
+
+Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	auto row = [&](int i) {
+		return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	};
+
+	// -w <= x <= w, -w <= y <= w and 0 <= z <= w in clip space
+	Frustum frustum{ {
+		row(3) + row(0),
+		row(3) - row(0),
+		row(3) + row(1),
+		row(3) - row(1),
+		row(2),
+		row(3) - row(2),
+	} };
+
+	for (glm::vec4& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return frustum;
+}
+
+Bounds transformBounds(const Bounds& bounds, const glm::mat4& transform)
+{
+	glm::mat3 absolute{ glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])), glm::abs(glm::vec3(transform[2])) };
+	glm::vec3 extents = absolute * bounds.extents;
+
+	return Bounds{
+		.origin = glm::vec3(transform * glm::vec4(bounds.origin, 1.f)),
+		.sphereRadius = glm::length(extents),
+		.extents = extents,
+	};
+}
+
+// a box is outside if it is entirely behind one of the planes
+static bool boundsVisible(const Frustum& frustum, const Bounds& bounds)
+{
+	for (const glm::vec4& plane : frustum.planes) {
+		glm::vec3 normal(plane);
+		float distance = glm::dot(normal, bounds.origin) + plane.w;
+		float radius = glm::dot(glm::abs(normal), bounds.extents);
+		if (distance + radius < 0.f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#if CULLING_SSE
+// the test of boundsVisible on four objects, bit i is set if objects[i] is visible
+static uint32_t boundsVisible4(const Frustum& frustum, const RenderObject* objects)
+{
+	const Bounds& b0 = objects[0].bounds;
+	const Bounds& b1 = objects[1].bounds;
+	const Bounds& b2 = objects[2].bounds;
+	const Bounds& b3 = objects[3].bounds;
+
+	__m128 originX = _mm_setr_ps(b0.origin.x, b1.origin.x, b2.origin.x, b3.origin.x);
+	__m128 originY = _mm_setr_ps(b0.origin.y, b1.origin.y, b2.origin.y, b3.origin.y);
+	__m128 originZ = _mm_setr_ps(b0.origin.z, b1.origin.z, b2.origin.z, b3.origin.z);
+	__m128 extentX = _mm_setr_ps(b0.extents.x, b1.extents.x, b2.extents.x, b3.extents.x);
+	__m128 extentY = _mm_setr_ps(b0.extents.y, b1.extents.y, b2.extents.y, b3.extents.y);
+	__m128 extentZ = _mm_setr_ps(b0.extents.z, b1.extents.z, b2.extents.z, b3.extents.z);
+
+	__m128 visible = _mm_cmpeq_ps(originX, originX);
+	for (const glm::vec4& plane : frustum.planes) {
+		__m128 distance = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(originX, _mm_set1_ps(plane.x)), _mm_mul_ps(originY, _mm_set1_ps(plane.y))),
+			_mm_add_ps(_mm_mul_ps(originZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+		__m128 radius = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(extentY, _mm_set1_ps(std::abs(plane.y)))),
+			_mm_mul_ps(extentZ, _mm_set1_ps(std::abs(plane.z))));
+
+		visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+	}
+
+	return static_cast<uint32_t>(_mm_movemask_ps(visible));
+}
+#endif
+
+uint32_t cullRenderObjects(const Frustum& frustum, std::vector<RenderObject>& objects)
+{
+	size_t count = objects.size();
+	size_t kept = 0;
+	size_t i = 0;
+
+	// visible objects move down over the culled ones, never past the ones not tested yet
+#if CULLING_SSE
+	for (; i + 4 <= count; i += 4) {
+		uint32_t visibleMask = boundsVisible4(frustum, &objects[i]);
+		for (size_t lane = 0; lane < 4; lane++) {
+			if (visibleMask & (1u << lane)) {
+				if (kept != i + lane) {
+					objects[kept] = objects[i + lane];
+				}
+				kept++;
+			}
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		if (boundsVisible(frustum, objects[i].bounds)) {
+			if (kept != i) {
+				objects[kept] = objects[i];
+			}
+			kept++;
+		}
+	}
+
+	objects.resize(kept);
+	return static_cast<uint32_t>(count - kept);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+// the planes of a view projection frustum, normals are unit length and point inwards
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+// for projections onto the [0, 1] depth range, reversed or not
+Frustum extractFrustum(const glm::mat4& viewProjection);
+// axis aligned bounds that enclose the transformed box of bounds
+Bounds transformBounds(const Bounds& bounds, const glm::mat4& transform);
+// removes the objects whose bounds are outside the frustum, four at a time on x86. The order of the
+// remaining objects is kept, returns the number of removed objects
+uint32_t cullRenderObjects(const Frustum& frustum, std::vector<RenderObject>& objects);
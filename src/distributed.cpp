@@ -0,0 +1,520 @@
+#include "distributed.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr SocketHandle INVALID_SOCKET_HANDLE = static_cast<SocketHandle>(-1);
+
+enum MessageType : uint32_t {
+	SetupMessage = 1,
+	JobMessage,
+	ResultMessage,
+	ShutdownMessage,
+};
+
+struct MessageHeader {
+	uint32_t type;
+	uint32_t padding;
+	// payload bytes following the header
+	uint64_t size;
+};
+
+struct SetupPayload {
+	uint32_t width;
+	uint32_t height;
+};
+
+struct ResultPayload {
+	uint32_t jobId;
+	uint32_t pixelCount;
+};
+
+#if defined(_WIN32)
+constexpr int SEND_FLAGS = 0;
+constexpr int SHUTDOWN_BOTH = SD_BOTH;
+
+void closeSocket(SocketHandle socket)
+{
+	closesocket(socket);
+}
+
+int pollSocket(pollfd& descriptor, int timeoutMilliseconds)
+{
+	return WSAPoll(&descriptor, 1, timeoutMilliseconds);
+}
+#else
+// a peer that disconnected makes send fail instead of raising SIGPIPE
+#if defined(MSG_NOSIGNAL)
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+constexpr int SHUTDOWN_BOTH = SHUT_RDWR;
+
+void closeSocket(SocketHandle socket)
+{
+	close(socket);
+}
+
+int pollSocket(pollfd& descriptor, int timeoutMilliseconds)
+{
+	return poll(&descriptor, 1, timeoutMilliseconds);
+}
+#endif
+
+void initSockets()
+{
+#if defined(_WIN32)
+	static bool initialized = []() {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	if (!initialized) {
+		throw std::runtime_error("failed to initialize Winsock");
+	}
+#endif
+}
+
+// jobs and results are single messages, so waiting for more data before sending only adds latency
+void disableNagle(SocketHandle socket)
+{
+	int enable = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+}
+
+}
+
+RenderConnection::RenderConnection(SocketHandle socket)
+	: socket(socket)
+{
+}
+
+RenderConnection::~RenderConnection()
+{
+	if (socket != INVALID_SOCKET_HANDLE) {
+		closeSocket(socket);
+	}
+}
+
+RenderConnection::RenderConnection(RenderConnection&& other) noexcept
+	: socket(std::exchange(other.socket, INVALID_SOCKET_HANDLE))
+{
+}
+
+RenderConnection& RenderConnection::operator=(RenderConnection&& other) noexcept
+{
+	if (this != &other) {
+		if (socket != INVALID_SOCKET_HANDLE) {
+			closeSocket(socket);
+		}
+		socket = std::exchange(other.socket, INVALID_SOCKET_HANDLE);
+	}
+	return *this;
+}
+
+RenderConnection RenderConnection::connect(const std::string& address)
+{
+	initSockets();
+
+	size_t separator = address.rfind(':');
+	if (separator == std::string::npos) {
+		throw std::runtime_error("coordinator address " + address + " is not host:port");
+	}
+	std::string host = address.substr(0, separator);
+	std::string port = address.substr(separator + 1);
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+		throw std::runtime_error("failed to resolve " + address);
+	}
+
+	SocketHandle connected = INVALID_SOCKET_HANDLE;
+	for (addrinfo* candidate = addresses; candidate && connected == INVALID_SOCKET_HANDLE; candidate = candidate->ai_next) {
+		SocketHandle attempt = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+		if (attempt == INVALID_SOCKET_HANDLE) {
+			continue;
+		}
+
+		if (::connect(attempt, candidate->ai_addr, static_cast<int>(candidate->ai_addrlen)) == 0) {
+			connected = attempt;
+		}
+		else {
+			closeSocket(attempt);
+		}
+	}
+	freeaddrinfo(addresses);
+
+	if (connected == INVALID_SOCKET_HANDLE) {
+		throw std::runtime_error("failed to connect to " + address);
+	}
+
+	disableNagle(connected);
+	return RenderConnection(connected);
+}
+
+bool RenderConnection::sendSetup(uint32_t width, uint32_t height)
+{
+	SetupPayload payload{ width, height };
+	std::span<const uint8_t> parts[] = { { reinterpret_cast<const uint8_t*>(&payload), sizeof(payload) } };
+	return sendMessage(SetupMessage, parts);
+}
+
+bool RenderConnection::receiveSetup(uint32_t& width, uint32_t& height)
+{
+	uint32_t type;
+	uint64_t size;
+	SetupPayload payload;
+	if (!receiveHeader(type, size) || type != SetupMessage || size != sizeof(payload) || !receiveBytes(&payload, sizeof(payload))) {
+		return false;
+	}
+
+	width = payload.width;
+	height = payload.height;
+	return true;
+}
+
+bool RenderConnection::sendJob(const RenderJob& job)
+{
+	std::span<const uint8_t> parts[] = { { reinterpret_cast<const uint8_t*>(&job), sizeof(job) } };
+	return sendMessage(JobMessage, parts);
+}
+
+bool RenderConnection::receiveJob(RenderJob& job)
+{
+	uint32_t type;
+	uint64_t size;
+	return receiveHeader(type, size) && type == JobMessage && size == sizeof(job) && receiveBytes(&job, sizeof(job));
+}
+
+bool RenderConnection::sendShutdown()
+{
+	return sendMessage(ShutdownMessage, {});
+}
+
+bool RenderConnection::sendResult(uint32_t jobId, std::span<const glm::vec4> accumulation)
+{
+	ResultPayload payload{ jobId, static_cast<uint32_t>(accumulation.size()) };
+	std::span<const uint8_t> parts[] = {
+		{ reinterpret_cast<const uint8_t*>(&payload), sizeof(payload) },
+		{ reinterpret_cast<const uint8_t*>(accumulation.data()), accumulation.size_bytes() },
+	};
+	return sendMessage(ResultMessage, parts);
+}
+
+bool RenderConnection::receiveResult(uint32_t& jobId, uint32_t pixelCount, std::vector<glm::vec4>& accumulation)
+{
+	uint32_t type;
+	uint64_t size;
+	ResultPayload payload;
+	if (!receiveHeader(type, size) || type != ResultMessage || size < sizeof(payload) || !receiveBytes(&payload, sizeof(payload))) {
+		return false;
+	}
+
+	// checked before allocating anything, a malformed message must not pick the buffer size
+	if (payload.pixelCount != pixelCount || size != sizeof(payload) + uint64_t(pixelCount) * sizeof(glm::vec4)) {
+		return false;
+	}
+
+	jobId = payload.jobId;
+	accumulation.resize(pixelCount);
+	return receiveBytes(accumulation.data(), accumulation.size() * sizeof(glm::vec4));
+}
+
+void RenderConnection::shutdown()
+{
+	if (socket != INVALID_SOCKET_HANDLE) {
+		::shutdown(socket, SHUTDOWN_BOTH);
+	}
+}
+
+bool RenderConnection::sendMessage(uint32_t type, std::span<const std::span<const uint8_t>> parts)
+{
+	MessageHeader header{ .type = type, .padding = 0, .size = 0 };
+	for (std::span<const uint8_t> part : parts) {
+		header.size += part.size();
+	}
+
+	if (!sendBytes(&header, sizeof(header))) {
+		return false;
+	}
+
+	for (std::span<const uint8_t> part : parts) {
+		if (!sendBytes(part.data(), part.size())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RenderConnection::receiveHeader(uint32_t& type, uint64_t& size)
+{
+	MessageHeader header;
+	if (!receiveBytes(&header, sizeof(header))) {
+		return false;
+	}
+
+	type = header.type;
+	size = header.size;
+	return true;
+}
+
+bool RenderConnection::sendBytes(const void* data, size_t size)
+{
+	const char* bytes = static_cast<const char*>(data);
+	while (size > 0) {
+		int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+		int sent = send(socket, bytes, chunk, SEND_FLAGS);
+		if (sent <= 0) {
+			return false;
+		}
+
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+bool RenderConnection::receiveBytes(void* data, size_t size)
+{
+	char* bytes = static_cast<char*>(data);
+	while (size > 0) {
+		int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+		int received = recv(socket, bytes, chunk, 0);
+		if (received <= 0) {
+			return false;
+		}
+
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+RenderCoordinator::RenderCoordinator(const CoordinatorSettings& coordinatorSettings)
+	: settings(coordinatorSettings)
+{
+	initSockets();
+
+	uint32_t samplesPerJob = std::max(1u, settings.samplesPerJob);
+	for (uint32_t firstSample = 0; firstSample < settings.samples; firstSample += samplesPerJob) {
+		queuedJobs.push_back(RenderJob{
+			.id = static_cast<uint32_t>(queuedJobs.size()),
+			.firstSample = firstSample,
+			.sampleCount = std::min(samplesPerJob, settings.samples - firstSample),
+		});
+	}
+	finishedJobs.assign(queuedJobs.size(), false);
+	accumulation.assign(static_cast<size_t>(settings.width) * settings.height, glm::vec4(0.f));
+
+	listener = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == INVALID_SOCKET_HANDLE) {
+		throw std::runtime_error("failed to create the coordinator socket");
+	}
+
+	// a restarted coordinator can take the port over right away
+	int enable = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enable), sizeof(enable));
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(settings.port);
+
+	if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+		closeSocket(listener);
+		throw std::runtime_error("failed to listen on port " + std::to_string(settings.port));
+	}
+}
+
+RenderCoordinator::~RenderCoordinator()
+{
+	closeSocket(listener);
+}
+
+std::vector<glm::vec4> RenderCoordinator::render()
+{
+	std::cout << "Waiting for workers on port " << settings.port << " to render " << finishedJobs.size() << " jobs of "
+		<< settings.samplesPerJob << " samples at " << settings.width << "x" << settings.height << std::endl;
+
+	std::thread acceptThread(&RenderCoordinator::acceptWorkers, this);
+
+	{
+		std::unique_lock lock(mutex);
+		jobsChanged.wait(lock, [&]() { return finishedJobCount == finishedJobs.size(); });
+		finished = true;
+	}
+	jobsChanged.notify_all();
+	acceptThread.join();
+
+	// workers still busy with overtaken jobs are cut off, the others have been sent a shutdown
+	for (auto& worker : workers) {
+		worker->connection.shutdown();
+		worker->thread.join();
+	}
+
+	return std::move(accumulation);
+}
+
+void RenderCoordinator::acceptWorkers()
+{
+	uint32_t nextWorkerId = 0;
+
+	while (!finished) {
+		// wakes up regularly to notice the end of the render
+		pollfd descriptor{ .fd = listener, .events = POLLIN, .revents = 0 };
+		if (pollSocket(descriptor, 100) <= 0) {
+			continue;
+		}
+
+		SocketHandle socket = accept(listener, nullptr, nullptr);
+		if (socket == INVALID_SOCKET_HANDLE) {
+			continue;
+		}
+		disableNagle(socket);
+
+		auto worker = std::make_unique<Worker>();
+		worker->id = nextWorkerId++;
+		worker->connection = RenderConnection(socket);
+		worker->thread = std::thread(&RenderCoordinator::serveWorker, this, std::ref(*worker));
+
+		std::cout << "Worker " << worker->id << " connected" << std::endl;
+		workers.push_back(std::move(worker));
+	}
+}
+
+void RenderCoordinator::serveWorker(Worker& worker)
+{
+	if (!worker.connection.sendSetup(settings.width, settings.height)) {
+		return;
+	}
+
+	RenderJob job;
+	uint32_t resultId;
+	std::vector<glm::vec4> result;
+
+	uint32_t pixelCount = static_cast<uint32_t>(accumulation.size());
+
+	while (takeJob(job)) {
+		bool delivered = worker.connection.sendJob(job) && worker.connection.receiveResult(resultId, pixelCount, result);
+		if (!delivered || resultId != job.id) {
+			// a malformed result leaves the stream out of sync, the worker is dropped either way
+			worker.connection.shutdown();
+			if (!finished) {
+				returnJob(worker.id, job);
+			}
+			return;
+		}
+
+		finishJob(worker.id, job, result);
+	}
+
+	worker.connection.sendShutdown();
+}
+
+bool RenderCoordinator::takeJob(RenderJob& job)
+{
+	std::unique_lock lock(mutex);
+
+	while (!finished) {
+		// copies of jobs another worker finished in the meantime are dropped
+		while (!queuedJobs.empty() && finishedJobs[queuedJobs.front().id]) {
+			queuedJobs.pop_front();
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (!queuedJobs.empty()) {
+			job = queuedJobs.front();
+			queuedJobs.pop_front();
+			runningJobs.push_back(RunningJob{ job, now, 1 });
+			return true;
+		}
+
+		// with nothing queued, an idle worker races the worker of the job running the longest once it is
+		// overdue, which covers both slow workers and ones that hang without closing the connection
+		auto oldest = std::min_element(runningJobs.begin(), runningJobs.end(), [](const RunningJob& a, const RunningJob& b) {
+			return a.started < b.started;
+		});
+		if (oldest != runningJobs.end() && now - oldest->started > settings.jobTimeout) {
+			std::cout << "Job " << oldest->job.id << " is overdue, handing it to another worker as well" << std::endl;
+			oldest->started = now;
+			oldest->workerCount++;
+			job = oldest->job;
+			return true;
+		}
+
+		jobsChanged.wait_for(lock, std::chrono::milliseconds(100));
+	}
+
+	return false;
+}
+
+void RenderCoordinator::finishJob(uint32_t workerId, const RenderJob& job, std::span<const glm::vec4> result)
+{
+	{
+		std::lock_guard lock(mutex);
+
+		// the slower copy of an overtaken job
+		if (finishedJobs[job.id]) {
+			return;
+		}
+
+		for (size_t i = 0; i < accumulation.size(); i++) {
+			accumulation[i] += result[i];
+		}
+
+		finishedJobs[job.id] = true;
+		finishedJobCount++;
+		std::erase_if(runningJobs, [&](const RunningJob& running) { return running.job.id == job.id; });
+
+		std::cout << "Merged samples " << job.firstSample << " to " << job.firstSample + job.sampleCount - 1 << " from worker " << workerId
+			<< ", " << finishedJobCount << "/" << finishedJobs.size() << " jobs done" << std::endl;
+	}
+	jobsChanged.notify_all();
+}
+
+void RenderCoordinator::returnJob(uint32_t workerId, const RenderJob& job)
+{
+	{
+		std::lock_guard lock(mutex);
+		if (finishedJobs[job.id]) {
+			return;
+		}
+
+		auto running = std::find_if(runningJobs.begin(), runningJobs.end(), [&](const RunningJob& other) { return other.job.id == job.id; });
+		if (running != runningJobs.end() && running->workerCount > 1) {
+			// another worker still has it, queuing it again would only start a duplicate
+			running->workerCount--;
+			std::cout << "Worker " << workerId << " disconnected, job " << job.id << " is still running on another worker" << std::endl;
+			return;
+		}
+
+		if (running != runningJobs.end()) {
+			runningJobs.erase(running);
+		}
+		queuedJobs.push_front(job);
+		std::cout << "Worker " << workerId << " disconnected, job " << job.id << " is queued again" << std::endl;
+	}
+	jobsChanged.notify_all();
+}
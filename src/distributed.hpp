@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(_WIN32)
+using SocketHandle = uintptr_t;
+#else
+using SocketHandle = int;
+#endif
+
+// a range of the per pixel sample sequence over the whole frame. Workers render disjoint ranges, so the
+// merged accumulation is the same as one render with all samples.
+struct RenderJob {
+	uint32_t id;
+	uint32_t firstSample;
+	uint32_t sampleCount;
+};
+
+// TCP connection between the coordinator and a worker carrying length prefixed messages. Every call
+// returns false once the peer is gone. The byte order is the host's, all supported hosts are little endian.
+struct RenderConnection {
+	RenderConnection() = default;
+	explicit RenderConnection(SocketHandle socket);
+	~RenderConnection();
+
+	RenderConnection(RenderConnection&& other) noexcept;
+	RenderConnection& operator=(RenderConnection&& other) noexcept;
+
+	// address is host:port, throws if no connection can be made
+	static RenderConnection connect(const std::string& address);
+
+	bool sendSetup(uint32_t width, uint32_t height);
+	bool receiveSetup(uint32_t& width, uint32_t& height);
+	bool sendJob(const RenderJob& job);
+	// false on a shutdown message as well
+	bool receiveJob(RenderJob& job);
+	bool sendShutdown();
+	// rgb radiance sum and sample count of every pixel
+	bool sendResult(uint32_t jobId, std::span<const glm::vec4> accumulation);
+	// fails without reading the pixels when the peer sends any other count than pixelCount
+	bool receiveResult(uint32_t& jobId, uint32_t pixelCount, std::vector<glm::vec4>& accumulation);
+
+	// wakes a thread blocked on the connection, its call fails
+	void shutdown();
+
+private:
+	SocketHandle socket = static_cast<SocketHandle>(-1);
+
+	bool sendMessage(uint32_t type, std::span<const std::span<const uint8_t>> parts);
+	bool receiveHeader(uint32_t& type, uint64_t& size);
+	bool sendBytes(const void* data, size_t size);
+	bool receiveBytes(void* data, size_t size);
+};
+
+struct CoordinatorSettings {
+	uint16_t port;
+	uint32_t width;
+	uint32_t height;
+	uint32_t samples;
+	uint32_t samplesPerJob;
+	// a job running longer is handed to an idle worker as well, the first result wins
+	std::chrono::duration<float> jobTimeout;
+};
+
+// splits one frame into sample ranges, hands them to the workers connecting to its port and merges their
+// accumulation buffers. A worker that disconnects gives its job back, a slow one gets overtaken.
+struct RenderCoordinator {
+	explicit RenderCoordinator(const CoordinatorSettings& settings);
+	~RenderCoordinator();
+
+	RenderCoordinator(const RenderCoordinator&) = delete;
+	RenderCoordinator& operator=(const RenderCoordinator&) = delete;
+
+	// blocks until every job is merged, returns the rgb radiance sum and sample count of every pixel
+	std::vector<glm::vec4> render();
+
+private:
+	struct RunningJob {
+		RenderJob job;
+		std::chrono::steady_clock::time_point started;
+		// more than one once the job got overtaken
+		uint32_t workerCount;
+	};
+
+	struct Worker {
+		uint32_t id;
+		RenderConnection connection;
+		std::thread thread;
+	};
+
+	CoordinatorSettings settings;
+	SocketHandle listener = static_cast<SocketHandle>(-1);
+
+	std::mutex mutex;
+	std::condition_variable jobsChanged;
+	std::deque<RenderJob> queuedJobs;
+	std::vector<RunningJob> runningJobs;
+	std::vector<bool> finishedJobs;
+	uint32_t finishedJobCount = 0;
+	std::atomic<bool> finished = false;
+	std::vector<glm::vec4> accumulation;
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	void acceptWorkers();
+	void serveWorker(Worker& worker);
+	// the next queued job, or a copy of an overdue one, false once all jobs are done
+	bool takeJob(RenderJob& job);
+	void finishJob(uint32_t workerId, const RenderJob& job, std::span<const glm::vec4> result);
+	// queues the job again unless another worker is still running it
+	void returnJob(uint32_t workerId, const RenderJob& job);
+};
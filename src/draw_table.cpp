@@ -0,0 +1,189 @@
+#include "draw_table.hpp"
+
+#include "engine.hpp"
+#include "vk_initializers.hpp"
+#include "vk_pipelines.hpp"
+
+// threads of draw_cull.comp
+constexpr uint32_t DRAW_CULL_GROUP_SIZE = 64;
+
+static GPUDrawInstance pack(const RenderObject& object)
+{
+	return GPUDrawInstance{
+		.worldMatrix = object.transform,
+		.vertexBuffer = object.vertexBufferAddress,
+		.colorBuffer = object.colorBufferAddress,
+		.positionOrigin = object.quantization.origin,
+		.vertexFlags = object.vertexFlags,
+		.positionExtent = object.quantization.extent,
+		.materialIndex = object.materialIndex,
+		.boundsOrigin = object.bounds.origin,
+		.indexCount = object.indexCount,
+		.boundsExtents = object.bounds.extents,
+		.firstIndex = object.firstIndex,
+	};
+}
+
+static void memoryBarrier(VkCommandBuffer cmdBuffer, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+	VkMemoryBarrier2 memoryBarrier{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+		.srcStageMask = srcStage,
+		.srcAccessMask = srcAccess,
+		.dstStageMask = dstStage,
+		.dstAccessMask = dstAccess,
+	};
+
+	VkDependencyInfo depInfo{
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.memoryBarrierCount = 1,
+		.pMemoryBarriers = &memoryBarrier,
+	};
+
+	vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+}
+
+static VkDeviceAddress bufferAddress(VkDevice device, const AllocatedBuffer& buffer)
+{
+	VkBufferDeviceAddressInfo deviceAddressInfo{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+		.buffer = buffer.buffer,
+	};
+	return vkGetBufferDeviceAddress(device, &deviceAddressInfo);
+}
+
+void DrawTable::buildPipeline(Engine* engine)
+{
+	VkPushConstantRange pushConstant{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.size = sizeof(DrawCullPushConstants),
+	};
+
+	VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipelineLayoutCreateInfo();
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+
+	VK_CHECK(vkCreatePipelineLayout(engine->device, &layoutInfo, nullptr, &cullLayout));
+
+	VkShaderModule cullShader;
+	if (!vkutil::loadShaderModule("shaders/draw_cull_comp.spv", engine->device, cullShader)) {
+		std::cout << "Error building the draw cull shader" << std::endl;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, cullShader),
+		.layout = cullLayout,
+	};
+
+	VK_CHECK(vkCreateComputePipelines(engine->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &cullPipeline));
+
+	vkDestroyShaderModule(engine->device, cullShader, nullptr);
+}
+
+void DrawTable::destroyPipeline(VkDevice device)
+{
+	vkDestroyPipeline(device, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(device, cullLayout, nullptr);
+}
+
+void DrawTable::build(const std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>>& scenes)
+{
+	// the same surfaces the CPU path draws, before culling
+	DrawContext context;
+	for (auto& [_, scene] : scenes) {
+		scene->draw(glm::mat4{ 1.f }, context);
+	}
+
+	instances.clear();
+	for (const RenderObject& object : context.opaqueSurfaces) {
+		instances.push_back(pack(object));
+	}
+	opaqueCount = static_cast<uint32_t>(instances.size());
+	for (const RenderObject& object : context.transparentSurfaces) {
+		instances.push_back(pack(object));
+	}
+}
+
+void DrawTable::upload(Engine* engine)
+{
+	instanceBuffer = engine->uploadBuffer(instances.data(), instances.size() * sizeof(GPUDrawInstance),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+	instanceBufferAddress = bufferAddress(engine->device, instanceBuffer);
+
+	size_t commandCount = std::max<size_t>(instances.size(), 1);
+	commandBuffer = engine->createBuffer(commandCount * sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	commandBufferAddress = bufferAddress(engine->device, commandBuffer);
+
+	countBuffer = engine->createBuffer(2 * sizeof(uint32_t),
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+	countBufferAddress = bufferAddress(engine->device, countBuffer);
+
+	uploaded = true;
+}
+
+void DrawTable::clear(Engine* engine)
+{
+	if (!uploaded) {
+		return;
+	}
+
+	engine->destroyBuffer(instanceBuffer);
+	engine->destroyBuffer(commandBuffer);
+	engine->destroyBuffer(countBuffer);
+
+	uploaded = false;
+}
+
+void DrawTable::cull(VkCommandBuffer cmdBuffer, const Frustum& frustum)
+{
+	// the draws of the previous frame may still read the commands and counts
+	memoryBarrier(cmdBuffer, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, 0,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+	vkCmdFillBuffer(cmdBuffer, countBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+	memoryBarrier(cmdBuffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+	DrawCullPushConstants pushConstants{
+		.frustum = frustum,
+		.instanceBuffer = instanceBufferAddress,
+		.commandBuffer = commandBufferAddress,
+		.countBuffer = countBufferAddress,
+		.opaqueCount = opaqueCount,
+		.instanceCount = static_cast<uint32_t>(instances.size()),
+	};
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdPushConstants(cmdBuffer, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DrawCullPushConstants), &pushConstants);
+	vkCmdDispatch(cmdBuffer, (pushConstants.instanceCount + DRAW_CULL_GROUP_SIZE - 1) / DRAW_CULL_GROUP_SIZE, 1, 1);
+
+	memoryBarrier(cmdBuffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+}
+
+uint32_t DrawTable::draw(VkCommandBuffer cmdBuffer, const MaterialPipeline& opaquePipeline, const MaterialPipeline& transparentPipeline)
+{
+	uint32_t transparentCount = static_cast<uint32_t>(instances.size()) - opaqueCount;
+	uint32_t drawCount = 0;
+
+	// the indirect pipelines only read the instance buffer address from the push constants
+	auto drawInstances = [&](const MaterialPipeline& pipeline, uint32_t firstInstance, uint32_t maxDrawCount, VkDeviceSize countOffset) {
+		if (maxDrawCount == 0) {
+			return;
+		}
+
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+		vkCmdPushConstants(cmdBuffer, pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkDeviceAddress), &instanceBufferAddress);
+		vkCmdDrawIndexedIndirectCount(cmdBuffer, commandBuffer.buffer, firstInstance * sizeof(VkDrawIndexedIndirectCommand),
+			countBuffer.buffer, countOffset, maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+		drawCount++;
+	};
+
+	drawInstances(opaquePipeline, 0, opaqueCount, 0);
+	drawInstances(transparentPipeline, opaqueCount, transparentCount, sizeof(uint32_t));
+
+	return drawCount;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "vk_types.hpp"
+#include "vk_loader.hpp"
+#include "culling.hpp"
+
+struct Engine;
+
+// one surface of the loaded scenes in the draw table, same layout as DrawInstance in draw_instance.glsl (std430)
+struct GPUDrawInstance {
+	glm::mat4 worldMatrix;
+	VkDeviceAddress vertexBuffer;
+	VkDeviceAddress colorBuffer;
+	glm::vec3 positionOrigin;
+	uint32_t vertexFlags;
+	glm::vec3 positionExtent;
+	uint32_t materialIndex;
+	// world space bounds
+	glm::vec3 boundsOrigin;
+	uint32_t indexCount;
+	glm::vec3 boundsExtents;
+	// in the geometry pool index buffer
+	uint32_t firstIndex;
+};
+
+static_assert(sizeof(GPUDrawInstance) == 144);
+
+// push constants of draw_cull.comp
+struct DrawCullPushConstants {
+	Frustum frustum;
+	VkDeviceAddress instanceBuffer;
+	VkDeviceAddress commandBuffer;
+	VkDeviceAddress countBuffer;
+	uint32_t opaqueCount;
+	uint32_t instanceCount;
+};
+
+static_assert(sizeof(DrawCullPushConstants) == 128);
+
+// every surface of the loaded scenes for the GPU driven rasterizer. The instances are uploaded once per
+// scene change, every frame a compute pass culls them into indirect draw commands and their counts, and
+// the geometry pass draws those with vkCmdDrawIndexedIndirectCount. The draws find their instance through
+// firstInstance.
+struct DrawTable {
+	// the opaque instances come first, the transparent ones follow them
+	std::vector<GPUDrawInstance> instances;
+	uint32_t opaqueCount = 0;
+
+	AllocatedBuffer instanceBuffer;
+	VkDeviceAddress instanceBufferAddress = 0;
+	// a VkDrawIndexedIndirectCommand per instance, the visible opaque draws are packed from the start, the
+	// transparent ones from opaqueCount
+	AllocatedBuffer commandBuffer;
+	VkDeviceAddress commandBufferAddress = 0;
+	// the opaque and the transparent draw count
+	AllocatedBuffer countBuffer;
+	VkDeviceAddress countBufferAddress = 0;
+
+	VkPipeline cullPipeline;
+	VkPipelineLayout cullLayout;
+
+	void buildPipeline(Engine* engine);
+	void destroyPipeline(VkDevice device);
+
+	// the surfaces reachable from the scene nodes, with the table indices of their materials
+	void build(const std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>>& scenes);
+	void upload(Engine* engine);
+	void clear(Engine* engine);
+
+	// resets the counts and writes the draws of the instances inside the frustum, outside of rendering
+	void cull(VkCommandBuffer cmdBuffer, const Frustum& frustum);
+	// one indirect draw each for the opaque and the transparent instances, returns the number of draw calls
+	uint32_t draw(VkCommandBuffer cmdBuffer, const MaterialPipeline& opaquePipeline, const MaterialPipeline& transparentPipeline);
+
+private:
+	bool uploaded = false;
+};
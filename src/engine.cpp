@@ -1,10 +1,14 @@
 #include "engine.hpp"
+#include <bit>
 #include <cassert>
 #include <VkBootstrap.h>
 
 #include "vk_initializers.hpp"
 #include "vk_images.hpp"
 #include "vk_pipelines.hpp"
+#include "blue_noise.hpp"
+#include "pfm.hpp"
+#include "culling.hpp"
 
 #include <imgui.h>
 #include <imgui_impl_vulkan.h>
@@ -15,6 +19,7 @@
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 constexpr bool enableValidationLayers = true;
 const uint32_t WINDOW_WIDTH = 600;
@@ -27,12 +32,18 @@ Engine& Engine::Get()
 	return *loadedEngine;
 }
 
-void Engine::init()
+void Engine::init(const EngineOptions& engineOptions)
 {
 	assert(loadedEngine == nullptr);
 	loadedEngine = this;
-    
-    initWindow();
+    options = engineOptions;
+
+    if (options.headless) {
+        windowExtent = options.extent;
+    }
+    else {
+        initWindow();
+    }
 
     initVulkan();
 
@@ -40,6 +51,8 @@ void Engine::init()
 
     initSwapchain();
 
+    initPathTracingQueues();
+
     initCommands();
 
     initSyncStructures();
@@ -48,24 +61,47 @@ void Engine::init()
 
     initPipelines();
 
-    initImgui();
+    if (!options.headless) {
+        initImgui();
+    }
 
     initDefaultData();
 
+    initGeometryPool();
+
     camera.velocity = glm::vec3(0);
     camera.position = glm::vec3(0, 0, 5);
     camera.pitch = 0;
     camera.yaw = 0;
 
-    std::string filePath = { "..\\..\\assets\\monkey.glb" };
-    auto file = loadGLTF(this, filePath);
+    // a window keeps rendering while the scene loads, headless renders need all of it up front
+    if (options.headless) {
+        auto file = loadGLTF(this, options.scenePath);
+        // release builds drop asserts, a render of nothing would still write its output
+        if (!file.has_value()) {
+            throw std::runtime_error("failed to load scene " + options.scenePath);
+        }
+        loadedScenes["structure"] = *file;
+    }
+    else {
+        loadScene("structure", options.scenePath);
+    }
 
-    assert(file.has_value());
-    loadedScenes["structure"] = *file;
+    buildMaterialTable();
+    buildDrawTable();
+    buildTracerScene();
 
     initialized = true;
 }
 
+// fills an image in the general layout with black
+static void clearImage(VkCommandBuffer cmdBuffer, VkImage image)
+{
+    VkClearColorValue clearValue{ { 0.f, 0.f, 0.f, 0.f } };
+    VkImageSubresourceRange clearRange = vkinit::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+    vkCmdClearColorImage(cmdBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
+}
+
 static void requestSwapchainResize(GLFWwindow* window, int width, int height) {
     Engine* engine = reinterpret_cast<Engine*>(glfwGetWindowUserPointer(window));
     engine->resizeRequested = true;
@@ -93,6 +129,7 @@ void Engine::initVulkan()
         .request_validation_layers(enableValidationLayers)
         .use_default_debug_messenger()
         .require_api_version(1, 3, 0)
+        .set_headless(options.headless)
         .build();
 
     if (!instanceResult) {
@@ -103,7 +140,9 @@ void Engine::initVulkan()
     instance = vkbInstance.instance;
     debugMessenger = vkbInstance.debug_messenger;
 
-    VK_CHECK(glfwCreateWindowSurface(instance, window, nullptr, &surface));
+    if (!options.headless) {
+        VK_CHECK(glfwCreateWindowSurface(instance, window, nullptr, &surface));
+    }
 
     VkPhysicalDeviceVulkan13Features features13{ 
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
@@ -114,36 +153,73 @@ void Engine::initVulkan()
     VkPhysicalDeviceVulkan12Features features12{
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
         .descriptorIndexing = VK_TRUE,
+        .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+        .descriptorBindingPartiallyBound = VK_TRUE,
+        .runtimeDescriptorArray = VK_TRUE,
+        .timelineSemaphore = VK_TRUE,
         .bufferDeviceAddress = VK_TRUE,
     };
 
 
     vkb::PhysicalDeviceSelector selector{ vkbInstance };
-    auto vkbPhysicalDeviceResult = selector
+    selector
         .set_minimum_version(1, 3)
         .set_required_features_13(features13)
-        .set_required_features_12(features12)
-        .set_surface(surface)
-        .select();
+        .set_required_features_12(features12);
+
+    // headless renders also run on devices that cannot present, like software implementations
+    if (options.headless) {
+        selector.require_present(false);
+    }
+    else {
+        selector.set_surface(surface);
+    }
+
+    auto vkbPhysicalDeviceResult = selector.select();
 
     if (!vkbPhysicalDeviceResult) {
         throw std::runtime_error("failed to find suitable GPU!");
     }
 
     vkb::PhysicalDevice vkbPhysicalDevice = vkbPhysicalDeviceResult.value();
+
+    // block compressed textures are optional, loaded textures stay rgba8 without them
+    textureCompressionBC = vkbPhysicalDevice.enable_features_if_present(VkPhysicalDeviceFeatures{ .textureCompressionBC = VK_TRUE });
+    // so is the GPU driven rasterizer, the CPU side draws need neither feature
+    bool firstInstanceSupported = vkbPhysicalDevice.enable_features_if_present(VkPhysicalDeviceFeatures{ .drawIndirectFirstInstance = VK_TRUE });
+    bool indirectCountSupported = vkbPhysicalDevice.enable_extension_features_if_present(VkPhysicalDeviceVulkan12Features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .drawIndirectCount = VK_TRUE,
+    });
+    gpuDrivenSupported = firstInstanceSupported && indirectCountSupported;
+
     vkb::DeviceBuilder deviceBuilder{ vkbPhysicalDevice };
     vkb::Device vkbDevice = deviceBuilder.build().value();
 
     device = vkbDevice.device;
     physicalDevice = vkbPhysicalDevice.physical_device;
+    timestampPeriod = vkbPhysicalDevice.properties.limits.timestampPeriod;
 
     graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
     graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
+
+    // uploads run on a transfer only family when there is one, they share the graphics queue otherwise
+    auto dedicatedTransferQueue = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+    if (dedicatedTransferQueue) {
+        transferQueue = dedicatedTransferQueue.value();
+        transferQueueFamily = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+    }
+    else {
+        transferQueue = graphicsQueue;
+        transferQueueFamily = graphicsQueueFamily;
+    }
 }
 
 void Engine::initSwapchain()
 {
-    createSwapchain(windowExtent.width, windowExtent.height);
+    if (!options.headless) {
+        createSwapchain(windowExtent.width, windowExtent.height);
+    }
 
     VkExtent3D drawImageExtent = {
         windowExtent.width,
@@ -170,6 +246,28 @@ void Engine::initSwapchain()
 
     VK_CHECK(vkCreateImageView(device, &rviewInfo, nullptr, &drawImage.imageView));
 
+    // fp32 running sum of the path tracer samples, rgb is the radiance sum and a the sample count
+    accumulationImage.imageFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+    accumulationImage.imageExtent = drawImageExtent;
+
+    VkImageCreateInfo aimgInfo = vkinit::imageCreateInfo(accumulationImage.imageFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, drawImageExtent);
+    vmaCreateImage(allocator, &aimgInfo, &rimgAllocinfo, &accumulationImage.image, &accumulationImage.allocation, nullptr);
+
+    VkImageViewCreateInfo aviewInfo = vkinit::imageViewCreateInfo(accumulationImage.imageFormat, accumulationImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    VK_CHECK(vkCreateImageView(device, &aviewInfo, nullptr, &accumulationImage.imageView));
+
+    // sum of the squared sample luminance, together with the accumulation it gives the variance of every pixel
+    luminanceMomentImage.imageFormat = VK_FORMAT_R32_SFLOAT;
+    luminanceMomentImage.imageExtent = drawImageExtent;
+
+    VkImageCreateInfo mimgInfo = vkinit::imageCreateInfo(luminanceMomentImage.imageFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, drawImageExtent);
+    vmaCreateImage(allocator, &mimgInfo, &rimgAllocinfo, &luminanceMomentImage.image, &luminanceMomentImage.allocation, nullptr);
+
+    VkImageViewCreateInfo mviewInfo = vkinit::imageViewCreateInfo(luminanceMomentImage.imageFormat, luminanceMomentImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    VK_CHECK(vkCreateImageView(device, &mviewInfo, nullptr, &luminanceMomentImage.imageView));
+
     depthImage.imageFormat = VK_FORMAT_D32_SFLOAT;
     depthImage.imageExtent = drawImageExtent;
     VkImageUsageFlags depthImageUsages = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
@@ -185,11 +283,57 @@ void Engine::initSwapchain()
         vkDestroyImageView(device, drawImage.imageView, nullptr);
         vmaDestroyImage(allocator, drawImage.image, drawImage.allocation);
 
+        vkDestroyImageView(device, accumulationImage.imageView, nullptr);
+        vmaDestroyImage(allocator, accumulationImage.image, accumulationImage.allocation);
+
+        vkDestroyImageView(device, luminanceMomentImage.imageView, nullptr);
+        vmaDestroyImage(allocator, luminanceMomentImage.image, luminanceMomentImage.allocation);
+
         vkDestroyImageView(device, depthImage.imageView, nullptr);
         vmaDestroyImage(allocator, depthImage.image, depthImage.allocation);
     });
 }
 
+void Engine::initPathTracingQueues()
+{
+    // the draw image size is fixed, so one queue entry per draw image pixel is always enough
+    tracer.queues.create(this, drawImage.imageExtent.width * drawImage.imageExtent.height);
+
+    // room for every tile of the draw image, the shaders read the list through its device address
+    uint32_t maxTileCount = ((drawImage.imageExtent.width + TRACER_TILE_SIZE - 1) / TRACER_TILE_SIZE)
+        * ((drawImage.imageExtent.height + TRACER_TILE_SIZE - 1) / TRACER_TILE_SIZE);
+
+    for (int i = 0; i < FRAME_OVERLAP; i++) {
+        frames[i].tileBuffer = createBuffer(maxTileCount * sizeof(glm::uvec2),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+        VkBufferDeviceAddressInfo deviceAddressInfo{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .buffer = frames[i].tileBuffer.buffer,
+        };
+        frames[i].tileBufferAddress = vkGetBufferDeviceAddress(device, &deviceAddressInfo);
+
+        frames[i].tileErrorBuffer = createBuffer(maxTileCount * sizeof(float),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+        deviceAddressInfo.buffer = frames[i].tileErrorBuffer.buffer;
+        frames[i].tileErrorBufferAddress = vkGetBufferDeviceAddress(device, &deviceAddressInfo);
+
+        frames[i].cpuTracerBuffer = createBuffer(drawImage.imageExtent.width * drawImage.imageExtent.height * sizeof(uint64_t),
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    }
+
+    deletionQueue.push([=]() {
+        tracer.queues.destroy(this);
+
+        for (int i = 0; i < FRAME_OVERLAP; i++) {
+            destroyBuffer(frames[i].tileBuffer);
+            destroyBuffer(frames[i].tileErrorBuffer);
+            destroyBuffer(frames[i].cpuTracerBuffer);
+        }
+    });
+}
+
 void Engine::createSwapchain(int width, int height)
 {
     vkb::SwapchainBuilder swapchainBuilder{ physicalDevice, device, surface };
@@ -215,7 +359,7 @@ void Engine::createSwapchain(int width, int height)
 
 void Engine::resizeSwapchain()
 {
-    vkDeviceWaitIdle(device);
+    waitDeviceIdle();
 
     destroySwapchain();
 
@@ -227,7 +371,7 @@ void Engine::resizeSwapchain()
     createSwapchain(windowExtent.width, windowExtent.height);
 
     resizeRequested = false;
-    tracer.render = true;
+    tracer.reset();
 }
 
 void Engine::initCommands()
@@ -250,6 +394,12 @@ void Engine::initCommands()
     deletionQueue.push([=]() {
         vkDestroyCommandPool(device, immediateCommandPool, nullptr);
     });
+
+    uploads.init(this, transferQueue, transferQueueFamily, UPLOAD_RING_BYTES);
+
+    deletionQueue.push([&]() {
+        uploads.destroy();
+    });
 }
 
 void Engine::destroySwapchain()
@@ -263,14 +413,23 @@ void Engine::destroySwapchain()
 
 void Engine::cleanup()
 {
-    vkDeviceWaitIdle(device);
+    for (auto& sceneLoad : sceneLoads) {
+        sceneLoad->thread.join();
+    }
+
+    waitDeviceIdle();
 
     loadedScenes.clear();
+    sceneLoads.clear();
+    tracer.scene.clear(this);
+    drawTable.clear(this);
+    materialTable.clear(this);
     
     for (int i = 0; i < FRAME_OVERLAP; i++) {
         vkDestroyCommandPool(device, frames[i].commandPool, nullptr);
 
         vkDestroyFence(device, frames[i].renderFence, nullptr);
+        vkDestroyQueryPool(device, frames[i].timestampPool, nullptr);
         vkDestroySemaphore(device, frames[i].renderSemaphor, nullptr);
         vkDestroySemaphore(device, frames[i].swapchainSemaphore, nullptr);
 
@@ -278,30 +437,49 @@ void Engine::cleanup()
     }
 
     metalRoughMaterial.clearResources(device);
+    drawTable.destroyPipeline(device);
 
     deletionQueue.flush();
 
-    destroySwapchain();
+    if (!options.headless) {
+        destroySwapchain();
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
     vkDestroyDevice(device, nullptr);
     vkb::destroy_debug_utils_messenger(instance, debugMessenger);
     vkDestroyInstance(instance, nullptr);
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!options.headless) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 
     loadedEngine = nullptr;
 }
 
 void Engine::draw()
 {
-    if (renderMode == Rasterize) {
+    updateSceneLoads();
+
+    // the GPU driven rasterizer needs only the camera
+    if (renderMode == Rasterize && !gpuDriven) {
         updateScene();
     }
+    else {
+        updateCamera();
+
+        if (sceneData.viewprojection != tracer.lastViewProjection) {
+            tracer.lastViewProjection = sceneData.viewprojection;
+            tracer.reset();
+            cpuTracer.reset();
+        }
+    }
 
     VK_CHECK(vkWaitForFences(device, 1, &currentFrame().renderFence, true, 1'000'000'000));
 
+    readTracerResults(currentFrame());
+
     currentFrame().deletionQueue.flush();
     currentFrame().frameDescriptors.clearPools(device);
 
@@ -329,9 +507,13 @@ void Engine::draw()
     if (renderMode == Rasterize) {
         rasterizerDraw(cmdBuffer);
     }
+    else if (renderMode == CpuTrace) {
+        if (tracer.render) {
+            cpuTracerDraw(cmdBuffer);
+        }
+    }
     else if (tracer.render) {
         pathtracerDraw(cmdBuffer);
-        tracer.render = false;
     }
 
     vkutil::transitionImage(cmdBuffer, drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
@@ -348,10 +530,19 @@ void Engine::draw()
 
     VK_CHECK(vkEndCommandBuffer(cmdBuffer));
 
+    // the frame may read anything uploaded so far
+    uploads.flush();
+
     VkCommandBufferSubmitInfo cmdBufferInfo = vkinit::commandBufferSubmitInfo(cmdBuffer);
-    VkSemaphoreSubmitInfo waitInfo = vkinit::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, currentFrame().swapchainSemaphore);
+    VkSemaphoreSubmitInfo waitInfos[] = {
+        vkinit::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, currentFrame().swapchainSemaphore),
+        uploads.waitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT),
+    };
     VkSemaphoreSubmitInfo signalInfo = vkinit::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, currentFrame().renderSemaphor);
-    VkSubmitInfo2 submitInfo = vkinit::submitInfo(&cmdBufferInfo, &signalInfo, &waitInfo);
+    VkSubmitInfo2 submitInfo = vkinit::submitInfo(&cmdBufferInfo, &signalInfo, waitInfos);
+    submitInfo.waitSemaphoreInfoCount = 2;
+
+    std::lock_guard queueLock(queueMutex);
 
     VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &submitInfo, currentFrame().renderFence));
 
@@ -391,12 +582,52 @@ void Engine::run()
         ImGui::NewFrame();
 
         if (ImGui::Begin("Stats")) {
+            int mode = renderMode;
+            if (ImGui::Combo("renderer", &mode, "path tracer\0rasterizer\0cpu path tracer\0")) {
+                renderMode = static_cast<RenderMode>(mode);
+                tracer.reset();
+                cpuTracer.reset();
+            }
+
+            for (auto& sceneLoad : sceneLoads) {
+                ImGui::Text("loading %s%s", sceneLoad->name.c_str(), sceneLoad->published ? " textures" : "");
+            }
+
             ImGui::Text("frame time %f ms", stats.frametime);
             ImGui::Text("draw time %f ms", stats.meshDrawTime);
             if (renderMode == Rasterize) {
-                ImGui::Text("update time %f ms", stats.sceneUpdateTime);
-                ImGui::Text("triangles %i", stats.triangleCount);
+                ImGui::BeginDisabled(!gpuDrivenSupported);
+                ImGui::Checkbox("gpu driven", &gpuDriven);
+                ImGui::EndDisabled();
+                if (gpuDriven) {
+                    ImGui::Text("instances %zu", drawTable.instances.size());
+                }
+                else {
+                    ImGui::Text("update time %f ms", stats.sceneUpdateTime);
+                    ImGui::Text("triangles %i", stats.triangleCount);
+                    ImGui::Text("culled %i", stats.culledCount);
+                }
                 ImGui::Text("draw calls %i", stats.drawCallCount);
+                ImGui::Text("binds %i pipeline, %i descriptor set, %i index buffer", stats.pipelineBindCount, stats.descriptorSetBindCount, stats.indexBufferBindCount);
+                ImGui::Text("geometry pool %.1f / %.1f MB", geometryPool.bytesUsed() / 1'000'000.f, geometryPool.capacity() / 1'000'000.f);
+            }
+            else if (renderMode == CpuTrace) {
+                ImGui::Text("samples %u", cpuTracer.sampleIndex);
+                ImGui::Text("rays %.2f M/s", stats.cpuTracerRaysPerSecond / 1'000'000.f);
+                ImGui::Text("bvh kernels %s", bvh8KernelName());
+                ImGui::Checkbox("accumulate", &tracer.render);
+            }
+            else {
+                ImGui::Text("samples %u", tracer.sampleIndex);
+                ImGui::Text("gpu time %f ms", stats.tracerGpuTime);
+                ImGui::Text("tiles %u / %u", tracer.tiles.tileBudget, tracer.tiles.tileCount());
+                ImGui::SliderFloat("budget ms", &tracer.tiles.targetMilliseconds, 1.f, 100.f);
+                ImGui::Checkbox("adaptive", &tracer.tiles.adaptive);
+                if (tracer.tiles.adaptive) {
+                    ImGui::Text("converged tiles %u", tracer.tiles.convergedCount());
+                    ImGui::SliderFloat("error threshold", &tracer.tiles.errorThreshold, 0.001f, 0.2f, "%.3f", ImGuiSliderFlags_Logarithmic);
+                }
+                ImGui::Checkbox("accumulate", &tracer.render);
             }
         }
         ImGui::End();
@@ -427,6 +658,213 @@ void Engine::run()
     }
 }
 
+void Engine::renderHeadless()
+{
+    auto start = std::chrono::system_clock::now();
+    int firstFrame = frameNumber;
+
+    float gpuTime = renderSamples(0, options.samples);
+
+    auto end = std::chrono::system_clock::now();
+    float seconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1'000'000.f;
+    float samplesPerSecond = static_cast<float>(drawExtent.width) * drawExtent.height * tracer.tiles.completedPasses / seconds;
+
+    std::cout << "Rendered " << tracer.tiles.completedPasses << " samples per pixel at " << drawExtent.width << "x" << drawExtent.height
+        << " in " << frameNumber - firstFrame << " frames, " << seconds << " s total, " << gpuTime << " ms gpu time, "
+        << samplesPerSecond / 1'000'000.f << " M samples/s" << std::endl;
+
+    saveDrawImage(options.outputPath);
+}
+
+void Engine::renderJobs(RenderConnection& coordinator)
+{
+    RenderJob job;
+    while (coordinator.receiveJob(job)) {
+        auto start = std::chrono::system_clock::now();
+
+        renderSamples(job.firstSample, job.sampleCount);
+        std::vector<glm::vec4> accumulation = readAccumulation();
+
+        auto end = std::chrono::system_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        std::cout << "Rendered samples " << job.firstSample << " to " << job.firstSample + job.sampleCount - 1
+            << " in " << elapsed.count() / 1000.f << " ms" << std::endl;
+
+        if (!coordinator.sendResult(job.id, accumulation)) {
+            break;
+        }
+    }
+
+    std::cout << "Coordinator finished the render" << std::endl;
+}
+
+float Engine::renderSamples(uint32_t firstSample, uint32_t sampleCount)
+{
+    // an offline render gets exactly the requested sample count, adaptive sampling would stop tiles early
+    tracer.tiles.adaptive = false;
+    tracer.tiles.maxPasses = sampleCount;
+    tracer.sampleOffset = firstSample;
+    tracer.reset();
+
+    updateCamera();
+    tracer.lastViewProjection = sceneData.viewprojection;
+    drawExtent = { drawImage.imageExtent.width, drawImage.imageExtent.height };
+
+    // no tile would ever be traced, so the loop below would not finish
+    if (tracer.scene.empty()) {
+        std::cout << "Nothing to render, the scene has no triangles" << std::endl;
+        immediateSubmit([&](VkCommandBuffer cmd) {
+            vkutil::transitionImage(cmd, drawImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+            clearImage(cmd, drawImage.image);
+            vkutil::transitionImage(cmd, drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        });
+        return 0.f;
+    }
+
+    float gpuTime = 0.f;
+
+    // the same frame loop as draw() minus the swapchain, so FRAME_OVERLAP frames stay in flight
+    while (!tracer.tiles.finished()) {
+        VK_CHECK(vkWaitForFences(device, 1, &currentFrame().renderFence, true, UINT64_MAX));
+        gpuTime += readTracerResults(currentFrame());
+
+        currentFrame().deletionQueue.flush();
+        currentFrame().frameDescriptors.clearPools(device);
+
+        VK_CHECK(vkResetFences(device, 1, &currentFrame().renderFence));
+
+        VkCommandBuffer cmdBuffer = currentFrame().commandBuffer;
+        VK_CHECK(vkResetCommandBuffer(cmdBuffer, 0));
+        VkCommandBufferBeginInfo cmdBufferBeginInfo = vkinit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+        VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &cmdBufferBeginInfo));
+
+        vkutil::transitionImage(cmdBuffer, drawImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+        pathtracerDraw(cmdBuffer);
+        vkutil::transitionImage(cmdBuffer, drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+        VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+        uploads.flush();
+
+        VkCommandBufferSubmitInfo cmdBufferInfo = vkinit::commandBufferSubmitInfo(cmdBuffer);
+        VkSemaphoreSubmitInfo waitInfo = uploads.waitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+        VkSubmitInfo2 submitInfo = vkinit::submitInfo(&cmdBufferInfo, nullptr, &waitInfo);
+
+        {
+            std::lock_guard queueLock(queueMutex);
+            VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &submitInfo, currentFrame().renderFence));
+        }
+
+        frameNumber++;
+    }
+
+    waitDeviceIdle();
+    for (int i = 0; i < FRAME_OVERLAP; i++) {
+        gpuTime += readTracerResults(frames[i]);
+    }
+
+    return gpuTime;
+}
+
+float Engine::readTracerResults(FrameData& frame)
+{
+    if (frame.tracedTiles.empty()) {
+        return 0.f;
+    }
+
+    // the frame that last used these resources has finished, its GPU time sizes the next tile budget
+    // and its error estimates retire converged tiles
+    uint32_t tracedTileCount = static_cast<uint32_t>(frame.tracedTiles.size());
+    float gpuTime = 0.f;
+
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(device, frame.timestampPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        gpuTime = (timestamps[1] - timestamps[0]) * timestampPeriod / 1'000'000.f;
+        stats.tracerGpuTime = gpuTime;
+        tracer.tiles.updateBudget(gpuTime, tracedTileCount);
+    }
+
+    vmaInvalidateAllocation(allocator, frame.tileErrorBuffer.allocation, 0, tracedTileCount * sizeof(float));
+    std::span<const float> tileErrors{ static_cast<const float*>(frame.tileErrorBuffer.info.pMappedData), tracedTileCount };
+    tracer.tiles.updateErrors(frame.tileGeneration, frame.tracedTiles, tileErrors);
+
+    frame.tracedTiles.clear();
+    return gpuTime;
+}
+
+// rgb radiance sum and sample count of every pixel in the draw extent
+std::vector<glm::vec4> Engine::readAccumulation()
+{
+    const uint32_t width = drawExtent.width;
+    const uint32_t height = drawExtent.height;
+
+    AllocatedBuffer readback = createBuffer(width * height * sizeof(glm::vec4), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+    immediateSubmit([&](VkCommandBuffer cmd) {
+        VkBufferImageCopy copyRegion{
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .layerCount = 1,
+            },
+            .imageExtent = { width, height, 1 },
+        };
+
+        // the tracer leaves the accumulation image in the general layout
+        vkCmdCopyImageToBuffer(cmd, accumulationImage.image, VK_IMAGE_LAYOUT_GENERAL, readback.buffer, 1, &copyRegion);
+    });
+
+    vmaInvalidateAllocation(allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+    const glm::vec4* pixels = static_cast<const glm::vec4*>(readback.info.pMappedData);
+    std::vector<glm::vec4> accumulation(pixels, pixels + width * height);
+
+    destroyBuffer(readback);
+    return accumulation;
+}
+
+// writes the draw extent of the draw image as a PFM
+void Engine::saveDrawImage(const std::string& path)
+{
+    const uint32_t width = drawExtent.width;
+    const uint32_t height = drawExtent.height;
+
+    AllocatedBuffer readback = createBuffer(width * height * sizeof(uint16_t) * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+    immediateSubmit([&](VkCommandBuffer cmd) {
+        VkBufferImageCopy copyRegion{
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .layerCount = 1,
+            },
+            .imageExtent = { width, height, 1 },
+        };
+
+        vkCmdCopyImageToBuffer(cmd, drawImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &copyRegion);
+    });
+
+    vmaInvalidateAllocation(allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+    const uint16_t* pixels = static_cast<const uint16_t*>(readback.info.pMappedData);
+
+    std::vector<float> rgb(width * height * 3);
+    jobs.parallelFor(width * height, 4096, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t pixel = begin; pixel < end; pixel++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                rgb[pixel * 3 + c] = glm::unpackHalf1x16(pixels[pixel * 4 + c]);
+            }
+        }
+    });
+
+    destroyBuffer(readback);
+
+    writePFM(path, width, height, rgb);
+}
+
+void Engine::waitDeviceIdle()
+{
+    std::lock_guard queueLock(queueMutex);
+    vkDeviceWaitIdle(device);
+}
+
 FrameData& Engine::currentFrame()
 {
     return frames[frameNumber % FRAME_OVERLAP];
@@ -447,7 +885,10 @@ void Engine::immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function
     VkCommandBufferSubmitInfo cmdInfo = vkinit::commandBufferSubmitInfo(cmdBuffer);
     VkSubmitInfo2 submit = vkinit::submitInfo(&cmdInfo, nullptr, nullptr);
 
-    VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &submit, immediateFence));
+    {
+        std::lock_guard queueLock(queueMutex);
+        VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &submit, immediateFence));
+    }
 
     VK_CHECK(vkWaitForFences(device, 1, &immediateFence, true, 9999999999));
 }
@@ -457,8 +898,15 @@ void Engine::initSyncStructures()
     VkFenceCreateInfo fenceCreateInfo = vkinit::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
     VkSemaphoreCreateInfo semaphoreCreateInfo = vkinit::semaphoreCreateInfo();
 
+    VkQueryPoolCreateInfo queryPoolInfo{
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2,
+    };
+
     for (int i = 0; i < FRAME_OVERLAP; i++) {
         VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &frames[i].renderFence));
+        VK_CHECK(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &frames[i].timestampPool));
         VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frames[i].renderSemaphor));
         VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frames[i].swapchainSemaphore));
     }
@@ -487,7 +935,9 @@ void Engine::initAllocator()
 void Engine::initDescriptors()
 {
     std::vector<DescriptorAllocator::PoolSizeRatio> sizes{
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1}
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3},
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8}
     };
     globalDescriptorAllocator.init(device, 10, sizes);
     
@@ -498,10 +948,67 @@ void Engine::initDescriptors()
         drawImageDescriptors = globalDescriptorAllocator.allocate(device, drawImageDescriptorLayout);
     }
 
+    {
+        DescriptorLayoutBuilder builder;
+        builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        tracer.imageDescriptorLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+        tracer.imageDescriptors = globalDescriptorAllocator.allocate(device, tracer.imageDescriptorLayout);
+    }
+
+    {
+        DescriptorLayoutBuilder builder;
+        builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+        // bindless tables of the material table
+        materialTable.init(physicalDevice);
+        builder.addBinding(8, VK_DESCRIPTOR_TYPE_SAMPLER, materialTable.samplerCapacity);
+        builder.addBinding(9, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, materialTable.textureCapacity);
+
+        // only the entries referenced by the materials are written
+        std::vector<VkDescriptorBindingFlags> bindingFlags(builder.bindings.size(), 0);
+        bindingFlags[8] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+        bindingFlags[9] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+            .bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+            .pBindingFlags = bindingFlags.data(),
+        };
+        tracer.sceneDescriptorLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT, &bindingFlagsInfo);
+
+        std::vector<DescriptorAllocator::PoolSizeRatio> sceneSizes{
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 },
+            { VK_DESCRIPTOR_TYPE_SAMPLER, static_cast<float>(materialTable.samplerCapacity) },
+            { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, static_cast<float>(materialTable.textureCapacity) }
+        };
+        tracer.sceneDescriptorPool.init(device, 1, sceneSizes);
+        tracer.sceneDescriptors = tracer.sceneDescriptorPool.allocate(device, tracer.sceneDescriptorLayout);
+    }
+
+    {
+        DescriptorLayoutBuilder builder;
+        builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        tracer.queueDescriptorLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+        tracer.queueDescriptors = globalDescriptorAllocator.allocate(device, tracer.queueDescriptorLayout);
+    }
+
     {
         DescriptorLayoutBuilder builder;
         builder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        gpuSceneDataDescriptorLayout = builder.build(device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        gpuSceneDataDescriptorLayout = builder.build(device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
     }
 
     {
@@ -514,9 +1021,27 @@ void Engine::initDescriptors()
     writer.writeImage(0, drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
     writer.updateSet(device, drawImageDescriptors);
 
+    writer.clear();
+    writer.writeImage(0, drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    writer.writeImage(1, accumulationImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    writer.writeImage(2, luminanceMomentImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    writer.updateSet(device, tracer.imageDescriptors);
+
+    writer.clear();
+    writer.writeBuffer(0, tracer.queues.counterBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(1, tracer.queues.pathBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(2, tracer.queues.hitBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(3, tracer.queues.shadowRayBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(4, tracer.queues.radianceBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.updateSet(device, tracer.queueDescriptors);
+
     deletionQueue.push([&]() {
         globalDescriptorAllocator.destroyPools(device);
+        tracer.sceneDescriptorPool.destroyPools(device);
         vkDestroyDescriptorSetLayout(device, drawImageDescriptorLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, tracer.imageDescriptorLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, tracer.sceneDescriptorLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, tracer.queueDescriptorLayout, nullptr);
         vkDestroyDescriptorSetLayout(device, gpuSceneDataDescriptorLayout, nullptr);
         vkDestroyDescriptorSetLayout(device, singleImageDescriptorLayout, nullptr);
     });
@@ -545,48 +1070,75 @@ void Engine::initPipelines()
     initPathTracingPipelines();
 
     metalRoughMaterial.buildPipelines(this);
+
+    drawTable.buildPipeline(this);
 }
 
 void Engine::initPathTracingPipelines()
 {
-    VkShaderModule pathtracingShader;
-    if (!vkutil::loadShaderModule("shaders/pathtracing_comp.spv", device, pathtracingShader)) {
-        std::cout << "Error when building the compute shader" << std::endl;
-    }
-
     VkPushConstantRange pushConstant{
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .size = sizeof(ComputePushConstants),
     };
 
+    VkDescriptorSetLayout layouts[] = {
+        tracer.imageDescriptorLayout,
+        gpuSceneDataDescriptorLayout,
+        tracer.sceneDescriptorLayout,
+        tracer.queueDescriptorLayout
+    };
+
     VkPipelineLayoutCreateInfo layoutInfo{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = 1,
-        .pSetLayouts = &drawImageDescriptorLayout,
+        .setLayoutCount = 4,
+        .pSetLayouts = layouts,
         .pushConstantRangeCount = 1,
         .pPushConstantRanges = &pushConstant,
     };
 
     VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &tracer.layout));
 
-    VkPipelineShaderStageCreateInfo stageInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module = pathtracingShader,
-        .pName = "main"
-    };
+    auto buildStage = [&](const char* filePath, VkPipeline& pipeline) {
+        VkShaderModule stageShader;
+        if (!vkutil::loadShaderModule(filePath, device, stageShader)) {
+            std::cout << "Error when building the compute shader " << filePath << std::endl;
+        }
 
-    VkComputePipelineCreateInfo pipelineInfo{
-        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .stage = stageInfo,
-        .layout = tracer.layout,
+        VkPipelineShaderStageCreateInfo stageInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = stageShader,
+            .pName = "main"
+        };
+
+        VkComputePipelineCreateInfo pipelineInfo{
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = stageInfo,
+            .layout = tracer.layout,
+        };
+
+        VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+
+        vkDestroyShaderModule(device, stageShader, nullptr);
     };
 
-    VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &tracer.pipeline));
+    buildStage("shaders/pt_generate_comp.spv", tracer.generatePipeline);
+    buildStage("shaders/pt_dispatch_comp.spv", tracer.dispatchPipeline);
+    buildStage("shaders/pt_extend_comp.spv", tracer.extendPipeline);
+    buildStage("shaders/pt_shade_comp.spv", tracer.shadePipeline);
+    buildStage("shaders/pt_connect_comp.spv", tracer.connectPipeline);
+    buildStage("shaders/pt_accumulate_comp.spv", tracer.accumulatePipeline);
+    buildStage("shaders/pt_converge_comp.spv", tracer.convergePipeline);
 
-    vkDestroyShaderModule(device, pathtracingShader, nullptr);
     deletionQueue.push([=]() {
-        vkDestroyPipeline(device, tracer.pipeline, nullptr);
+        vkDestroyPipelineLayout(device, tracer.layout, nullptr);
+        vkDestroyPipeline(device, tracer.generatePipeline, nullptr);
+        vkDestroyPipeline(device, tracer.dispatchPipeline, nullptr);
+        vkDestroyPipeline(device, tracer.extendPipeline, nullptr);
+        vkDestroyPipeline(device, tracer.shadePipeline, nullptr);
+        vkDestroyPipeline(device, tracer.connectPipeline, nullptr);
+        vkDestroyPipeline(device, tracer.accumulatePipeline, nullptr);
+        vkDestroyPipeline(device, tracer.convergePipeline, nullptr);
     });
 }
 
@@ -721,6 +1273,20 @@ void Engine::initImgui()
     });
 }
 
+void Engine::initGeometryPool()
+{
+    // the path tracer binds the arenas as storage buffers
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkDeviceSize maxRange = properties.limits.maxStorageBufferRange;
+
+    geometryPool.init(this, std::min(GEOMETRY_POOL_VERTEX_BYTES, maxRange), std::min(GEOMETRY_POOL_INDEX_BYTES, maxRange));
+
+    deletionQueue.push([&]() {
+        geometryPool.destroy(this);
+    });
+}
+
 void Engine::initDefaultData()
 {
     // Default Textures
@@ -749,10 +1315,21 @@ void Engine::initDefaultData()
     };
     vkCreateSampler(device, &samplerInfo, nullptr, &defaultSamplerNearest);
 
+    // also used for textures without a sampler of their own, they are trilinear
     samplerInfo.magFilter = VK_FILTER_LINEAR;
     samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
     vkCreateSampler(device, &samplerInfo, nullptr, &defaultSamplerLinear);
 
+    // the tracer's blue noise mask, the sampler is bound only because texelFetch needs one
+    std::vector<uint32_t> blueNoise = generateBlueNoise(BLUE_NOISE_SIZE);
+    tracer.blueNoiseImage = createImage(blueNoise.data(), VkExtent3D{ BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, 1 }, VK_FORMAT_R32_UINT, VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    DescriptorWriter writer;
+    writer.writeImage(3, tracer.blueNoiseImage.imageView, defaultSamplerNearest, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    writer.updateSet(device, tracer.imageDescriptors);
+
     deletionQueue.push([&]() {
         vkDestroySampler(device, defaultSamplerNearest, nullptr);
         vkDestroySampler(device, defaultSamplerLinear, nullptr);
@@ -760,29 +1337,12 @@ void Engine::initDefaultData()
         destroyImage(greyImage);
         destroyImage(blackImage);
         destroyImage(missingTextureImage);
+        destroyImage(tracer.blueNoiseImage);
     });
 
     // Default Material
 
-    GLTFMetallicRoughness::MaterialResources materialResources{
-        .colorImage = whiteImage,
-        .colorSampler = defaultSamplerLinear,
-        .metalRoughImage = whiteImage,
-        .metalRoughSampler = defaultSamplerLinear,
-    };
-
-    AllocatedBuffer materialConstants = createBuffer(sizeof(GLTFMetallicRoughness::MaterialConstants), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-
-    auto sceneUniformData = (GLTFMetallicRoughness::MaterialConstants*)materialConstants.allocation->GetMappedData();
-    sceneUniformData->colorFactors = glm::vec4(1, 1, 1, 1);
-    sceneUniformData->metalRoughFactors = glm::vec4(1, 0.5, 0, 0);
-
-    deletionQueue.push([=]() {
-        destroyBuffer(materialConstants);
-    });
-
-    materialResources.dataBuffer = materialConstants.buffer;
-    defaultData = metalRoughMaterial.writeMaterial(device, MaterialPass::Opaque, materialResources, globalDescriptorAllocator);
+    defaultData = metalRoughMaterial.createInstance(MaterialPass::Opaque);
 
     for (auto& mesh : testMeshes) {
         std::shared_ptr<MeshNode> newNode = std::make_shared<MeshNode>();
@@ -826,23 +1386,18 @@ void Engine::drawImGui(VkCommandBuffer cmdBuffer, VkImageView targetImageView)
 void Engine::drawGeometry(VkCommandBuffer cmdBuffer)
 {
     stats.drawCallCount = 0;
+    stats.pipelineBindCount = 0;
+    stats.descriptorSetBindCount = 0;
+    stats.indexBufferBindCount = 0;
     stats.triangleCount = 0;
     auto start = std::chrono::system_clock::now();
 
-    AllocatedBuffer gpuSceneDataBuffer = createBuffer(sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    VkDescriptorSet globalDescriptor = writeSceneData();
 
-    currentFrame().deletionQueue.push([=]() {
-        destroyBuffer(gpuSceneDataBuffer);
-    });
-
-    GPUSceneData* sceneUniformData = (GPUSceneData*)gpuSceneDataBuffer.allocation->GetMappedData();
-    *sceneUniformData = sceneData;
-
-    VkDescriptorSet globalDescriptor = currentFrame().frameDescriptors.allocate(device, gpuSceneDataDescriptorLayout);
-
-    DescriptorWriter writer;
-    writer.writeBuffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    writer.updateSet(device, globalDescriptor);
+    // compute, so before the rendering starts
+    if (gpuDriven) {
+        drawTable.cull(cmdBuffer, extractFrustum(sceneData.viewprojection));
+    }
 
     VkRenderingAttachmentInfo colorAttachment = vkinit::attachmentInfo(drawImage.imageView, nullptr);
     VkRenderingAttachmentInfo depthAttachment = vkinit::depthAttachmentInfo(depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
@@ -865,16 +1420,32 @@ void Engine::drawGeometry(VkCommandBuffer cmdBuffer)
     };
     vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
 
-    auto draw = [&](const RenderObject& toDraw) {
-        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, toDraw.material->pipeline->pipeline);
-        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, toDraw.material->pipeline->layout, 0, 1, &globalDescriptor, 0, nullptr);
-        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, toDraw.material->pipeline->layout, 1, 1, &toDraw.material->materialSet, 0, nullptr);
+    // both material pipelines share one layout, so the sets stay bound across pipeline changes
+    VkDescriptorSet sets[] = { globalDescriptor, metalRoughMaterial.materialSet };
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, metalRoughMaterial.opaquePipeline.layout, 0, 2, sets, 0, nullptr);
+    stats.descriptorSetBindCount++;
+
+    // the indices of every mesh are in the geometry pool
+    vkCmdBindIndexBuffer(cmdBuffer, geometryPool.indexArena.buffer, 0, VK_INDEX_TYPE_UINT32);
+    stats.indexBufferBindCount++;
 
-        vkCmdBindIndexBuffer(cmdBuffer, toDraw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    // the surfaces are sorted by pipeline, only changes are bound
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    auto draw = [&](const RenderObject& toDraw) {
+        if (toDraw.material->pipeline->pipeline != boundPipeline) {
+            boundPipeline = toDraw.material->pipeline->pipeline;
+            vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boundPipeline);
+            stats.pipelineBindCount++;
+        }
 
         GPUDrawPushConstants pushConstants{
             .worldMatrix = toDraw.transform,
             .vertexBuffer = toDraw.vertexBufferAddress,
+            .colorBuffer = toDraw.colorBufferAddress,
+            .positionOrigin = toDraw.quantization.origin,
+            .vertexFlags = toDraw.vertexFlags,
+            .positionExtent = toDraw.quantization.extent,
+            .materialIndex = toDraw.materialIndex,
         };
         vkCmdPushConstants(cmdBuffer, toDraw.material->pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
 
@@ -884,12 +1455,19 @@ void Engine::drawGeometry(VkCommandBuffer cmdBuffer)
         stats.triangleCount += toDraw.indexCount / 3;
     };
 
-    for (const RenderObject& surface : mainDrawContext.opaqueSurfaces) {
-        draw(surface);
+    if (gpuDriven) {
+        // the visible count is only known on the GPU, transparent draws are additive and need no order
+        stats.drawCallCount = drawTable.draw(cmdBuffer, metalRoughMaterial.indirectOpaquePipeline, metalRoughMaterial.indirectTransparentPipeline);
+        stats.pipelineBindCount = stats.drawCallCount;
     }
+    else {
+        for (uint32_t index : mainDrawContext.opaqueOrder) {
+            draw(mainDrawContext.opaqueSurfaces[index]);
+        }
 
-    for (const RenderObject& surface : mainDrawContext.transparentSurfaces) {
-        draw(surface);
+        for (uint32_t index : mainDrawContext.transparentOrder) {
+            draw(mainDrawContext.transparentSurfaces[index]);
+        }
     }
     
     vkCmdEndRendering(cmdBuffer);
@@ -899,16 +1477,188 @@ void Engine::drawGeometry(VkCommandBuffer cmdBuffer)
     stats.meshDrawTime = elapsed.count() / 1000.f;
 }
 
+// makes the queue writes of one wavefront stage visible to the next one, including its indirect arguments
+static void queueBarrier(VkCommandBuffer cmdBuffer, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess)
+{
+    VkMemoryBarrier2 memoryBarrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = srcStage,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+        .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+    };
+
+    VkDependencyInfo depInfo{
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &memoryBarrier,
+    };
+
+    vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+}
+
 void Engine::pathtracerDraw(VkCommandBuffer cmdBuffer)
 {
+    // the traversal needs at least one instance with triangles
+    if (tracer.scene.empty()) {
+        clearImage(cmdBuffer, drawImage.image);
+        return;
+    }
+
     auto start = std::chrono::system_clock::now();
-    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.pipeline);
+
+    if (tracer.tiles.resize(drawExtent)) {
+        tracer.reset();
+    }
+
+    if (tracer.clearAccumulation) {
+        vkutil::transitionImage(cmdBuffer, accumulationImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+        VkClearColorValue clearValue{ { 0.f, 0.f, 0.f, 0.f } };
+        VkImageSubresourceRange clearRange = vkinit::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+        vkCmdClearColorImage(cmdBuffer, accumulationImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
+
+        vkutil::transitionImage(cmdBuffer, luminanceMomentImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        vkCmdClearColorImage(cmdBuffer, luminanceMomentImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
+
+        tracer.clearAccumulation = false;
+    }
+
+    std::span<const glm::uvec2> frameTiles = tracer.tiles.nextTiles();
+    tracer.sampleIndex = tracer.tiles.completedPasses;
+    uint32_t tileCount = static_cast<uint32_t>(frameTiles.size());
+
+    // every tile has converged, the image stays as it is until the next reset
+    if (tileCount == 0) {
+        return;
+    }
+
+    memcpy(currentFrame().tileBuffer.info.pMappedData, frameTiles.data(), frameTiles.size_bytes());
+    currentFrame().tracedTiles.assign(tracer.tiles.frameTileIndices().begin(), tracer.tiles.frameTileIndices().end());
+    currentFrame().tileGeneration = tracer.tiles.generation;
+
+    vkCmdResetQueryPool(cmdBuffer, currentFrame().timestampPool, 0, 2);
+    vkCmdWriteTimestamp2(cmdBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, currentFrame().timestampPool, 0);
+
+    VkDescriptorSet sets[] = {
+        tracer.imageDescriptors,
+        writeSceneData(),
+        tracer.sceneDescriptors,
+        tracer.queueDescriptors
+    };
+
+    // every stage uses the same layout, so the sets stay bound across pipeline changes
     vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.layout,
-        0, 1, &drawImageDescriptors, 0, nullptr);
+        0, 4, sets, 0, nullptr);
 
-    vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &tracer.pushConstants);
+    auto computeBarrier = [&]() {
+        queueBarrier(cmdBuffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    };
 
-    vkCmdDispatch(cmdBuffer, std::ceil(drawExtent.width / 16.0), std::ceil(drawExtent.height / 16.0), 1);
+    auto pushWave = [&](uint32_t bounce, TracerDispatchPass pass) {
+        // integer data is passed bitwise through the float push constants
+        tracer.pushConstants.data1 = glm::uintBitsToFloat(glm::uvec4(tracer.sampleIndex, frameNumber, drawExtent.width, drawExtent.height));
+        tracer.pushConstants.data2 = glm::uintBitsToFloat(glm::uvec4(bounce, pass, tracer.queues.capacity, tracer.maxDepth));
+        tracer.pushConstants.data3 = glm::uintBitsToFloat(glm::uvec4(
+            static_cast<uint32_t>(currentFrame().tileBufferAddress), static_cast<uint32_t>(currentFrame().tileBufferAddress >> 32), tileCount, tracer.sampleOffset));
+        tracer.pushConstants.data4 = glm::uintBitsToFloat(glm::uvec4(
+            static_cast<uint32_t>(currentFrame().tileErrorBufferAddress), static_cast<uint32_t>(currentFrame().tileErrorBufferAddress >> 32), tracer.tiles.minSamples, 0));
+
+        vkCmdPushConstants(cmdBuffer, tracer.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &tracer.pushConstants);
+    };
+
+    // the generate stage appends to the first ray queue, this also orders the accumulation clear before the tracing
+    vkCmdFillBuffer(cmdBuffer, tracer.queues.counterBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    queueBarrier(cmdBuffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+    // one z slice of 16x16 groups per tile
+    constexpr uint32_t tileGroups = TRACER_TILE_SIZE / 16;
+
+    pushWave(0, PrepareExtend);
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.generatePipeline);
+    vkCmdDispatch(cmdBuffer, tileGroups, tileGroups, tileCount);
+    computeBarrier();
+
+    // the queue sizes are only known on the GPU, so every bounce is recorded and empty ones dispatch no groups
+    for (uint32_t bounce = 0; bounce < tracer.maxDepth; bounce++) {
+        pushWave(bounce, PrepareExtend);
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.dispatchPipeline);
+        vkCmdDispatch(cmdBuffer, 1, 1, 1);
+        computeBarrier();
+
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.extendPipeline);
+        vkCmdDispatchIndirect(cmdBuffer, tracer.queues.counterBuffer.buffer, offsetof(TracerQueueCounters, extendDispatch));
+        computeBarrier();
+
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.shadePipeline);
+        vkCmdDispatchIndirect(cmdBuffer, tracer.queues.counterBuffer.buffer, offsetof(TracerQueueCounters, extendDispatch));
+        computeBarrier();
+
+        pushWave(bounce, PrepareConnect);
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.dispatchPipeline);
+        vkCmdDispatch(cmdBuffer, 1, 1, 1);
+        computeBarrier();
+
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.connectPipeline);
+        vkCmdDispatchIndirect(cmdBuffer, tracer.queues.counterBuffer.buffer, offsetof(TracerQueueCounters, shadowDispatch));
+        computeBarrier();
+    }
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.accumulatePipeline);
+    vkCmdDispatch(cmdBuffer, tileGroups, tileGroups, tileCount);
+    computeBarrier();
+
+    // one workgroup reduces a whole tile
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.convergePipeline);
+    vkCmdDispatch(cmdBuffer, 1, 1, tileCount);
+
+    VkMemoryBarrier2 readbackBarrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+        .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+    };
+
+    VkDependencyInfo readbackDependency{
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &readbackBarrier,
+    };
+
+    vkCmdPipelineBarrier2(cmdBuffer, &readbackDependency);
+
+    vkCmdWriteTimestamp2(cmdBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, currentFrame().timestampPool, 1);
+
+    auto end = std::chrono::system_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    stats.meshDrawTime = elapsed.count() / 1000.f;
+}
+
+void Engine::cpuTracerDraw(VkCommandBuffer cmdBuffer)
+{
+    if (tracer.scene.empty()) {
+        clearImage(cmdBuffer, drawImage.image);
+        return;
+    }
+
+    auto start = std::chrono::system_clock::now();
+
+    // blocks until every pixel got its sample, the worker threads share the tiles of the pass
+    std::span<const uint64_t> pixels = cpuTracer.renderPass(jobs, tracer.scene, sceneData, drawExtent);
+    stats.cpuTracerRaysPerSecond = cpuTracer.raysPerSecond;
+
+    memcpy(currentFrame().cpuTracerBuffer.info.pMappedData, pixels.data(), pixels.size_bytes());
+
+    VkBufferImageCopy copyRegion{
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .layerCount = 1,
+        },
+        .imageExtent = { drawExtent.width, drawExtent.height, 1 },
+    };
+
+    vkCmdCopyBufferToImage(cmdBuffer, currentFrame().cpuTracerBuffer.buffer, drawImage.image, VK_IMAGE_LAYOUT_GENERAL, 1, &copyRegion);
 
     auto end = std::chrono::system_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
@@ -933,8 +1683,22 @@ AllocatedBuffer Engine::createBuffer(size_t allocSize, VkBufferUsageFlags usage,
         .usage = usage,
     };
 
+    // anything the upload queue may copy into is shared with its family instead of changing owners
+    uint32_t queueFamilies[] = { graphicsQueueFamily, transferQueueFamily };
+    if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && transferQueueFamily != graphicsQueueFamily) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilies;
+    }
+
+    // buffers that are only touched by the GPU should not end up in host visible memory
+    VmaAllocationCreateFlags flags = 0;
+    if (memoryUsage != VMA_MEMORY_USAGE_GPU_ONLY) {
+        flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    }
+
     VmaAllocationCreateInfo vmaallocInfo{
-        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+        .flags = flags,
         .usage = memoryUsage
     };
 
@@ -949,15 +1713,28 @@ void Engine::destroyBuffer(const AllocatedBuffer& buffer)
 }
 
 AllocatedImage Engine::createImage(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped)
+{
+    VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(format, usage, size);
+    if (mipmapped) {
+        imgInfo.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(size.width, size.height)))) + 1;
+    }
+
+    return allocateImage(imgInfo, VkComponentMapping{});
+}
+
+AllocatedImage Engine::allocateImage(VkImageCreateInfo imgInfo, VkComponentMapping components)
 {
     AllocatedImage newImage{
-        .imageExtent = size,
-        .imageFormat = format,
+        .imageExtent = imgInfo.extent,
+        .imageFormat = imgInfo.format,
+        .mipLevels = imgInfo.mipLevels,
     };
 
-    VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(format, usage, size);
-    if (mipmapped) {
-        imgInfo.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(size.width, size.height))));
+    uint32_t queueFamilies[] = { graphicsQueueFamily, transferQueueFamily };
+    if ((imgInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) && transferQueueFamily != graphicsQueueFamily) {
+        imgInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imgInfo.queueFamilyIndexCount = 2;
+        imgInfo.pQueueFamilyIndices = queueFamilies;
     }
 
     VmaAllocationCreateInfo allocInfo{
@@ -968,12 +1745,13 @@ AllocatedImage Engine::createImage(VkExtent3D size, VkFormat format, VkImageUsag
     VK_CHECK(vmaCreateImage(allocator, &imgInfo, &allocInfo, &newImage.image, &newImage.allocation, nullptr));
 
     VkImageAspectFlags aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT;
-    if (format == VK_FORMAT_D32_SFLOAT) {
+    if (imgInfo.format == VK_FORMAT_D32_SFLOAT) {
         aspectFlag = VK_IMAGE_ASPECT_DEPTH_BIT;
     }
 
-    VkImageViewCreateInfo viewInfo = vkinit::imageViewCreateInfo(format, newImage.image, aspectFlag);
+    VkImageViewCreateInfo viewInfo = vkinit::imageViewCreateInfo(imgInfo.format, newImage.image, aspectFlag);
     viewInfo.subresourceRange.levelCount = imgInfo.mipLevels;
+    viewInfo.components = components;
 
     VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &newImage.imageView));
 
@@ -983,47 +1761,205 @@ AllocatedImage Engine::createImage(VkExtent3D size, VkFormat format, VkImageUsag
 AllocatedImage Engine::createImage(void* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped)
 {
     size_t dataSize = size.depth * size.width * size.height * 4;
-    AllocatedBuffer uploadBuffer = createBuffer(dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-
-    memcpy(uploadBuffer.info.pMappedData, data, dataSize);
 
     usage = usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     AllocatedImage newImage = createImage(size, format, usage, mipmapped);
 
-    immediateSubmit([&](VkCommandBuffer cmd) {
-        vkutil::transitionImage(cmd, newImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    uploads.uploadImage(data, dataSize, newImage);
 
-        VkBufferImageCopy copyRegion{
-            .imageSubresource{
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .layerCount = 1,
-            },
-            .imageExtent = size
-        };
+    return newImage;
+}
 
-        vkCmdCopyBufferToImage(cmd, uploadBuffer.buffer, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+AllocatedImage Engine::createImage(const TextureData& texture, VkImageUsageFlags usage)
+{
+    return createImage(texture, texture.data, usage);
+}
 
-        vkutil::transitionImage(cmd, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    });
+AllocatedImage Engine::createImage(const TextureData& texture, std::span<const uint8_t> data, VkImageUsageFlags usage)
+{
+    VkExtent3D size{ texture.extent.width, texture.extent.height, 1 };
+    if (texture.format == VK_FORMAT_R8G8B8A8_UNORM && texture.levelOffsets.size() == 1) {
+        return createImage(const_cast<uint8_t*>(data.data()), size, texture.format, usage, true);
+    }
+
+    VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(texture.format, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT, size);
+    imgInfo.mipLevels = static_cast<uint32_t>(texture.levelOffsets.size());
+
+    AllocatedImage newImage = allocateImage(imgInfo, texture.components);
 
-    destroyBuffer(uploadBuffer);
+    uploads.uploadImage(data.data(), data.size(), newImage, texture.levelOffsets);
 
     return newImage;
 }
 
+bool Engine::formatSampleable(VkFormat format) const
+{
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
 void Engine::destroyImage(const AllocatedImage& image)
 {
     vkDestroyImageView(device, image.imageView, nullptr);
     vmaDestroyImage(allocator, image.image, image.allocation);
 }
 
-void Engine::updateScene()
+void Engine::loadScene(const std::string& name, const std::filesystem::path& path)
+{
+    std::unique_ptr<SceneLoad> sceneLoad = std::make_unique<SceneLoad>();
+    sceneLoad->name = name;
+    sceneLoad->load.path = path;
+
+    // its own thread, a job would run on the main thread when it waits on the job system
+    GLTFLoad& load = sceneLoad->load;
+    sceneLoad->thread = std::thread([this, &load]() {
+        loadGLTF(this, load);
+    });
+
+    sceneLoads.push_back(std::move(sceneLoad));
+}
+
+void Engine::updateSceneLoads()
+{
+    bool scenesChanged = false;
+    bool texturesChanged = false;
+
+    for (auto it = sceneLoads.begin(); it != sceneLoads.end();) {
+        SceneLoad& sceneLoad = **it;
+
+        if (!sceneLoad.published && sceneLoad.load.geometryReady) {
+            // a scene it replaces may still be in use by frames in flight
+            if (loadedScenes.contains(sceneLoad.name)) {
+                waitDeviceIdle();
+            }
+            loadedScenes[sceneLoad.name] = sceneLoad.load.scene;
+            sceneLoad.published = true;
+            scenesChanged = true;
+        }
+
+        if (!sceneLoad.load.finished) {
+            it++;
+            continue;
+        }
+
+        sceneLoad.thread.join();
+        if (sceneLoad.load.scene) {
+            // nothing reads the materials between frames
+            sceneLoad.load.scene->applyTextures();
+            texturesChanged = true;
+        }
+        else {
+            std::cout << "Failed to load scene " << sceneLoad.name << std::endl;
+        }
+        it = sceneLoads.erase(it);
+    }
+
+    if (scenesChanged) {
+        buildMaterialTable();
+        buildDrawTable();
+        buildTracerScene();
+        cpuTracer.reset();
+    }
+    else if (texturesChanged) {
+        // the geometry and the material indices stay as they are, only the texture tables change
+        buildMaterialTable();
+        writeTracerMaterials();
+        tracer.reset();
+        cpuTracer.reset();
+    }
+}
+
+void Engine::buildMaterialTable()
+{
+    // the old material buffer may still be read by frames in flight
+    waitDeviceIdle();
+
+    materialTable.clear(this);
+    materialTable.build(loadedScenes);
+    materialTable.upload(this);
+
+    DescriptorWriter writer;
+    writer.writeBuffer(0, materialTable.materialBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    materialTable.writeTables(*this, writer, 1, 2);
+    writer.updateSet(device, metalRoughMaterial.materialSet);
+
+    std::cout << "Built material table with " << materialTable.materials.size() << " materials and "
+        << materialTable.textures.size() << " textures" << std::endl;
+}
+
+void Engine::buildDrawTable()
+{
+    // the old instances may still be read by frames in flight
+    waitDeviceIdle();
+
+    drawTable.clear(this);
+    drawTable.build(loadedScenes);
+    drawTable.upload(this);
+}
+
+void Engine::buildTracerScene()
 {
     auto start = std::chrono::system_clock::now();
 
-    mainDrawContext.opaqueSurfaces.clear();
-    mainDrawContext.transparentSurfaces.clear();
+    // the old scene buffers may still be read by frames in flight
+    waitDeviceIdle();
+
+    tracer.scene.clear(this);
+    tracer.scene.build(loadedScenes, materialTable, jobs);
+    tracer.scene.upload(this);
+
+    DescriptorWriter writer;
+    writer.writeBuffer(0, geometryPool.vertexArena.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(1, geometryPool.indexArena.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(2, tracer.scene.nodeBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(3, tracer.scene.primitiveBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(4, tracer.scene.instanceBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(5, tracer.scene.triangleMaterialBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.writeBuffer(7, tracer.scene.lightBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.updateSet(device, tracer.sceneDescriptors);
+
+    writeTracerMaterials();
+    tracer.reset();
+
+    auto end = std::chrono::system_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    std::cout << "Built path tracer scene with " << tracer.scene.instances.size() << " instances of "
+        << tracer.scene.triangleCount << " unique triangles and " << tracer.scene.lights.size() << " emissive triangles in " << elapsed.count() / 1000.f << " ms" << std::endl;
+}
+
+void Engine::writeTracerMaterials()
+{
+    DescriptorWriter writer;
+    writer.writeBuffer(6, materialTable.materialBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    materialTable.writeTables(*this, writer, 8, 9);
+    writer.updateSet(device, tracer.sceneDescriptors);
+}
+
+VkDescriptorSet Engine::writeSceneData()
+{
+    AllocatedBuffer gpuSceneDataBuffer = createBuffer(sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+    currentFrame().deletionQueue.push([=]() {
+        destroyBuffer(gpuSceneDataBuffer);
+    });
+
+    GPUSceneData* sceneUniformData = (GPUSceneData*)gpuSceneDataBuffer.allocation->GetMappedData();
+    *sceneUniformData = sceneData;
 
+    VkDescriptorSet globalDescriptor = currentFrame().frameDescriptors.allocate(device, gpuSceneDataDescriptorLayout);
+
+    DescriptorWriter writer;
+    writer.writeBuffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    writer.updateSet(device, globalDescriptor);
+
+    return globalDescriptor;
+}
+
+void Engine::updateCamera()
+{
     camera.update();
 
     sceneData.view = camera.viewMatrix();
@@ -1038,57 +1974,160 @@ void Engine::updateScene()
     sceneData.ambientColor = glm::vec4(.1f);
     sceneData.sunlightColor = glm::vec4(1.f);
     sceneData.sunlightDrection = glm::vec4(0, 1, 0.5, 1.f);
+}
 
-    loadedScenes["structure"]->draw(glm::mat4{ 1.f }, mainDrawContext);
+// distance in front of the camera, clamped to 0 so its bits sort like the float
+static float viewDepth(const glm::mat4& view, const RenderObject& surface)
+{
+    return std::max(-(view * glm::vec4(surface.bounds.origin, 1.f)).z, 0.f);
+}
+
+// opaque surfaces are grouped by pipeline, then by material, and drawn front to back within a group. The key packs
+// them in that order: 8 bits pipeline, 24 bits material index, 32 bits depth. Transparent surfaces only go back to front
+static void sortSurfaces(const std::vector<RenderObject>& surfaces, const glm::mat4& view, bool transparent, std::vector<uint32_t>& order)
+{
+    std::vector<const MaterialPipeline*> pipelines;
+    std::vector<std::pair<uint64_t, uint32_t>> keys(surfaces.size());
+
+    for (uint32_t i = 0; i < surfaces.size(); i++) {
+        const RenderObject& surface = surfaces[i];
+        uint64_t depthBits = std::bit_cast<uint32_t>(viewDepth(view, surface));
+
+        if (transparent) {
+            keys[i] = { ~depthBits & 0xffffffff, i };
+            continue;
+        }
+
+        auto pipeline = std::find(pipelines.begin(), pipelines.end(), surface.material->pipeline);
+        uint64_t pipelineId = pipeline - pipelines.begin();
+        if (pipeline == pipelines.end()) {
+            pipelines.push_back(surface.material->pipeline);
+        }
+
+        keys[i] = { (pipelineId << 56) | (static_cast<uint64_t>(surface.materialIndex & 0xffffff) << 32) | depthBits, i };
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    order.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        order[i] = keys[i].second;
+    }
+}
+
+void Engine::updateScene()
+{
+    auto start = std::chrono::system_clock::now();
+
+    mainDrawContext.opaqueSurfaces.clear();
+    mainDrawContext.transparentSurfaces.clear();
+
+    updateCamera();
+    Frustum frustum = extractFrustum(sceneData.viewprojection);
+
+    // top nodes collect and cull their surfaces in parallel and are merged in order, so equal sort keys keep their order
+    // scenes that are still loading are not in loadedScenes yet
+    std::vector<Node*> topNodes;
+    for (auto& [_, scene] : loadedScenes) {
+        for (auto& node : scene->topNodes) {
+            topNodes.push_back(node.get());
+        }
+    }
+    std::vector<DrawContext> nodeContexts(topNodes.size());
+    std::vector<uint32_t> culledCounts(topNodes.size());
+    jobs.parallelFor(static_cast<uint32_t>(topNodes.size()), 16, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            topNodes[i]->draw(glm::mat4{ 1.f }, nodeContexts[i]);
+            culledCounts[i] = cullRenderObjects(frustum, nodeContexts[i].opaqueSurfaces)
+                + cullRenderObjects(frustum, nodeContexts[i].transparentSurfaces);
+        }
+    });
+
+    stats.culledCount = 0;
+    for (uint32_t culled : culledCounts) {
+        stats.culledCount += culled;
+    }
+
+    for (const DrawContext& context : nodeContexts) {
+        mainDrawContext.opaqueSurfaces.insert(mainDrawContext.opaqueSurfaces.end(), context.opaqueSurfaces.begin(), context.opaqueSurfaces.end());
+        mainDrawContext.transparentSurfaces.insert(mainDrawContext.transparentSurfaces.end(), context.transparentSurfaces.begin(), context.transparentSurfaces.end());
+    }
+
+    sortSurfaces(mainDrawContext.opaqueSurfaces, sceneData.view, false, mainDrawContext.opaqueOrder);
+    sortSurfaces(mainDrawContext.transparentSurfaces, sceneData.view, true, mainDrawContext.transparentOrder);
 
     auto end = std::chrono::system_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
     stats.sceneUpdateTime = elapsed.count() / 1000.f;
 }
 
-GPUMeshBuffers Engine::uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices)
+std::optional<GPUMeshBuffers> Engine::uploadMesh(std::span<const uint32_t> indices, std::span<const Vertex> vertices)
 {
-    const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-    const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
-    
-    GPUMeshBuffers newSurface;
-    newSurface.vertexBuffer = createBuffer(vertexBufferSize,
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
-
-    VkBufferDeviceAddressInfo deviceAddressInfo{
-        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-        .buffer = newSurface.vertexBuffer.buffer,
-    };
-    newSurface.vertexBufferAddress = vkGetBufferDeviceAddress(device, &deviceAddressInfo);
+    return uploadMeshData(indices, std::as_bytes(vertices), {});
+}
 
-    newSurface.indexBuffer = createBuffer(indexBufferSize,VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+std::optional<GPUMeshBuffers> Engine::uploadMesh(std::span<const uint32_t> indices, const CompressedMesh& mesh)
+{
+    return uploadMesh(indices, mesh.vertices, mesh.colors);
+}
 
-    AllocatedBuffer staging = createBuffer(vertexBufferSize + indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+std::optional<GPUMeshBuffers> Engine::uploadMesh(std::span<const uint32_t> indices, std::span<const CompressedVertex> vertices, std::span<const uint32_t> colors)
+{
+    return uploadMeshData(indices, std::as_bytes(vertices), colors);
+}
 
-    void* data = staging.allocation->GetMappedData();
-    memcpy(data, vertices.data(), vertexBufferSize);
-    memcpy((char*)data + vertexBufferSize, indices.data(), indexBufferSize);
+std::optional<GPUMeshBuffers> Engine::uploadMeshData(std::span<const uint32_t> indices, std::span<const std::byte> vertexData, std::span<const uint32_t> colors)
+{
+    const size_t vertexBufferSize = vertexData.size();
+    const size_t colorBufferSize = colors.size() * sizeof(uint32_t);
+    const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
 
-    immediateSubmit([&](VkCommandBuffer cmdBuffer) {
-        VkBufferCopy vertexCopy{
-            .size = vertexBufferSize
-        };
+    std::optional<GeometryRange> vertexRange = geometryPool.allocateVertices(vertexBufferSize);
+    std::optional<GeometryRange> colorRange = colorBufferSize > 0 ? geometryPool.allocateVertices(colorBufferSize) : GeometryRange{};
+    std::optional<GeometryRange> indexRange = geometryPool.allocateIndices(indexBufferSize);
 
-        vkCmdCopyBuffer(cmdBuffer, staging.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+    // the ranges that did fit go back to the pool
+    if (!vertexRange || !colorRange || !indexRange) {
+        geometryPool.free(GPUMeshBuffers{
+            .vertices = vertexRange.value_or(GeometryRange{}),
+            .colors = colorRange.value_or(GeometryRange{}),
+            .indices = indexRange.value_or(GeometryRange{}),
+        });
+        return {};
+    }
+    
+    GPUMeshBuffers newSurface;
+    newSurface.vertices = *vertexRange;
+    newSurface.vertexBufferAddress = geometryPool.vertexArenaAddress + newSurface.vertices.offset;
 
-        VkBufferCopy indexCopy{
-            .srcOffset = vertexBufferSize,
-            .size = indexBufferSize,
-        };
+    if (colorBufferSize > 0) {
+        newSurface.colors = *colorRange;
+        newSurface.colorBufferAddress = geometryPool.vertexArenaAddress + newSurface.colors.offset;
+    }
 
-        vkCmdCopyBuffer(cmdBuffer, staging.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
-    });
+    newSurface.indices = *indexRange;
+    newSurface.firstIndex = static_cast<uint32_t>(newSurface.indices.offset / sizeof(uint32_t));
 
-    destroyBuffer(staging);
+    uploads.uploadBuffer(vertexData.data(), vertexBufferSize, geometryPool.vertexArena.buffer, newSurface.vertices.offset);
+    uploads.uploadBuffer(colors.data(), colorBufferSize, geometryPool.vertexArena.buffer, newSurface.colors.offset);
+    uploads.uploadBuffer(indices.data(), indexBufferSize, geometryPool.indexArena.buffer, newSurface.indices.offset);
 
     return newSurface;
 }
 
+AllocatedBuffer Engine::uploadBuffer(const void* data, size_t size, VkBufferUsageFlags usage)
+{
+    // zero sized buffers are not allowed, empty data still gets a buffer that can be bound
+    AllocatedBuffer newBuffer = createBuffer(std::max<size_t>(size, 16), usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    if (size == 0) {
+        return newBuffer;
+    }
+
+    uploads.uploadBuffer(data, size, newBuffer.buffer);
+
+    return newBuffer;
+}
+
 void GLTFMetallicRoughness::buildPipelines(Engine* engine)
 {
     VkShaderModule meshVertexShader;
@@ -1101,17 +2140,42 @@ void GLTFMetallicRoughness::buildPipelines(Engine* engine)
         std::cout << "Error building the fragment shader module!" << std::endl;
     };
 
+    VkShaderModule meshIndirectVertexShader;
+    if (!vkutil::loadShaderModule("shaders/mesh_indirect_vert.spv", engine->device, meshIndirectVertexShader)) {
+        std::cout << "Error building the indirect vertex shader module!" << std::endl;
+    };
+
     VkPushConstantRange matrixRange{
         .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
         .size = sizeof(GPUDrawPushConstants),
     };
 
+    const MaterialTable& table = engine->materialTable;
     DescriptorLayoutBuilder layoutBuilder;
-    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    layoutBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    layoutBuilder.addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    layoutBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_SAMPLER, table.samplerCapacity);
+    layoutBuilder.addBinding(2, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, table.textureCapacity);
+
+    // only the entries referenced by the materials are written
+    VkDescriptorBindingFlags bindingFlags[] = {
+        0,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = 3,
+        .pBindingFlags = bindingFlags,
+    };
+    materialLayout = layoutBuilder.build(engine->device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &bindingFlagsInfo);
 
-    materialLayout = layoutBuilder.build(engine->device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+    std::vector<DescriptorAllocator::PoolSizeRatio> sizes{
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+        { VK_DESCRIPTOR_TYPE_SAMPLER, static_cast<float>(table.samplerCapacity) },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, static_cast<float>(table.textureCapacity) }
+    };
+    descriptorPool.init(engine->device, 1, sizes);
+    materialSet = descriptorPool.allocate(engine->device, materialLayout);
 
     VkDescriptorSetLayout layouts[] = {
         engine->gpuSceneDataDescriptorLayout,
@@ -1129,6 +2193,8 @@ void GLTFMetallicRoughness::buildPipelines(Engine* engine)
 
     opaquePipeline.layout = newLayout;
     transparentPipeline.layout = newLayout;
+    indirectOpaquePipeline.layout = newLayout;
+    indirectTransparentPipeline.layout = newLayout;
 
     PipelineBuilder pipelineBuilder;
     pipelineBuilder.setShaders(meshVertexShader, meshFragmentShader);
@@ -1145,28 +2211,37 @@ void GLTFMetallicRoughness::buildPipelines(Engine* engine)
     pipelineBuilder.pipelineLayout = newLayout;
     opaquePipeline.pipeline = pipelineBuilder.build(engine->device);
 
+    pipelineBuilder.setShaders(meshIndirectVertexShader, meshFragmentShader);
+    indirectOpaquePipeline.pipeline = pipelineBuilder.build(engine->device);
+
     pipelineBuilder.enableBlendingAdditive();
     pipelineBuilder.enableDepthtest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
     
+    indirectTransparentPipeline.pipeline = pipelineBuilder.build(engine->device);
+
+    pipelineBuilder.setShaders(meshVertexShader, meshFragmentShader);
     transparentPipeline.pipeline = pipelineBuilder.build(engine->device);
 
     vkDestroyShaderModule(engine->device, meshVertexShader, nullptr);
     vkDestroyShaderModule(engine->device, meshFragmentShader, nullptr);
+    vkDestroyShaderModule(engine->device, meshIndirectVertexShader, nullptr);
 }
 
 void GLTFMetallicRoughness::clearResources(VkDevice device)
 {
+    descriptorPool.destroyPools(device);
     vkDestroyDescriptorSetLayout(device, materialLayout, nullptr);
     vkDestroyPipelineLayout(device, opaquePipeline.layout, nullptr);
 
     vkDestroyPipeline(device, opaquePipeline.pipeline, nullptr);
     vkDestroyPipeline(device, transparentPipeline.pipeline, nullptr);
+    vkDestroyPipeline(device, indirectOpaquePipeline.pipeline, nullptr);
+    vkDestroyPipeline(device, indirectTransparentPipeline.pipeline, nullptr);
 }
 
-MaterialInstance GLTFMetallicRoughness::writeMaterial(VkDevice device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocator& descriptorAllocator)
+MaterialInstance GLTFMetallicRoughness::createInstance(MaterialPass pass)
 {
     MaterialInstance matData{
-        .materialSet = descriptorAllocator.allocate(device, materialLayout),
         .passType = pass
     };
     if (pass == MaterialPass::Transparent) {
@@ -1175,12 +2250,6 @@ MaterialInstance GLTFMetallicRoughness::writeMaterial(VkDevice device, MaterialP
     else {
         matData.pipeline = &opaquePipeline;
     }
-    
-    writer.clear();
-    writer.writeBuffer(0, resources.dataBuffer, sizeof(MaterialConstants), resources.dataBufferOffset, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    writer.writeImage(1, resources.colorImage.imageView, resources.colorSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    writer.writeImage(2, resources.metalRoughImage.imageView, resources.metalRoughSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    writer.updateSet(device, matData.materialSet);
 
     return matData;
 }
@@ -1192,11 +2261,15 @@ void MeshNode::draw(const glm::mat4& topMatrix, DrawContext& ctx)
     for (auto& surface : mesh->surfaces) {
         RenderObject renderObject{
             .indexCount = surface.count,
-            .firstIndex = surface.startIndex,
-            .indexBuffer = mesh->meshBuffers.indexBuffer.buffer,
+            .firstIndex = mesh->meshBuffers.firstIndex + surface.startIndex,
             .material = &surface.material->data,
+            .materialIndex = surface.material->tableIndex,
             .transform = nodeMatrix,
-            .vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress
+            .vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress,
+            .colorBufferAddress = mesh->meshBuffers.colorBufferAddress,
+            .vertexFlags = mesh->vertexFlags,
+            .quantization = mesh->compressed.quantization,
+            .bounds = transformBounds(surface.bounds, nodeMatrix),
         };
 
         if (surface.material->data.passType == MaterialPass::Transparent) {
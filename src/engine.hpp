@@ -7,6 +7,17 @@
 #include "vk_descriptors.hpp"
 #include "vk_loader.hpp"
 #include "camera.hpp"
+#include "material_table.hpp"
+#include "draw_table.hpp"
+#include "geometry_pool.hpp"
+#include "upload_queue.hpp"
+#include "texture_compression.hpp"
+#include "tracer_scene.hpp"
+#include "tracer_queues.hpp"
+#include "tile_scheduler.hpp"
+#include "cpu_tracer.hpp"
+#include "job_system.hpp"
+#include "distributed.hpp"
 
 
 struct ComputePushConstants {
@@ -18,22 +29,67 @@ struct ComputePushConstants {
 
 struct PathTracer {
 	bool render = true;
-	VkPipeline pipeline;
+	// number of full passes over the image since the last reset
+	uint32_t sampleIndex = 0;
+	// added to the per pixel sample counts, workers of a distributed render trace disjoint ranges
+	uint32_t sampleOffset = 0;
+	bool clearAccumulation = true;
+	glm::mat4 lastViewProjection{ 0.f };
+	uint32_t maxDepth = 8;
+
+	// wavefront stages, they share one layout and talk through the queues
+	VkPipeline generatePipeline;
+	VkPipeline dispatchPipeline;
+	VkPipeline extendPipeline;
+	VkPipeline shadePipeline;
+	VkPipeline connectPipeline;
+	VkPipeline accumulatePipeline;
+	VkPipeline convergePipeline;
 	VkPipelineLayout layout;
+	VkDescriptorSetLayout imageDescriptorLayout;
+	VkDescriptorSet imageDescriptors;
+	VkDescriptorSetLayout sceneDescriptorLayout;
+	VkDescriptorSet sceneDescriptors;
+	// holds only the scene set, its bindless arrays would exhaust the shared pools
+	DescriptorAllocator sceneDescriptorPool;
+	VkDescriptorSetLayout queueDescriptorLayout;
+	VkDescriptorSet queueDescriptors;
 	ComputePushConstants pushConstants;
+
+	// blue noise ranks that shift the sample sequence per pixel
+	AllocatedImage blueNoiseImage;
+
+	TracerScene scene;
+	TracerQueues queues;
+	TileScheduler tiles;
+
+	void reset() {
+		sampleIndex = 0;
+		clearAccumulation = true;
+		tiles.restart();
+	}
 };
 
 enum RenderMode {
 	PathTrace,
 	Rasterize,
+	CpuTrace,
 };
 
 struct EngineStats {
 	float frametime;
 	int triangleCount;
 	int drawCallCount;
+	// vkCmdBind* calls of the geometry pass
+	int pipelineBindCount;
+	int descriptorSetBindCount;
+	int indexBufferBindCount;
+	// surfaces outside the view frustum
+	int culledCount;
 	float sceneUpdateTime;
 	float meshDrawTime;
+	float tracerGpuTime;
+	float cpuTracerRaysPerSecond;
 };
 
 struct MeshNode : public Node {
@@ -43,33 +99,20 @@ struct MeshNode : public Node {
 };
 
 struct GLTFMetallicRoughness {
-
-	struct MaterialConstants {
-		glm::vec4 colorFactors;
-		glm::vec4 metalRoughFactors;
-		// padding to get 256 bytes (minimum requirement all gpus meet)
-		glm::vec4 extra[14];
-	};
-
-	struct MaterialResources {
-		AllocatedImage colorImage;
-		VkSampler colorSampler;
-		AllocatedImage metalRoughImage;
-		VkSampler metalRoughSampler;
-		VkBuffer dataBuffer;
-		uint32_t dataBufferOffset;
-	};
-
 	MaterialPipeline opaquePipeline;
 	MaterialPipeline transparentPipeline;
+	// draw the instances of the draw table, same layout as the pipelines above
+	MaterialPipeline indirectOpaquePipeline;
+	MaterialPipeline indirectTransparentPipeline;
 
+	// material buffer and bindless tables of the material table, shared by all draws
 	VkDescriptorSetLayout materialLayout;
-
-	DescriptorWriter writer;
+	VkDescriptorSet materialSet;
+	DescriptorAllocator descriptorPool;
 
 	void buildPipelines(Engine* engine);
 	void clearResources(VkDevice device);
-	MaterialInstance writeMaterial(VkDevice device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocator& descriptorAllocator);
+	MaterialInstance createInstance(MaterialPass pass);
 };
 
 struct ComputeEffect {
@@ -103,16 +146,65 @@ struct FrameData {
 	
 	DeletionQueue deletionQueue;
 	DescriptorAllocator frameDescriptors;
+
+	// start and end timestamps of the path tracer work of this frame
+	VkQueryPool timestampPool;
+	// scheduler indices of the tiles traced by this frame and the generation they belong to
+	std::vector<uint32_t> tracedTiles;
+	uint32_t tileGeneration;
+	AllocatedBuffer tileBuffer;
+	VkDeviceAddress tileBufferAddress;
+	// written by the converge stage, one error estimate per traced tile
+	AllocatedBuffer tileErrorBuffer;
+	VkDeviceAddress tileErrorBufferAddress;
+	// rgba16f pixels of the CPU tracer, copied into the draw image
+	AllocatedBuffer cpuTracerBuffer;
 };
 
 constexpr unsigned int FRAME_OVERLAP = 2;
 
+// a scene loading in the background, see GLTFLoad
+struct SceneLoad {
+	std::string name;
+	GLTFLoad load;
+	std::thread thread;
+	// the scene is in loadedScenes, its textures may still be missing
+	bool published = false;
+};
+
+// set from the command line, the defaults open a window
+struct EngineOptions {
+	// no window, swapchain or UI, renders options.samples passes and writes the draw image to outputPath
+	bool headless = false;
+	std::string scenePath = "..\\..\\assets\\monkey.glb";
+	// draw image size of a headless render
+	VkExtent2D extent{ 800, 800 };
+	uint32_t samples = 64;
+	std::string outputPath = "render.pfm";
+	// distributed render: the coordinator listens on this port and only merges, it needs no GPU
+	uint16_t coordinatorPort = 0;
+	// distributed render: a worker renders the jobs of the coordinator at this host:port
+	std::string coordinatorAddress;
+	uint32_t samplesPerJob = 16;
+	// seconds before a job is handed to another worker as well
+	float jobTimeout = 120.f;
+	// loaded meshes use the quantized vertex format
+	bool compressVertices = false;
+	// loaded png and jpeg textures are block compressed, the results are cached next to the scene
+	bool compressTextures = false;
+	// loaded scenes are read from and written to a binary cache next to the glTF file
+	bool sceneCache = true;
+};
+
 struct Engine {
+	EngineOptions options;
 	bool resizeRequested = false;
 	bool initialized = false;
 	int frameNumber{ 0 };
 	float renderScale = 1.f;
 	RenderMode renderMode = PathTrace;
+	// the rasterizer culls and draws the draw table on the GPU instead of walking the scene nodes
+	bool gpuDriven = false;
 
 	VkExtent2D windowExtent{ 800, 800 };
 	VkExtent2D drawExtent;
@@ -122,6 +214,11 @@ struct Engine {
 	VkInstance instance;
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	// nanoseconds per timestamp tick
+	float timestampPeriod;
+	bool textureCompressionBC = false;
+	// the draw table needs indirect draws with a first instance
+	bool gpuDrivenSupported = false;
 	VkDevice device;
 	VkSurfaceKHR surface;
 
@@ -136,11 +233,18 @@ struct Engine {
 
 	VkQueue graphicsQueue;
 	uint32_t graphicsQueueFamily;
+	// the graphics queue on devices without a transfer only family
+	VkQueue transferQueue;
+	uint32_t transferQueueFamily;
+	// held for every submission to either queue, loader threads submit their uploads themselves
+	std::mutex queueMutex;
 
 	DeletionQueue deletionQueue;
 
 	VmaAllocator allocator;
 	AllocatedImage drawImage;
+	AllocatedImage accumulationImage;
+	AllocatedImage luminanceMomentImage;
 	AllocatedImage depthImage;
 
 	DescriptorAllocator globalDescriptorAllocator;
@@ -158,6 +262,9 @@ struct Engine {
 
 	std::vector<std::shared_ptr<MeshAsset>> testMeshes;
 
+	// all uploads of meshes, textures and scene buffers, frames wait for them on the GPU
+	UploadQueue uploads;
+
 	GPUSceneData sceneData;
 	VkDescriptorSetLayout gpuSceneDataDescriptorLayout;
 
@@ -174,38 +281,64 @@ struct Engine {
 
 	MaterialInstance defaultData;
 	GLTFMetallicRoughness metalRoughMaterial;
+	MaterialTable materialTable;
+	DrawTable drawTable;
+	// vertex and index data of all loaded meshes
+	GeometryPool geometryPool;
 
 	DrawContext mainDrawContext;
 	std::unordered_map<std::string, std::shared_ptr<Node>> loadedNodes;
 
 	Camera camera;
 	std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>> loadedScenes;
+	std::vector<std::unique_ptr<SceneLoad>> sceneLoads;
 
 	EngineStats stats;
 
+	// worker threads for the CPU side of the engine
+	JobSystem jobs;
+
 	PathTracer tracer;
+	CpuTracer cpuTracer;
 
 	static Engine& Get();
 
-	void init();
+	void init(const EngineOptions& engineOptions = {});
 	void cleanup();
 	void draw();
 	void run();
+	void renderHeadless();
+	// renders the jobs of a distributed render until the coordinator shuts the connection down
+	void renderJobs(RenderConnection& coordinator);
 	void initCommands();
 	FrameData& currentFrame();
 	void immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
-	GPUMeshBuffers uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices);
+	void waitDeviceIdle();
+	// loads a glTF file in the background, it joins loadedScenes under name once its geometry is ready
+	void loadScene(const std::string& name, const std::filesystem::path& path);
+	// nothing if the geometry pool has no room for the mesh
+	std::optional<GPUMeshBuffers> uploadMesh(std::span<const uint32_t> indices, std::span<const Vertex> vertices);
+	std::optional<GPUMeshBuffers> uploadMesh(std::span<const uint32_t> indices, const CompressedMesh& mesh);
+	std::optional<GPUMeshBuffers> uploadMesh(std::span<const uint32_t> indices, std::span<const CompressedVertex> vertices, std::span<const uint32_t> colors);
+	AllocatedBuffer uploadBuffer(const void* data, size_t size, VkBufferUsageFlags usage);
 
 	AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage = VMA_MEMORY_USAGE_AUTO);
 	void destroyBuffer(const AllocatedBuffer& buffer);
 
 	AllocatedImage createImage(void* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
+	// the image gets the texture's levels and its view the texture's swizzle
+	AllocatedImage createImage(const TextureData& texture, VkImageUsageFlags usage);
+	// same with the texels in data instead of texture.data, a single rgba8 level gets its mips blitted
+	AllocatedImage createImage(const TextureData& texture, std::span<const uint8_t> data, VkImageUsageFlags usage);
+	// optimal tiling images of the format can be sampled and copied to
+	bool formatSampleable(VkFormat format) const;
 	void destroyImage(const AllocatedImage& image);
 
 private:
 	void initWindow();
 	void initVulkan();
 	void initSwapchain();
+	void initPathTracingQueues();
 	void createSwapchain(int width, int height);
 	void resizeSwapchain();
 	void destroySwapchain();
@@ -217,13 +350,36 @@ private:
 	void initBackgroundPipelines();
 	void initImgui();
 	void initDefaultData();
+	void initGeometryPool();
+	// copies the mesh into the geometry pool, the colors get their own range when not empty
+	std::optional<GPUMeshBuffers> uploadMeshData(std::span<const uint32_t> indices, std::span<const std::byte> vertexData, std::span<const uint32_t> colors);
 	void drawBackground(VkCommandBuffer cmdBuffer);
 	void drawImGui(VkCommandBuffer cmdBuffer, VkImageView targetImageView);
 	void drawGeometry(VkCommandBuffer cmdBuffer);
 	void pathtracerDraw(VkCommandBuffer cmdBuffer);
+	void cpuTracerDraw(VkCommandBuffer cmdBuffer);
+	// GPU time and error estimates of a finished frame, returns its tracer time in milliseconds
+	float readTracerResults(FrameData& frame);
+	// traces sampleCount samples per pixel starting at firstSample into the cleared accumulation image and
+	// waits for them, returns the tracer GPU time in milliseconds
+	float renderSamples(uint32_t firstSample, uint32_t sampleCount);
+	std::vector<glm::vec4> readAccumulation();
+	void saveDrawImage(const std::string& path);
 	void rasterizerDraw(VkCommandBuffer cmdBuffer);
 
 	AllocatedImage createImage(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
-
+	AllocatedImage allocateImage(VkImageCreateInfo imgInfo, VkComponentMapping components);
+	VkDescriptorSet writeSceneData();
+
+	// rebuild from the loaded scenes, the draw table and the tracer scene index the material table
+	void buildMaterialTable();
+	void buildDrawTable();
+	void buildTracerScene();
+	// points the tracer at the current material buffer and tables, after a rebuild of only the materials
+	void writeTracerMaterials();
+	// publishes the scenes of background loads and rebuilds what depends on them
+	void updateSceneLoads();
+
+	void updateCamera();
 	void updateScene();
 };
\ No newline at end of file
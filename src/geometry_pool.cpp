@@ -0,0 +1,129 @@
+#include "geometry_pool.hpp"
+
+#include "engine.hpp"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+void FreeListAllocator::init(VkDeviceSize arenaSize)
+{
+	capacity = arenaSize;
+	usedSize = 0;
+	freeBlocks.clear();
+	freeBlocks[0] = arenaSize;
+}
+
+std::optional<VkDeviceSize> FreeListAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	size = alignUp(size, alignment);
+
+	for (auto it = freeBlocks.begin(); it != freeBlocks.end(); it++) {
+		auto [blockOffset, blockSize] = *it;
+		VkDeviceSize offset = alignUp(blockOffset, alignment);
+		if (offset + size > blockOffset + blockSize) {
+			continue;
+		}
+
+		// the block is split into the alignment gap in front and the rest behind the range
+		freeBlocks.erase(it);
+		if (offset > blockOffset) {
+			freeBlocks[blockOffset] = offset - blockOffset;
+		}
+		if (offset + size < blockOffset + blockSize) {
+			freeBlocks[offset + size] = blockOffset + blockSize - offset - size;
+		}
+
+		usedSize += size;
+		return offset;
+	}
+
+	return std::nullopt;
+}
+
+void FreeListAllocator::free(VkDeviceSize offset, VkDeviceSize size)
+{
+	usedSize -= size;
+
+	auto next = freeBlocks.lower_bound(offset);
+	if (next != freeBlocks.end() && offset + size == next->first) {
+		size += next->second;
+		next = freeBlocks.erase(next);
+	}
+
+	if (next != freeBlocks.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			previous->second += size;
+			return;
+		}
+	}
+
+	freeBlocks[offset] = size;
+}
+
+void GeometryPool::init(Engine* engine, VkDeviceSize vertexBytes, VkDeviceSize indexBytes)
+{
+	vertexArena = engine->createBuffer(vertexBytes,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+
+	VkBufferDeviceAddressInfo deviceAddressInfo{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+		.buffer = vertexArena.buffer,
+	};
+	vertexArenaAddress = vkGetBufferDeviceAddress(engine->device, &deviceAddressInfo);
+
+	indexArena = engine->createBuffer(indexBytes,
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+
+	vertexAllocator.init(vertexBytes);
+	indexAllocator.init(indexBytes);
+}
+
+void GeometryPool::destroy(Engine* engine)
+{
+	engine->destroyBuffer(vertexArena);
+	engine->destroyBuffer(indexArena);
+}
+
+std::optional<GeometryRange> GeometryPool::allocateVertices(VkDeviceSize size)
+{
+	std::lock_guard lock(mutex);
+
+	std::optional<VkDeviceSize> offset = vertexAllocator.allocate(size, GEOMETRY_POOL_ALIGNMENT);
+	if (!offset) {
+		return {};
+	}
+
+	return GeometryRange{ .offset = *offset, .size = alignUp(size, GEOMETRY_POOL_ALIGNMENT) };
+}
+
+std::optional<GeometryRange> GeometryPool::allocateIndices(VkDeviceSize size)
+{
+	std::lock_guard lock(mutex);
+
+	std::optional<VkDeviceSize> offset = indexAllocator.allocate(size, GEOMETRY_POOL_ALIGNMENT);
+	if (!offset) {
+		return {};
+	}
+
+	return GeometryRange{ .offset = *offset, .size = alignUp(size, GEOMETRY_POOL_ALIGNMENT) };
+}
+
+void GeometryPool::free(const GPUMeshBuffers& meshBuffers)
+{
+	std::lock_guard lock(mutex);
+
+	if (meshBuffers.vertices.size > 0) {
+		vertexAllocator.free(meshBuffers.vertices.offset, meshBuffers.vertices.size);
+	}
+	if (meshBuffers.colors.size > 0) {
+		vertexAllocator.free(meshBuffers.colors.offset, meshBuffers.colors.size);
+	}
+	if (meshBuffers.indices.size > 0) {
+		indexAllocator.free(meshBuffers.indices.offset, meshBuffers.indices.size);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+#include <map>
+#include <mutex>
+#include <optional>
+
+struct Engine;
+
+// sizes of the geometry arenas, lowered to the storage buffer range of the device
+constexpr VkDeviceSize GEOMETRY_POOL_VERTEX_BYTES = 512ull << 20;
+constexpr VkDeviceSize GEOMETRY_POOL_INDEX_BYTES = 256ull << 20;
+// every range starts aligned to this, enough for the Vertex and CompressedVertex records
+constexpr VkDeviceSize GEOMETRY_POOL_ALIGNMENT = 16;
+
+// first fit allocator over the offsets of an arena. Free blocks are kept sorted by offset and merged with
+// their neighbours when a range is given back.
+struct FreeListAllocator {
+	VkDeviceSize capacity = 0;
+	VkDeviceSize usedSize = 0;
+
+	void init(VkDeviceSize arenaSize);
+	// offset of a free range of size bytes, nothing if no free block is large enough
+	std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment);
+	void free(VkDeviceSize offset, VkDeviceSize size);
+
+private:
+	// offset to size
+	std::map<VkDeviceSize, VkDeviceSize> freeBlocks;
+};
+
+// the vertex and index data of every loaded mesh, sub-allocated from one device local buffer each.
+// Meshes only hold ranges of the arenas, so the rasterizer binds one index buffer and the path tracer
+// reads all geometry through two storage buffers. Meshes may be allocated and freed from any thread.
+struct GeometryPool {
+	// Vertex or CompressedVertex records and color streams, read through its device address
+	AllocatedBuffer vertexArena;
+	VkDeviceAddress vertexArenaAddress;
+	// uint32 indices local to their mesh
+	AllocatedBuffer indexArena;
+
+	void init(Engine* engine, VkDeviceSize vertexBytes, VkDeviceSize indexBytes);
+	void destroy(Engine* engine);
+
+	// nothing if the arena is full, the callers run on job threads and must not throw
+	std::optional<GeometryRange> allocateVertices(VkDeviceSize size);
+	std::optional<GeometryRange> allocateIndices(VkDeviceSize size);
+	// gives back every range of the mesh, the GPU must be done with it
+	void free(const GPUMeshBuffers& meshBuffers);
+
+	// of both arenas
+	VkDeviceSize bytesUsed() const { return vertexAllocator.usedSize + indexAllocator.usedSize; }
+	VkDeviceSize capacity() const { return vertexAllocator.capacity + indexAllocator.capacity; }
+
+private:
+	std::mutex mutex;
+	FreeListAllocator vertexAllocator;
+	FreeListAllocator indexAllocator;
+};
@@ -0,0 +1,131 @@
+#include "job_system.hpp"
+
+namespace {
+
+// the job system the current thread works for and its deque in it
+thread_local const JobSystem* workerSystem = nullptr;
+thread_local uint32_t workerQueue = 0;
+
+}
+
+JobSystem::JobSystem()
+	: JobSystem(std::max(1u, std::thread::hardware_concurrency()) - 1)
+{
+}
+
+JobSystem::JobSystem(uint32_t workerCount)
+{
+	for (uint32_t i = 0; i <= workerCount; i++) {
+		queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	for (uint32_t i = 1; i <= workerCount; i++) {
+		workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard lock(sleepMutex);
+		stopping = true;
+	}
+	jobQueued.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void JobSystem::run(JobCounter& counter, std::function<void()> job)
+{
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+	WorkQueue& queue = *queues[currentQueue()];
+	{
+		std::lock_guard lock(queue.mutex);
+		queue.jobs.push_back(Job{ std::move(job), &counter });
+	}
+
+	// taking the lock orders the increment against a worker checking it before it sleeps
+	{
+		std::lock_guard lock(sleepMutex);
+		queuedJobs.fetch_add(1, std::memory_order_relaxed);
+	}
+	jobQueued.notify_one();
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	uint32_t queueIndex = currentQueue();
+	while (counter.pending.load(std::memory_order_acquire) > 0) {
+		if (!runQueuedJob(queueIndex, &counter)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::workerLoop(uint32_t queueIndex)
+{
+	workerSystem = this;
+	workerQueue = queueIndex;
+
+	while (true) {
+		if (runQueuedJob(queueIndex)) {
+			continue;
+		}
+
+		std::unique_lock lock(sleepMutex);
+		jobQueued.wait(lock, [&]() { return stopping || queuedJobs.load(std::memory_order_relaxed) > 0; });
+		if (stopping) {
+			return;
+		}
+	}
+}
+
+uint32_t JobSystem::currentQueue() const
+{
+	return workerSystem == this ? workerQueue : 0;
+}
+
+bool JobSystem::runQueuedJob(uint32_t queueIndex, const JobCounter* counter)
+{
+	Job job;
+	bool found = false;
+
+	auto matches = [&](const Job& queued) {
+		return counter == nullptr || queued.counter == counter;
+	};
+
+	// newest own job first, then the oldest job of the other deques
+	{
+		WorkQueue& queue = *queues[queueIndex];
+		std::lock_guard lock(queue.mutex);
+		auto it = std::find_if(queue.jobs.rbegin(), queue.jobs.rend(), matches);
+		if (it != queue.jobs.rend()) {
+			job = std::move(*it);
+			queue.jobs.erase(std::next(it).base());
+			found = true;
+		}
+	}
+
+	for (size_t i = 1; i < queues.size() && !found; i++) {
+		WorkQueue& victim = *queues[(queueIndex + i) % queues.size()];
+		std::lock_guard lock(victim.mutex);
+		auto it = std::find_if(victim.jobs.begin(), victim.jobs.end(), matches);
+		if (it != victim.jobs.end()) {
+			job = std::move(*it);
+			victim.jobs.erase(it);
+			found = true;
+		}
+	}
+
+	if (!found) {
+		return false;
+	}
+
+	queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	job.function();
+	job.counter->pending.fetch_sub(1, std::memory_order_release);
+	return true;
+}
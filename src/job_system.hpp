@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// unfinished jobs of a group. A job may run children under the counter it runs under, they are counted
+// before the parent finishes, so waiting on the counter waits for the whole tree of jobs.
+struct JobCounter {
+	std::atomic<uint32_t> pending = 0;
+};
+
+// work-stealing job system. Every thread pushes and pops its own jobs at the back of its deque and steals
+// from the front of the other deques when it runs out, so recently spawned (cache warm) jobs run locally
+// and large, old jobs get stolen. Threads outside the pool share the first deque.
+struct JobSystem {
+	// starts one worker per hardware thread besides the calling thread
+	JobSystem();
+	explicit JobSystem(uint32_t workerCount);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	void run(JobCounter& counter, std::function<void()> job);
+	// runs queued jobs of the counter until it reaches zero, so jobs can wait on their children without
+	// blocking a worker. Jobs of other counters are left alone, a short wait never picks up a long
+	// unrelated job like a scene load
+	void wait(JobCounter& counter);
+
+	// calls body(begin, end) on consecutive ranges of at most batchSize items and returns when all are done
+	template<typename Function>
+	void parallelFor(uint32_t count, uint32_t batchSize, Function&& body)
+	{
+		JobCounter counter;
+		for (uint32_t begin = 0; begin < count; begin += batchSize) {
+			uint32_t end = std::min(count, begin + batchSize);
+			run(counter, [&body, begin, end]() { body(begin, end); });
+		}
+		wait(counter);
+	}
+
+	// workers and the calling thread
+	uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+
+private:
+	struct Job {
+		std::function<void()> function;
+		JobCounter* counter;
+	};
+
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::thread> workers;
+	// one per worker, preceded by the one of the threads outside the pool
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+
+	std::mutex sleepMutex;
+	std::condition_variable jobQueued;
+	std::atomic<uint32_t> queuedJobs = 0;
+	bool stopping = false;
+
+	void workerLoop(uint32_t queueIndex);
+	uint32_t currentQueue() const;
+	// any job when counter is null, only the jobs of counter otherwise
+	bool runQueuedJob(uint32_t queueIndex, const JobCounter* counter = nullptr);
+};
@@ -0,0 +1,273 @@
+#include "ktx2.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const char WRITER_KEY[] = "KTXwriter";
+static const char WRITER[] = "pathtracer";
+// four floats, the mean of the texels the texture was encoded from
+static const char AVERAGE_KEY[] = "pathtracer.average";
+
+struct KTX2Header {
+	uint8_t identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+static_assert(sizeof(KTX2Header) == 80);
+
+struct KTX2Level {
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+// one sample of a basic data format descriptor block
+struct DescriptorSample {
+	uint32_t channel;
+	uint32_t bitOffset;
+	uint32_t bitLength;
+};
+
+bool isKTX2(std::span<const uint8_t> bytes)
+{
+	return bytes.size() >= sizeof(KTX2_IDENTIFIER) && memcmp(bytes.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+}
+
+std::optional<VkFormat> ktx2Format(std::span<const uint8_t> bytes)
+{
+	KTX2Header header;
+	if (!isKTX2(bytes) || bytes.size() < sizeof(header)) {
+		return {};
+	}
+	memcpy(&header, bytes.data(), sizeof(header));
+
+	// BasisLZ and UASTC textures have no Vulkan format until they are transcoded
+	if (header.vkFormat == VK_FORMAT_UNDEFINED || header.supercompressionScheme != 0) {
+		return {};
+	}
+	if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+		return {};
+	}
+
+	return static_cast<VkFormat>(header.vkFormat);
+}
+
+std::optional<TextureData> readKTX2(std::span<const uint8_t> bytes)
+{
+	if (!ktx2Format(bytes)) {
+		return {};
+	}
+
+	KTX2Header header;
+	memcpy(&header, bytes.data(), sizeof(header));
+
+	uint32_t levelCount = std::max(header.levelCount, 1u);
+	if (sizeof(header) + static_cast<uint64_t>(levelCount) * sizeof(KTX2Level) > bytes.size()) {
+		return {};
+	}
+
+	TextureData texture{
+		.format = static_cast<VkFormat>(header.vkFormat),
+		.extent = { header.pixelWidth, std::max(header.pixelHeight, 1u) },
+	};
+
+	for (uint32_t i = 0; i < levelCount; i++) {
+		KTX2Level level;
+		memcpy(&level, bytes.data() + sizeof(header) + i * sizeof(KTX2Level), sizeof(level));
+		if (level.byteOffset + level.byteLength > bytes.size()) {
+			return {};
+		}
+
+		texture.levelOffsets.push_back(texture.data.size());
+		texture.data.insert(texture.data.end(), bytes.begin() + level.byteOffset, bytes.begin() + level.byteOffset + level.byteLength);
+	}
+
+	uint64_t kvdEnd = static_cast<uint64_t>(header.kvdByteOffset) + header.kvdByteLength;
+	uint64_t offset = header.kvdByteOffset;
+	while (kvdEnd <= bytes.size() && offset + 4 <= kvdEnd) {
+		uint32_t length;
+		memcpy(&length, bytes.data() + offset, sizeof(length));
+		if (offset + 4 + length > kvdEnd) {
+			break;
+		}
+
+		const char* entry = reinterpret_cast<const char*>(bytes.data() + offset + 4);
+		std::string_view key(entry, strnlen(entry, length));
+		if (key == AVERAGE_KEY && key.size() + 1 + sizeof(glm::vec4) == length) {
+			glm::vec4 average;
+			memcpy(&average, entry + key.size() + 1, sizeof(average));
+			texture.average = average;
+		}
+
+		offset += 4 + (length + 3) / 4 * 4;
+	}
+
+	return texture;
+}
+
+// bytes of a 4x4 block, 0 for the formats the cache does not write
+static uint32_t blockBytes(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		return 8;
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+// the basic descriptor block of the Khronos data format specification for the BC formats
+static std::vector<uint32_t> dataFormatDescriptor(VkFormat format)
+{
+	uint32_t colorModel;
+	std::vector<DescriptorSample> samples;
+
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		colorModel = 128;
+		samples = { { 0, 0, 64 } };
+		break;
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+		colorModel = 131;
+		samples = { { 0, 0, 64 }, { 1, 64, 64 } };
+		break;
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		colorModel = 133;
+		samples = { { 0, 0, 128 } };
+		break;
+	default:
+		return {};
+	}
+
+	uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+
+	std::vector<uint32_t> words;
+	// total size, then the Khronos vendor and basic descriptor type
+	words.push_back(4 + blockSize);
+	words.push_back(0);
+	// version 1.3
+	words.push_back(2 | (blockSize << 16));
+	// BT.709 primaries, linear transfer, straight alpha
+	words.push_back(colorModel | (1 << 8) | (1 << 16));
+	// 4x4 texel blocks, every dimension is stored minus one
+	words.push_back(3 | (3 << 8));
+	// bytes of the block in the first plane
+	words.push_back(blockBytes(format));
+	words.push_back(0);
+
+	for (const DescriptorSample& sample : samples) {
+		words.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channel << 24));
+		words.push_back(0);
+		words.push_back(0);
+		words.push_back(UINT32_MAX);
+	}
+
+	return words;
+}
+
+static void addKeyValue(std::vector<uint8_t>& kvd, std::string_view key, const void* value, uint32_t valueLength)
+{
+	uint32_t length = static_cast<uint32_t>(key.size()) + 1 + valueLength;
+	const uint8_t* lengthBytes = reinterpret_cast<const uint8_t*>(&length);
+	const uint8_t* valueBytes = static_cast<const uint8_t*>(value);
+
+	kvd.insert(kvd.end(), lengthBytes, lengthBytes + sizeof(length));
+	kvd.insert(kvd.end(), key.begin(), key.end());
+	kvd.push_back(0);
+	kvd.insert(kvd.end(), valueBytes, valueBytes + valueLength);
+	kvd.resize((kvd.size() + 3) / 4 * 4, 0);
+}
+
+bool writeKTX2(const std::filesystem::path& path, const TextureData& texture)
+{
+	std::vector<uint32_t> dfd = dataFormatDescriptor(texture.format);
+	if (dfd.empty() || texture.levelOffsets.empty()) {
+		return false;
+	}
+
+	// keys are sorted
+	std::vector<uint8_t> kvd;
+	addKeyValue(kvd, WRITER_KEY, WRITER, sizeof(WRITER));
+	if (texture.average) {
+		addKeyValue(kvd, AVERAGE_KEY, &*texture.average, sizeof(glm::vec4));
+	}
+
+	uint32_t levelCount = static_cast<uint32_t>(texture.levelOffsets.size());
+	uint32_t dfdOffset = static_cast<uint32_t>(sizeof(KTX2Header) + levelCount * sizeof(KTX2Level));
+	uint32_t kvdOffset = dfdOffset + static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+	// the smallest level comes first, every level starts at a multiple of the block size
+	uint64_t alignment = blockBytes(texture.format);
+	uint64_t dataOffset = kvdOffset + kvd.size();
+	std::vector<KTX2Level> levels(levelCount);
+	for (uint32_t i = levelCount; i-- > 0;) {
+		size_t levelEnd = i + 1 < levelCount ? texture.levelOffsets[i + 1] : texture.data.size();
+		uint64_t levelSize = levelEnd - texture.levelOffsets[i];
+		dataOffset = (dataOffset + alignment - 1) / alignment * alignment;
+		levels[i] = KTX2Level{ .byteOffset = dataOffset, .byteLength = levelSize, .uncompressedByteLength = levelSize };
+		dataOffset += levelSize;
+	}
+
+	KTX2Header header{
+		.vkFormat = static_cast<uint32_t>(texture.format),
+		.typeSize = 1,
+		.pixelWidth = texture.extent.width,
+		.pixelHeight = texture.extent.height,
+		.faceCount = 1,
+		.levelCount = levelCount,
+		.dfdByteOffset = dfdOffset,
+		.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t)),
+		.kvdByteOffset = kvdOffset,
+		.kvdByteLength = static_cast<uint32_t>(kvd.size()),
+	};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+
+	std::vector<uint8_t> file(dataOffset, 0);
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), levels.data(), levels.size() * sizeof(KTX2Level));
+	memcpy(file.data() + dfdOffset, dfd.data(), dfd.size() * sizeof(uint32_t));
+	memcpy(file.data() + kvdOffset, kvd.data(), kvd.size());
+	for (uint32_t i = 0; i < levelCount; i++) {
+		memcpy(file.data() + levels[i].byteOffset, texture.data.data() + texture.levelOffsets[i], levels[i].byteLength);
+	}
+
+	// written under a name of its own and renamed, loads of the same image never see half a file
+	std::filesystem::path temporaryPath = path;
+	temporaryPath += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+	{
+		std::ofstream stream(temporaryPath, std::ios::binary);
+		if (!stream.write(reinterpret_cast<const char*>(file.data()), file.size())) {
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error) {
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "texture_compression.hpp"
+
+#include <filesystem>
+#include <optional>
+
+bool isKTX2(std::span<const uint8_t> bytes);
+// the format of a KTX2 file that readKTX2 accepts as far as its header tells, without reading the levels
+std::optional<VkFormat> ktx2Format(std::span<const uint8_t> bytes);
+// textures of KTX2 files without supercompression, like the ones of the texture cache. Basis Universal
+// payloads need a transcoder and are rejected, so are arrays, cube maps and 3D textures
+std::optional<TextureData> readKTX2(std::span<const uint8_t> bytes);
+// writes one of the BC encodings with its data format descriptor, the average goes into the key/value data
+bool writeKTX2(const std::filesystem::path& path, const TextureData& texture);
@@ -1,16 +1,130 @@
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
 #include "engine.hpp"
+#include "pfm.hpp"
 
+// --headless [--scene path] [--width n] [--height n] [--samples n] [--output path.pfm]
+// --coordinator port [--width n] [--height n] [--samples n] [--job-samples n] [--job-timeout seconds] [--output path.pfm]
+// --worker host:port [--scene path]
+// any mode: [--compress-vertices] [--compress-textures] [--no-scene-cache]
+static EngineOptions parseOptions(int argc, char* argv[])
+{
+    EngineOptions options;
 
-int main() {
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--headless") {
+            options.headless = true;
+        }
+        else if (argument == "--scene" && hasValue) {
+            options.scenePath = argv[++i];
+        }
+        else if (argument == "--width" && hasValue) {
+            options.extent.width = std::stoul(argv[++i]);
+        }
+        else if (argument == "--height" && hasValue) {
+            options.extent.height = std::stoul(argv[++i]);
+        }
+        else if (argument == "--samples" && hasValue) {
+            options.samples = std::stoul(argv[++i]);
+        }
+        else if (argument == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        }
+        else if (argument == "--coordinator" && hasValue) {
+            options.coordinatorPort = static_cast<uint16_t>(std::stoul(argv[++i]));
+        }
+        else if (argument == "--worker" && hasValue) {
+            options.coordinatorAddress = argv[++i];
+            options.headless = true;
+        }
+        else if (argument == "--job-samples" && hasValue) {
+            options.samplesPerJob = std::stoul(argv[++i]);
+        }
+        else if (argument == "--job-timeout" && hasValue) {
+            options.jobTimeout = std::stof(argv[++i]);
+        }
+        else if (argument == "--compress-vertices") {
+            options.compressVertices = true;
+        }
+        else if (argument == "--compress-textures") {
+            options.compressTextures = true;
+        }
+        else if (argument == "--no-scene-cache") {
+            options.sceneCache = false;
+        }
+        else {
+            throw std::runtime_error("unknown or incomplete argument " + argument);
+        }
+    }
+
+    if (options.extent.width == 0 || options.extent.height == 0 || options.samples == 0 || options.samplesPerJob == 0) {
+        throw std::runtime_error("width, height, samples and job samples must be at least 1");
+    }
+
+    return options;
+}
+
+// merges the sample ranges rendered by the workers into one image
+static void renderCoordinator(const EngineOptions& options)
+{
+    RenderCoordinator coordinator(CoordinatorSettings{
+        .port = options.coordinatorPort,
+        .width = options.extent.width,
+        .height = options.extent.height,
+        .samples = options.samples,
+        .samplesPerJob = options.samplesPerJob,
+        .jobTimeout = std::chrono::duration<float>(options.jobTimeout),
+    });
+
+    std::vector<glm::vec4> accumulation = coordinator.render();
+
+    std::vector<float> rgb(accumulation.size() * 3);
+    for (size_t i = 0; i < accumulation.size(); i++) {
+        float sampleCount = std::max(accumulation[i].w, 1.f);
+        rgb[3 * i + 0] = accumulation[i].x / sampleCount;
+        rgb[3 * i + 1] = accumulation[i].y / sampleCount;
+        rgb[3 * i + 2] = accumulation[i].z / sampleCount;
+    }
+
+    writePFM(options.outputPath, options.extent.width, options.extent.height, rgb);
+}
+
+int main(int argc, char* argv[]) {
     try {
+        EngineOptions options = parseOptions(argc, argv);
+
+        if (options.coordinatorPort != 0) {
+            renderCoordinator(options);
+            return EXIT_SUCCESS;
+        }
+
+        // workers render at the resolution the coordinator merges at
+        RenderConnection coordinator;
+        if (!options.coordinatorAddress.empty()) {
+            coordinator = RenderConnection::connect(options.coordinatorAddress);
+            if (!coordinator.receiveSetup(options.extent.width, options.extent.height)) {
+                throw std::runtime_error("coordinator " + options.coordinatorAddress + " closed the connection");
+            }
+        }
+
         Engine engine;
-        
-        engine.init();
-        
-        engine.run();
+
+        engine.init(options);
+
+        if (!options.coordinatorAddress.empty()) {
+            engine.renderJobs(coordinator);
+        }
+        else if (options.headless) {
+            engine.renderHeadless();
+        }
+        else {
+            engine.run();
+        }
 
         engine.cleanup();
     }
@@ -20,4 +134,4 @@ int main() {
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,168 @@
+#include "material_table.hpp"
+
+#include "engine.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+glm::vec4 unpackBaseColor(const GPUMaterial& material)
+{
+	return glm::unpackUnorm4x8(material.baseColor);
+}
+
+glm::vec3 unpackEmission(const GPUMaterial& material)
+{
+	return glm::vec3(
+		glm::unpackHalf1x16(material.emission[0]),
+		glm::unpackHalf1x16(material.emission[1]),
+		glm::unpackHalf1x16(material.emission[2]));
+}
+
+void MaterialTable::init(VkPhysicalDevice physicalDevice)
+{
+	// one slot of every stage stays free for the blue noise texture of the path tracer
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	textureCapacity = std::min(MAX_MATERIAL_TEXTURES, properties.limits.maxPerStageDescriptorSampledImages - 1);
+	samplerCapacity = std::min(MAX_MATERIAL_SAMPLERS, properties.limits.maxPerStageDescriptorSamplers - 1);
+}
+
+void MaterialTable::build(const std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>>& scenes)
+{
+	textures.assign(1, VK_NULL_HANDLE);
+	samplers.assign(1, VK_NULL_HANDLE);
+	textureIndices.clear();
+	samplerIndices.clear();
+	materialIndices.clear();
+
+	GLTFMaterial defaultMaterial;
+	materials.assign(1, pack(defaultMaterial));
+
+	// every image of the loaded files goes into the texture table, materials only add missing ones
+	for (auto& [_, scene] : scenes) {
+		for (auto& image : scene->images) {
+			addTexture(image.second.imageView);
+		}
+	}
+
+	// the name keyed maps of a file can miss unnamed materials, the nodes reach all that are drawn
+	for (auto& [_, scene] : scenes) {
+		for (auto& node : scene->topNodes) {
+			addNode(*node);
+		}
+	}
+}
+
+void MaterialTable::addNode(const Node& node)
+{
+	if (const MeshNode* meshNode = dynamic_cast<const MeshNode*>(&node)) {
+		for (const GeoSurface& surface : meshNode->mesh->surfaces) {
+			addMaterial(*surface.material);
+		}
+	}
+
+	for (auto& child : node.children) {
+		addNode(*child);
+	}
+}
+
+void MaterialTable::addMaterial(GLTFMaterial& material)
+{
+	auto it = materialIndices.find(&material);
+	if (it != materialIndices.end()) {
+		return;
+	}
+
+	materials.push_back(pack(material));
+	material.tableIndex = static_cast<uint32_t>(materials.size() - 1);
+	materialIndices[&material] = material.tableIndex;
+}
+
+GPUMaterial MaterialTable::pack(const GLTFMaterial& material)
+{
+	GPUMaterial packed{
+		.baseColor = glm::packUnorm4x8(material.baseColor),
+		.emission = {
+			glm::packHalf1x16(material.emission.r),
+			glm::packHalf1x16(material.emission.g),
+			glm::packHalf1x16(material.emission.b),
+		},
+		.metallic = static_cast<uint8_t>(glm::packUnorm1x8(material.metallic)),
+		.roughness = static_cast<uint8_t>(glm::packUnorm1x8(material.roughness)),
+	};
+
+	if (material.baseColorImage) {
+		packed.baseColorTexture = addTexture(material.baseColorImage);
+		packed.baseColorSampler = addSampler(material.baseColorSampler);
+	}
+	if (material.metalRoughImage) {
+		packed.metalRoughTexture = addTexture(material.metalRoughImage);
+		packed.metalRoughSampler = addSampler(material.metalRoughSampler);
+	}
+
+	return packed;
+}
+
+uint16_t MaterialTable::addTexture(VkImageView image)
+{
+	auto it = textureIndices.find(image);
+	if (it != textureIndices.end()) {
+		return static_cast<uint16_t>(it->second);
+	}
+
+	if (textures.size() >= textureCapacity) {
+		std::cout << "material texture table is full, shading with the material factors" << std::endl;
+		textureIndices[image] = 0;
+		return 0;
+	}
+
+	textures.push_back(image);
+	textureIndices[image] = static_cast<uint32_t>(textures.size() - 1);
+	return static_cast<uint16_t>(textures.size() - 1);
+}
+
+uint16_t MaterialTable::addSampler(VkSampler sampler)
+{
+	auto it = samplerIndices.find(sampler);
+	if (it != samplerIndices.end()) {
+		return static_cast<uint16_t>(it->second);
+	}
+
+	if (samplers.size() >= samplerCapacity) {
+		samplerIndices[sampler] = 0;
+		return 0;
+	}
+
+	samplers.push_back(sampler);
+	samplerIndices[sampler] = static_cast<uint32_t>(samplers.size() - 1);
+	return static_cast<uint16_t>(samplers.size() - 1);
+}
+
+void MaterialTable::upload(Engine* engine)
+{
+	materialBuffer = engine->uploadBuffer(materials.data(), materials.size() * sizeof(GPUMaterial), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	uploaded = true;
+}
+
+void MaterialTable::clear(Engine* engine)
+{
+	if (!uploaded) {
+		return;
+	}
+
+	engine->destroyBuffer(materialBuffer);
+
+	uploaded = false;
+}
+
+void MaterialTable::writeTables(const Engine& engine, DescriptorWriter& writer, uint32_t samplerBinding, uint32_t textureBinding) const
+{
+	for (uint32_t i = 0; i < samplers.size(); i++) {
+		VkSampler sampler = i == 0 ? engine.defaultSamplerLinear : samplers[i];
+		writer.writeImage(samplerBinding, VK_NULL_HANDLE, sampler, VK_IMAGE_LAYOUT_UNDEFINED, VK_DESCRIPTOR_TYPE_SAMPLER, i);
+	}
+	for (uint32_t i = 0; i < textures.size(); i++) {
+		VkImageView texture = i == 0 ? engine.whiteImage.imageView : textures[i];
+		writer.writeImage(textureBinding, texture, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, i);
+	}
+}
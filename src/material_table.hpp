@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vk_types.hpp"
+#include "vk_descriptors.hpp"
+#include "vk_loader.hpp"
+
+struct Engine;
+
+// upper bounds of the bindless texture and sampler tables, lowered to the device limits
+constexpr uint32_t MAX_MATERIAL_TEXTURES = 4096;
+constexpr uint32_t MAX_MATERIAL_SAMPLERS = 256;
+
+// one material in the material buffer, same layout as GPUMaterial in material.glsl (std430)
+struct GPUMaterial {
+	// rgba8 unorm base color factor
+	uint32_t baseColor;
+	// rgb half float radiance emitted from both sides of the surface
+	uint16_t emission[3];
+	// unorm8 factors
+	uint8_t metallic;
+	uint8_t roughness;
+	// indices into the bindless texture and sampler tables
+	uint16_t baseColorTexture;
+	uint16_t metalRoughTexture;
+	uint16_t baseColorSampler;
+	uint16_t metalRoughSampler;
+};
+
+static_assert(sizeof(GPUMaterial) == 20);
+
+glm::vec4 unpackBaseColor(const GPUMaterial& material);
+glm::vec3 unpackEmission(const GPUMaterial& material);
+
+// every material of the loaded scenes in one storage buffer, plus bindless tables of the textures and
+// samplers they use. The rasterizer and the path tracer index it with GLTFMaterial::tableIndex.
+struct MaterialTable {
+	// entry 0 is the default material
+	std::vector<GPUMaterial> materials;
+	// entry 0 stands for the engine's white image and default sampler, references beyond the capacity
+	// of the descriptor arrays fall back to it
+	std::vector<VkImageView> textures;
+	std::vector<VkSampler> samplers;
+	uint32_t textureCapacity = 1;
+	uint32_t samplerCapacity = 1;
+
+	AllocatedBuffer materialBuffer;
+
+	// fits the table capacities to the device, before any layout using them is built
+	void init(VkPhysicalDevice physicalDevice);
+	// assigns the table index of every material reachable from the scene nodes
+	void build(const std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>>& scenes);
+	void upload(Engine* engine);
+	void clear(Engine* engine);
+
+	// writes the sampler and texture arrays of a set that declares them
+	void writeTables(const Engine& engine, DescriptorWriter& writer, uint32_t samplerBinding, uint32_t textureBinding) const;
+
+private:
+	bool uploaded = false;
+
+	std::unordered_map<const GLTFMaterial*, uint32_t> materialIndices;
+	std::unordered_map<VkImageView, uint32_t> textureIndices;
+	std::unordered_map<VkSampler, uint32_t> samplerIndices;
+
+	void addNode(const Node& node);
+	void addMaterial(GLTFMaterial& material);
+	GPUMaterial pack(const GLTFMaterial& material);
+	uint16_t addTexture(VkImageView image);
+	uint16_t addSampler(VkSampler sampler);
+};
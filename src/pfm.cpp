@@ -0,0 +1,21 @@
+#include "pfm.hpp"
+
+#include <fstream>
+#include <iostream>
+
+bool writePFM(const std::string& path, uint32_t width, uint32_t height, std::span<const float> rgb)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cout << "Failed to open " << path << " for writing" << std::endl;
+		return false;
+	}
+
+	file << "PF\n" << width << " " << height << "\n-1.0\n";
+	for (uint32_t y = height; y-- > 0;) {
+		file.write(reinterpret_cast<const char*>(rgb.data() + static_cast<size_t>(y) * width * 3), width * 3 * sizeof(float));
+	}
+
+	std::cout << "Wrote " << path << std::endl;
+	return true;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+// writes rgb floats given top row first as a little endian PFM, which stores the rows bottom to top
+bool writePFM(const std::string& path, uint32_t width, uint32_t height, std::span<const float> rgb);
@@ -0,0 +1,854 @@
+#include "scene_cache.hpp"
+
+#include "engine.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char SCENE_CACHE_MAGIC[8] = "PTSCENE";
+constexpr uint64_t ARRAY_ALIGNMENT = 16;
+
+// SceneCacheKey::options
+constexpr uint32_t CACHED_COMPRESSED_VERTICES = 1;
+constexpr uint32_t CACHED_COMPRESSED_TEXTURES = 2;
+
+// sampler indices of materials that have none of the file's samplers
+constexpr int32_t NO_SAMPLER = -1;
+constexpr int32_t DEFAULT_SAMPLER = -2;
+
+struct SceneCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t options;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	// written last, a file without it was never finished
+	uint64_t imageTableOffset;
+};
+
+struct CachedSampler {
+	uint32_t magFilter;
+	uint32_t minFilter;
+	uint32_t mipmapMode;
+	float maxLod;
+};
+
+struct CachedMaterial {
+	glm::vec4 baseColor;
+	glm::vec3 emission;
+	float metallic;
+	float roughness;
+	uint32_t passType;
+	int32_t baseColorSampler;
+	int32_t metalRoughSampler;
+};
+
+struct CachedTextureReference {
+	uint32_t material;
+	uint32_t use;
+	uint64_t image;
+};
+
+struct CachedSurface {
+	uint32_t startIndex;
+	uint32_t count;
+	uint32_t material;
+	Bounds bounds;
+};
+
+// the arrays of the records point into the mapped file
+struct CachedMesh {
+	std::string name;
+	uint32_t vertexFlags;
+	std::span<const CachedSurface> surfaces;
+	std::span<const uint32_t> indices;
+	std::span<const Vertex> vertices;
+	PositionQuantization quantization;
+	std::span<const CompressedVertex> compressedVertices;
+	std::span<const uint32_t> colors;
+	std::span<const BVHNode> bvhNodes;
+	std::span<const uint32_t> primitiveIndices;
+};
+
+struct CachedNode {
+	int32_t mesh;
+	glm::mat4 localTransform;
+	std::span<const uint32_t> children;
+};
+
+// no levels for images that failed to load when the cache was written
+struct CachedImage {
+	glm::vec4 average{ 1.f };
+	VkFormat format;
+	VkExtent2D extent;
+	VkComponentMapping components;
+	std::span<const VkDeviceSize> levelOffsets;
+	std::span<const uint8_t> data;
+};
+
+// a read only mapping of a whole file
+struct MappedFile {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+#if defined(_WIN32)
+		if (data) {
+			UnmapViewOfFile(data);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+#else
+		if (data) {
+			munmap(const_cast<uint8_t*>(data), size);
+		}
+#endif
+	}
+
+	bool open(const std::filesystem::path& path)
+	{
+#if defined(_WIN32)
+		file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			return false;
+		}
+
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) {
+			return false;
+		}
+
+		data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		size = static_cast<size_t>(fileSize.QuadPart);
+		return data != nullptr;
+#else
+		int descriptor = ::open(path.c_str(), O_RDONLY);
+		if (descriptor < 0) {
+			return false;
+		}
+
+		struct stat status;
+		if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+			close(descriptor);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+		close(descriptor);
+		if (view == MAP_FAILED) {
+			return false;
+		}
+
+		data = static_cast<const uint8_t*>(view);
+		size = static_cast<size_t>(status.st_size);
+		return true;
+#endif
+	}
+
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
+
+// sequential reads of the mapped file, a read past its end fails the reader
+struct CacheReader {
+	const uint8_t* data;
+	size_t size;
+	size_t position;
+	bool failed = false;
+
+	size_t remaining() const
+	{
+		return position < size ? size - position : 0;
+	}
+
+	template<typename T>
+	T read()
+	{
+		T value{};
+		if (sizeof(T) > remaining()) {
+			failed = true;
+			return value;
+		}
+
+		memcpy(&value, data + position, sizeof(T));
+		position += sizeof(T);
+		return value;
+	}
+
+	std::string readString()
+	{
+		uint32_t length = read<uint32_t>();
+		if (length > remaining()) {
+			failed = true;
+			return {};
+		}
+
+		std::string value(reinterpret_cast<const char*>(data + position), length);
+		position += length;
+		return value;
+	}
+
+	std::vector<std::string> readStrings()
+	{
+		uint64_t count = read<uint64_t>();
+		if (count > remaining()) {
+			failed = true;
+			return {};
+		}
+
+		std::vector<std::string> values;
+		for (uint64_t i = 0; i < count && !failed; i++) {
+			values.push_back(readString());
+		}
+		return values;
+	}
+
+	template<typename T>
+	std::span<const T> readArray()
+	{
+		uint64_t count = read<uint64_t>();
+		position = (position + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+		if (failed || count > remaining() / sizeof(T)) {
+			failed = true;
+			return {};
+		}
+
+		std::span<const T> values(reinterpret_cast<const T*>(data + position), count);
+		position += count * sizeof(T);
+		return values;
+	}
+};
+
+// the rasterizer, the tracers and the BVH collapse index these arrays without checks
+bool validMesh(const CachedMesh& mesh, size_t materialCount)
+{
+	for (const CachedSurface& surface : mesh.surfaces) {
+		if (surface.material >= materialCount || surface.startIndex + uint64_t(surface.count) > mesh.indices.size()) {
+			return false;
+		}
+	}
+	for (uint32_t index : mesh.indices) {
+		if (index >= mesh.vertices.size()) {
+			return false;
+		}
+	}
+
+	if ((mesh.vertexFlags & VERTEX_COMPRESSED) && mesh.compressedVertices.size() != mesh.vertices.size()) {
+		return false;
+	}
+	if ((mesh.vertexFlags & VERTEX_COLORS) && mesh.colors.size() != mesh.vertices.size()) {
+		return false;
+	}
+
+	// BVH::build always leaves a root, an empty one has neither primitives nor children. Children come
+	// after their parent, so traversal cannot loop
+	if (mesh.bvhNodes.empty()) {
+		return false;
+	}
+	for (size_t i = 0; i < mesh.bvhNodes.size(); i++) {
+		const BVHNode& node = mesh.bvhNodes[i];
+		if (node.primitiveCount > 0) {
+			if (node.leftFirst + uint64_t(node.primitiveCount) > mesh.primitiveIndices.size()) {
+				return false;
+			}
+		}
+		else if (mesh.bvhNodes.size() > 1 && (node.leftFirst <= i || node.leftFirst + uint64_t(1) >= mesh.bvhNodes.size())) {
+			return false;
+		}
+	}
+
+	const size_t triangleCount = mesh.indices.size() / 3;
+	for (uint32_t primitive : mesh.primitiveIndices) {
+		if (primitive >= triangleCount) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// the levels are uploaded straight from the mapping, each one has to lie inside the image data and have
+// the size of its extent and format
+bool validImage(const CachedImage& image)
+{
+	if (image.extent.width == 0 || image.extent.height == 0) {
+		return false;
+	}
+
+	uint32_t maxLevelCount = std::bit_width(std::max(image.extent.width, image.extent.height));
+	if (image.levelOffsets.size() > maxLevelCount) {
+		return false;
+	}
+
+	for (uint32_t level = 0; level < image.levelOffsets.size(); level++) {
+		std::optional<VkDeviceSize> size = textureLevelSize(image.format, image.extent, level);
+		VkDeviceSize offset = image.levelOffsets[level];
+		if (!size || offset > image.data.size() || *size > image.data.size() - offset) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+}
+
+SceneCacheKey sceneCacheKey(Engine* engine, const std::filesystem::path& scenePath)
+{
+	std::error_code error;
+	SceneCacheKey key{
+		.sourceSize = std::filesystem::file_size(scenePath, error),
+		.sourceTime = std::filesystem::last_write_time(scenePath, error).time_since_epoch().count(),
+		.options = 0,
+	};
+
+	if (engine->options.compressVertices) {
+		key.options |= CACHED_COMPRESSED_VERTICES;
+	}
+	if (engine->options.compressTextures && engine->textureCompressionBC) {
+		key.options |= CACHED_COMPRESSED_TEXTURES;
+	}
+
+	return key;
+}
+
+std::filesystem::path sceneCachePath(const std::filesystem::path& scenePath)
+{
+	std::filesystem::path cachePath = scenePath;
+	cachePath += ".cache";
+	return cachePath;
+}
+
+template<typename T>
+void SceneCacheWriter::write(const T& value)
+{
+	stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void SceneCacheWriter::writeString(const std::string& value)
+{
+	write(static_cast<uint32_t>(value.size()));
+	stream.write(value.data(), value.size());
+}
+
+template<typename T>
+void SceneCacheWriter::writeArray(std::span<const T> values)
+{
+	static const char padding[ARRAY_ALIGNMENT] = {};
+
+	write(static_cast<uint64_t>(values.size()));
+	uint64_t position = static_cast<uint64_t>(stream.tellp());
+	stream.write(padding, (ARRAY_ALIGNMENT - position % ARRAY_ALIGNMENT) % ARRAY_ALIGNMENT);
+	stream.write(reinterpret_cast<const char*>(values.data()), values.size_bytes());
+}
+
+bool SceneCacheWriter::open(const std::filesystem::path& path, const SceneCacheKey& key)
+{
+	this->path = path;
+	temporaryPath = path;
+	temporaryPath += ".tmp";
+
+	stream.open(temporaryPath, std::ios::binary | std::ios::trunc);
+	if (!stream) {
+		return false;
+	}
+
+	SceneCacheHeader header{
+		.version = SCENE_CACHE_VERSION,
+		.options = key.options,
+		.sourceSize = key.sourceSize,
+		.sourceTime = key.sourceTime,
+		.imageTableOffset = 0,
+	};
+	memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+	write(header);
+
+	return stream.good();
+}
+
+void SceneCacheWriter::writeScene(const SceneCacheContents& contents)
+{
+	std::lock_guard lock(mutex);
+
+	std::unordered_map<VkSampler, int32_t> samplerIndices;
+	std::vector<CachedSampler> samplers;
+	for (size_t i = 0; i < contents.samplerInfos.size(); i++) {
+		const VkSamplerCreateInfo& info = contents.samplerInfos[i];
+		samplers.push_back(CachedSampler{
+			.magFilter = static_cast<uint32_t>(info.magFilter),
+			.minFilter = static_cast<uint32_t>(info.minFilter),
+			.mipmapMode = static_cast<uint32_t>(info.mipmapMode),
+			.maxLod = info.maxLod,
+		});
+		samplerIndices[contents.samplers[i]] = static_cast<int32_t>(i);
+	}
+	writeArray<CachedSampler>(samplers);
+
+	// textures without a sampler of the file use the engine's default one
+	auto samplerIndex = [&](VkSampler sampler) {
+		if (sampler == VK_NULL_HANDLE) {
+			return NO_SAMPLER;
+		}
+		auto it = samplerIndices.find(sampler);
+		return it != samplerIndices.end() ? it->second : DEFAULT_SAMPLER;
+	};
+
+	std::unordered_map<const GLTFMaterial*, uint32_t> materialIndices;
+	std::vector<CachedMaterial> materials;
+	for (uint32_t i = 0; i < contents.materials.size(); i++) {
+		const GLTFMaterial& material = *contents.materials[i];
+		materials.push_back(CachedMaterial{
+			.baseColor = material.baseColor,
+			.emission = material.emission,
+			.metallic = material.metallic,
+			.roughness = material.roughness,
+			.passType = static_cast<uint32_t>(material.data.passType),
+			.baseColorSampler = samplerIndex(material.baseColorSampler),
+			.metalRoughSampler = samplerIndex(material.metalRoughSampler),
+		});
+		materialIndices[&material] = i;
+	}
+
+	write(static_cast<uint64_t>(contents.materialNames.size()));
+	for (const std::string& name : contents.materialNames) {
+		writeString(name);
+	}
+	writeArray<CachedMaterial>(materials);
+
+	std::vector<CachedTextureReference> textureReferences;
+	for (const LoadedGLTF::TextureReference& reference : contents.textureReferences) {
+		textureReferences.push_back(CachedTextureReference{
+			.material = materialIndices[reference.material.get()],
+			.use = static_cast<uint32_t>(reference.use),
+			.image = reference.image,
+		});
+	}
+	writeArray<CachedTextureReference>(textureReferences);
+
+	std::unordered_map<const MeshAsset*, int32_t> meshIndices;
+	write(static_cast<uint64_t>(contents.meshes.size()));
+	for (int32_t i = 0; i < static_cast<int32_t>(contents.meshes.size()); i++) {
+		const MeshAsset& mesh = *contents.meshes[i];
+		meshIndices[&mesh] = i;
+
+		std::vector<CachedSurface> surfaces;
+		for (const GeoSurface& surface : mesh.surfaces) {
+			surfaces.push_back(CachedSurface{
+				.startIndex = surface.startIndex,
+				.count = surface.count,
+				.material = materialIndices[surface.material.get()],
+				.bounds = surface.bounds,
+			});
+		}
+
+		writeString(mesh.name);
+		write(mesh.vertexFlags);
+		writeArray<CachedSurface>(surfaces);
+		writeArray<uint32_t>(mesh.indices);
+		writeArray<Vertex>(mesh.vertices);
+		write(mesh.compressed.quantization);
+		writeArray<CompressedVertex>(mesh.compressed.vertices);
+		writeArray<uint32_t>(mesh.compressed.colors);
+		writeArray<BVHNode>(mesh.bvh.nodes);
+		writeArray<uint32_t>(mesh.bvh.primitiveIndices);
+	}
+
+	std::unordered_map<const Node*, uint32_t> nodeIndices;
+	for (uint32_t i = 0; i < contents.nodes.size(); i++) {
+		nodeIndices[contents.nodes[i].get()] = i;
+	}
+
+	write(static_cast<uint64_t>(contents.nodeNames.size()));
+	for (const std::string& name : contents.nodeNames) {
+		writeString(name);
+	}
+
+	write(static_cast<uint64_t>(contents.nodes.size()));
+	for (const std::shared_ptr<Node>& node : contents.nodes) {
+		int32_t mesh = -1;
+		if (const MeshNode* meshNode = dynamic_cast<const MeshNode*>(node.get())) {
+			mesh = meshIndices[meshNode->mesh.get()];
+		}
+
+		std::vector<uint32_t> children;
+		for (const std::shared_ptr<Node>& child : node->children) {
+			children.push_back(nodeIndices[child.get()]);
+		}
+
+		write(mesh);
+		write(node->localTransform);
+		writeArray<uint32_t>(children);
+	}
+
+	write(static_cast<uint64_t>(contents.imageNames.size()));
+	for (const std::string& name : contents.imageNames) {
+		writeString(name);
+	}
+	imageOffsets.assign(contents.imageNames.size(), 0);
+}
+
+void SceneCacheWriter::writeImage(size_t index, const TextureData* texture, glm::vec4 average)
+{
+	std::lock_guard lock(mutex);
+
+	imageOffsets[index] = static_cast<uint64_t>(stream.tellp());
+
+	write(static_cast<uint32_t>(texture ? texture->levelOffsets.size() : 0));
+	write(average);
+	if (!texture) {
+		return;
+	}
+
+	write(static_cast<uint32_t>(texture->format));
+	write(texture->extent);
+	write(texture->components);
+	writeArray<VkDeviceSize>(texture->levelOffsets);
+	writeArray<uint8_t>(texture->data);
+}
+
+bool SceneCacheWriter::finish()
+{
+	std::lock_guard lock(mutex);
+
+	uint64_t imageTableOffset = static_cast<uint64_t>(stream.tellp());
+	writeArray<uint64_t>(imageOffsets);
+
+	stream.seekp(offsetof(SceneCacheHeader, imageTableOffset));
+	write(imageTableOffset);
+
+	bool written = stream.good();
+	stream.close();
+
+	std::error_code error;
+	if (written && !stream.fail()) {
+		std::filesystem::rename(temporaryPath, path, error);
+		if (!error) {
+			return true;
+		}
+	}
+
+	std::filesystem::remove(temporaryPath, error);
+	return false;
+}
+
+bool loadSceneCache(Engine* engine, GLTFLoad& load, const SceneCacheKey& key)
+{
+	std::filesystem::path cachePath = sceneCachePath(load.path);
+
+	MappedFile file;
+	if (!file.open(cachePath)) {
+		return false;
+	}
+
+	SceneCacheHeader header;
+	if (file.size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, file.data, sizeof(header));
+
+	if (memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != SCENE_CACHE_VERSION
+		|| header.options != key.options || header.sourceSize != key.sourceSize || header.sourceTime != key.sourceTime
+		|| header.imageTableOffset == 0) {
+		std::cout << "Scene cache " << cachePath << " is stale" << std::endl;
+		return false;
+	}
+
+	// the whole file is read before the first resource is created, a broken one is left alone
+	CacheReader reader{ .data = file.data, .size = file.size, .position = sizeof(header) };
+
+	std::span<const CachedSampler> samplers = reader.readArray<CachedSampler>();
+	std::vector<std::string> materialNames = reader.readStrings();
+	std::span<const CachedMaterial> materials = reader.readArray<CachedMaterial>();
+	std::span<const CachedTextureReference> textureReferences = reader.readArray<CachedTextureReference>();
+
+	uint64_t meshCount = reader.read<uint64_t>();
+	std::vector<CachedMesh> meshes;
+	for (uint64_t i = 0; i < meshCount && !reader.failed; i++) {
+		CachedMesh mesh;
+		mesh.name = reader.readString();
+		mesh.vertexFlags = reader.read<uint32_t>();
+		mesh.surfaces = reader.readArray<CachedSurface>();
+		mesh.indices = reader.readArray<uint32_t>();
+		mesh.vertices = reader.readArray<Vertex>();
+		mesh.quantization = reader.read<PositionQuantization>();
+		mesh.compressedVertices = reader.readArray<CompressedVertex>();
+		mesh.colors = reader.readArray<uint32_t>();
+		mesh.bvhNodes = reader.readArray<BVHNode>();
+		mesh.primitiveIndices = reader.readArray<uint32_t>();
+		meshes.push_back(mesh);
+	}
+
+	std::vector<std::string> nodeNames = reader.readStrings();
+	uint64_t nodeCount = reader.read<uint64_t>();
+	std::vector<CachedNode> nodes;
+	for (uint64_t i = 0; i < nodeCount && !reader.failed; i++) {
+		CachedNode node;
+		node.mesh = reader.read<int32_t>();
+		node.localTransform = reader.read<glm::mat4>();
+		node.children = reader.readArray<uint32_t>();
+		nodes.push_back(node);
+	}
+
+	std::vector<std::string> imageNames = reader.readStrings();
+
+	CacheReader tableReader{ .data = file.data, .size = file.size, .position = header.imageTableOffset };
+	std::span<const uint64_t> imageOffsets = tableReader.readArray<uint64_t>();
+
+	bool valid = !reader.failed && !tableReader.failed && materialNames.size() == materials.size()
+		&& nodeNames.size() == nodes.size() && imageOffsets.size() == imageNames.size();
+
+	std::vector<CachedImage> images(imageOffsets.size());
+	for (size_t i = 0; i < imageOffsets.size() && valid; i++) {
+		if (imageOffsets[i] == 0) {
+			continue;
+		}
+
+		CachedImage& image = images[i];
+		CacheReader imageReader{ .data = file.data, .size = file.size, .position = imageOffsets[i] };
+		uint32_t levelCount = imageReader.read<uint32_t>();
+		image.average = imageReader.read<glm::vec4>();
+		if (levelCount == 0) {
+			valid = !imageReader.failed;
+			continue;
+		}
+
+		image.format = static_cast<VkFormat>(imageReader.read<uint32_t>());
+		image.extent = imageReader.read<VkExtent2D>();
+		image.components = imageReader.read<VkComponentMapping>();
+		image.levelOffsets = imageReader.readArray<VkDeviceSize>();
+		image.data = imageReader.readArray<uint8_t>();
+
+		valid = !imageReader.failed && image.levelOffsets.size() == levelCount && validImage(image);
+	}
+
+	auto validSampler = [&](int32_t sampler) {
+		return sampler == NO_SAMPLER || sampler == DEFAULT_SAMPLER || (sampler >= 0 && sampler < static_cast<int32_t>(samplers.size()));
+	};
+	for (const CachedMaterial& material : materials) {
+		valid = valid && validSampler(material.baseColorSampler) && validSampler(material.metalRoughSampler);
+	}
+	for (const CachedTextureReference& reference : textureReferences) {
+		valid = valid && reference.material < materials.size() && reference.image < imageNames.size()
+			&& reference.use <= static_cast<uint32_t>(LoadedGLTF::TextureUse::Emission);
+	}
+	for (const CachedMesh& mesh : meshes) {
+		valid = valid && validMesh(mesh, materials.size());
+	}
+	for (const CachedNode& node : nodes) {
+		valid = valid && node.mesh < static_cast<int32_t>(meshes.size());
+		for (uint32_t child : node.children) {
+			valid = valid && child < nodes.size();
+		}
+	}
+
+	if (!valid) {
+		std::cout << "Ignoring broken scene cache " << cachePath << std::endl;
+		return false;
+	}
+
+	std::cout << "Loading scene cache: " << cachePath << std::endl;
+
+	std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
+	scene->creator = engine;
+	LoadedGLTF& loaded = *scene.get();
+
+	for (const CachedSampler& sampler : samplers) {
+		VkSamplerCreateInfo samplerInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.magFilter = static_cast<VkFilter>(sampler.magFilter),
+			.minFilter = static_cast<VkFilter>(sampler.minFilter),
+			.mipmapMode = static_cast<VkSamplerMipmapMode>(sampler.mipmapMode),
+			.maxLod = sampler.maxLod,
+		};
+
+		VkSampler newSampler;
+		vkCreateSampler(engine->device, &samplerInfo, nullptr, &newSampler);
+		loaded.samplers.push_back(newSampler);
+	}
+
+	auto sampler = [&](int32_t index) {
+		if (index == NO_SAMPLER) {
+			return VkSampler(VK_NULL_HANDLE);
+		}
+		return index == DEFAULT_SAMPLER ? engine->defaultSamplerLinear : loaded.samplers[index];
+	};
+
+	std::vector<std::shared_ptr<GLTFMaterial>> newMaterials;
+	for (size_t i = 0; i < materials.size(); i++) {
+		const CachedMaterial& material = materials[i];
+
+		std::shared_ptr<GLTFMaterial> newMaterial = std::make_shared<GLTFMaterial>();
+		newMaterial->data = engine->metalRoughMaterial.createInstance(static_cast<MaterialPass>(material.passType));
+		newMaterial->baseColor = material.baseColor;
+		newMaterial->metallic = material.metallic;
+		newMaterial->roughness = material.roughness;
+		newMaterial->emission = material.emission;
+		newMaterial->baseColorSampler = sampler(material.baseColorSampler);
+		newMaterial->metalRoughSampler = sampler(material.metalRoughSampler);
+
+		newMaterials.push_back(newMaterial);
+		loaded.materials[materialNames[i]] = newMaterial;
+	}
+
+	for (const CachedTextureReference& reference : textureReferences) {
+		loaded.textureReferences.push_back(LoadedGLTF::TextureReference{
+			.material = newMaterials[reference.material],
+			.use = static_cast<LoadedGLTF::TextureUse>(reference.use),
+			.image = reference.image,
+		});
+	}
+
+	std::vector<std::shared_ptr<MeshAsset>> newMeshes;
+	for (const CachedMesh& mesh : meshes) {
+		std::shared_ptr<MeshAsset> newMesh = std::make_shared<MeshAsset>();
+		newMesh->name = mesh.name;
+		newMeshes.push_back(newMesh);
+		loaded.meshes[mesh.name] = newMesh;
+	}
+
+	// the geometry goes from the mapping into staging memory, the cpu copies are kept for the tracer scene
+	std::atomic<bool> geometryFits = true;
+	engine->jobs.parallelFor(static_cast<uint32_t>(meshes.size()), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			const CachedMesh& mesh = meshes[i];
+			MeshAsset& newMesh = *newMeshes[i];
+
+			for (const CachedSurface& surface : mesh.surfaces) {
+				newMesh.surfaces.push_back(GeoSurface{
+					.startIndex = surface.startIndex,
+					.count = surface.count,
+					.material = newMaterials[surface.material],
+					.bounds = surface.bounds,
+				});
+			}
+
+			newMesh.vertexFlags = mesh.vertexFlags;
+			newMesh.compressed.quantization = mesh.quantization;
+			newMesh.indices.assign(mesh.indices.begin(), mesh.indices.end());
+			newMesh.vertices.assign(mesh.vertices.begin(), mesh.vertices.end());
+			newMesh.bvh.nodes.assign(mesh.bvhNodes.begin(), mesh.bvhNodes.end());
+			newMesh.bvh.primitiveIndices.assign(mesh.primitiveIndices.begin(), mesh.primitiveIndices.end());
+
+			std::optional<GPUMeshBuffers> meshBuffers = (mesh.vertexFlags & VERTEX_COMPRESSED)
+				? engine->uploadMesh(mesh.indices, mesh.compressedVertices, mesh.colors)
+				: engine->uploadMesh(mesh.indices, mesh.vertices);
+			if (meshBuffers) {
+				newMesh.meshBuffers = *meshBuffers;
+			}
+			else {
+				geometryFits = false;
+			}
+		}
+	});
+
+	// the source file would not fit either, the load fails instead of falling back to it
+	if (!geometryFits) {
+		std::cout << "Failed to load scene cache: the geometry pool is full" << std::endl;
+		engine->uploads.wait(engine->uploads.flush());
+		load.finished = true;
+		return true;
+	}
+
+	std::vector<std::shared_ptr<Node>> newNodes;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		std::shared_ptr<Node> newNode;
+		if (nodes[i].mesh >= 0) {
+			newNode = std::make_shared<MeshNode>();
+			static_cast<MeshNode*>(newNode.get())->mesh = newMeshes[nodes[i].mesh];
+		}
+		else {
+			newNode = std::make_shared<Node>();
+		}
+
+		newNode->localTransform = nodes[i].localTransform;
+		newNodes.push_back(newNode);
+		loaded.nodes[nodeNames[i]] = newNode;
+	}
+
+	for (size_t i = 0; i < nodes.size(); i++) {
+		for (uint32_t child : nodes[i].children) {
+			newNodes[i]->children.push_back(newNodes[child]);
+			newNodes[child]->parent = newNodes[i];
+		}
+	}
+
+	for (auto& node : newNodes) {
+		if (node->parent.lock() == nullptr) {
+			loaded.topNodes.push_back(node);
+			node->refreshTransform(glm::mat4{ 1.f });
+		}
+	}
+
+	engine->uploads.flush();
+	load.scene = scene;
+	load.geometryReady = true;
+
+	std::cout << "Loaded cached geometry, uploading " << imageNames.size() << " images" << std::endl;
+
+	loaded.decodedImages.resize(imageNames.size());
+	engine->jobs.parallelFor(static_cast<uint32_t>(imageNames.size()), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			const CachedImage& image = images[i];
+			LoadedGLTF::DecodedImage& decoded = loaded.decodedImages[i];
+			decoded.name = imageNames[i];
+			decoded.image = engine->missingTextureImage;
+			decoded.average = image.average;
+			if (image.levelOffsets.empty()) {
+				continue;
+			}
+
+			if (!engine->formatSampleable(image.format)) {
+				std::cout << "failed to load cached texture " << decoded.name << std::endl;
+				continue;
+			}
+
+			TextureData texture{
+				.format = image.format,
+				.extent = image.extent,
+				.levelOffsets = std::vector<VkDeviceSize>(image.levelOffsets.begin(), image.levelOffsets.end()),
+				.components = image.components,
+			};
+			decoded.image = engine->createImage(texture, image.data, VK_IMAGE_USAGE_SAMPLED_BIT);
+		}
+	});
+
+	// the texels are staged, the mapping can go
+	engine->uploads.flush();
+	load.finished = true;
+
+	std::cout << "Finished loading scene cache" << std::endl;
+	return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "vk_loader.hpp"
+#include "texture_compression.hpp"
+
+#include <fstream>
+#include <mutex>
+
+// bumped whenever the layout of the file or of a record in it changes
+constexpr uint32_t SCENE_CACHE_VERSION = 3;
+
+// identifies the glTF file and the load options a cache was written for, a cache with another key is
+// stale. Only the glTF file itself is checked, edits of its external buffers and images are not noticed
+struct SceneCacheKey {
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t options;
+};
+
+SceneCacheKey sceneCacheKey(Engine* engine, const std::filesystem::path& scenePath);
+// next to the glTF file
+std::filesystem::path sceneCachePath(const std::filesystem::path& scenePath);
+
+// the results of the glTF loader in the order of the glTF arrays, everything but the image texels
+struct SceneCacheContents {
+	std::span<const VkSamplerCreateInfo> samplerInfos;
+	std::span<const VkSampler> samplers;
+	std::span<const std::shared_ptr<GLTFMaterial>> materials;
+	std::span<const std::string> materialNames;
+	std::span<const LoadedGLTF::TextureReference> textureReferences;
+	std::span<const std::shared_ptr<MeshAsset>> meshes;
+	std::span<const std::shared_ptr<Node>> nodes;
+	std::span<const std::string> nodeNames;
+	std::span<const std::string> imageNames;
+};
+
+// writes the cache of a glTF file while it loads. The scene goes in first, the images follow from the
+// decoding jobs in any order. The file replaces an older cache only once finish succeeds.
+struct SceneCacheWriter {
+	bool open(const std::filesystem::path& path, const SceneCacheKey& key);
+	// before the textures are applied, the emission of the materials still is their factor
+	void writeScene(const SceneCacheContents& contents);
+	// texture holds the texels that were uploaded for the image, null if it failed to load
+	void writeImage(size_t index, const TextureData* texture, glm::vec4 average);
+	bool finish();
+
+private:
+	std::filesystem::path path;
+	std::filesystem::path temporaryPath;
+	std::ofstream stream;
+	std::mutex mutex;
+	// file offset of every image record, 0 for images that were never written
+	std::vector<uint64_t> imageOffsets;
+
+	template<typename T>
+	void write(const T& value);
+	void writeString(const std::string& value);
+	// arrays start at a multiple of 16 bytes, so the reader can use them in place
+	template<typename T>
+	void writeArray(std::span<const T> values);
+};
+
+// loads a scene from its cache in the stages of loadGLTF. The file is mapped and its arrays are copied
+// straight into the staging memory of the upload queue, nothing is parsed or built. Returns false
+// without touching the engine if there is no cache, or it is stale or broken. A cache whose geometry does
+// not fit into the geometry pool finishes the load without a scene.
+bool loadSceneCache(Engine* engine, GLTFLoad& load, const SceneCacheKey& key);
@@ -0,0 +1,408 @@
+#include "texture_compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// weights of the 16 interpolated colors of a 4 bit BC7 index, in 64ths
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// writes fields from the least significant bit of the block upwards, the block must start zeroed
+struct BlockWriter {
+	uint8_t* output;
+	uint32_t position = 0;
+
+	void write(uint32_t value, uint32_t bitCount)
+	{
+		for (uint32_t bit = 0; bit < bitCount; bit++, position++) {
+			if ((value >> bit) & 1) {
+				output[position / 8] |= 1 << (position % 8);
+			}
+		}
+	}
+};
+
+VkFormat textureFormat(TextureEncoding encoding)
+{
+	switch (encoding) {
+	case TextureEncoding::BC1:
+		return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case TextureEncoding::BC5:
+		return VK_FORMAT_BC5_UNORM_BLOCK;
+	case TextureEncoding::BC7:
+		return VK_FORMAT_BC7_UNORM_BLOCK;
+	case TextureEncoding::RGBA8:
+	default:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+VkComponentMapping textureComponents(TextureEncoding encoding)
+{
+	if (encoding != TextureEncoding::BC5) {
+		return {};
+	}
+
+	return VkComponentMapping{
+		.r = VK_COMPONENT_SWIZZLE_ZERO,
+		.g = VK_COMPONENT_SWIZZLE_R,
+		.b = VK_COMPONENT_SWIZZLE_G,
+		.a = VK_COMPONENT_SWIZZLE_ONE,
+	};
+}
+
+std::optional<VkDeviceSize> textureLevelSize(VkFormat format, VkExtent2D extent, uint32_t level)
+{
+	VkDeviceSize width = std::max(extent.width >> level, 1u);
+	VkDeviceSize height = std::max(extent.height >> level, 1u);
+	VkDeviceSize blocks = ((width + 3) / 4) * ((height + 3) / 4);
+
+	switch (format) {
+	case VK_FORMAT_R8_UNORM:
+		return width * height;
+	case VK_FORMAT_R8G8_UNORM:
+		return width * height * 2;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		return width * height * 4;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return width * height * 8;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return width * height * 16;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+		return blocks * 8;
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return blocks * 16;
+	default:
+		return {};
+	}
+}
+
+// the 4x4 texels of a block, blocks over the image edge repeat its last row and column
+static void readBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, glm::vec4 texels[16])
+{
+	for (uint32_t y = 0; y < 4; y++) {
+		for (uint32_t x = 0; x < 4; x++) {
+			uint32_t pixelX = std::min(blockX * 4 + x, width - 1);
+			uint32_t pixelY = std::min(blockY * 4 + y, height - 1);
+			const uint8_t* texel = rgba + 4 * (static_cast<size_t>(pixelY) * width + pixelX);
+			texels[y * 4 + x] = glm::vec4(texel[0], texel[1], texel[2], texel[3]);
+		}
+	}
+}
+
+// the line through the block's texels along their largest spread, by power iteration on the covariance.
+// Its ends at the outermost texels become the block's endpoints
+static void fitEndpoints(const glm::vec4 texels[16], glm::vec4& low, glm::vec4& high)
+{
+	glm::vec4 mean{ 0.f };
+	for (int i = 0; i < 16; i++) {
+		mean += texels[i];
+	}
+	mean /= 16.f;
+
+	glm::mat4 covariance{ 0.f };
+	for (int i = 0; i < 16; i++) {
+		glm::vec4 offset = texels[i] - mean;
+		covariance += glm::outerProduct(offset, offset);
+	}
+
+	// the longest column is never orthogonal to the principal axis
+	glm::vec4 axis = covariance[0];
+	for (int i = 1; i < 4; i++) {
+		if (glm::dot(covariance[i], covariance[i]) > glm::dot(axis, axis)) {
+			axis = covariance[i];
+		}
+	}
+
+	low = high = mean;
+	if (glm::dot(axis, axis) < 1e-6f) {
+		return;
+	}
+
+	for (int i = 0; i < 8; i++) {
+		axis = glm::normalize(covariance * axis);
+	}
+
+	float minT = 0.f;
+	float maxT = 0.f;
+	for (int i = 0; i < 16; i++) {
+		float t = glm::dot(texels[i] - mean, axis);
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	low = glm::clamp(mean + minT * axis, 0.f, 255.f);
+	high = glm::clamp(mean + maxT * axis, 0.f, 255.f);
+}
+
+static uint16_t packRGB565(glm::vec4 color)
+{
+	uint32_t r = static_cast<uint32_t>(std::lround(color.r * 31.f / 255.f));
+	uint32_t g = static_cast<uint32_t>(std::lround(color.g * 63.f / 255.f));
+	uint32_t b = static_cast<uint32_t>(std::lround(color.b * 31.f / 255.f));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static glm::vec4 unpackRGB565(uint16_t color)
+{
+	uint32_t r = color >> 11;
+	uint32_t g = (color >> 5) & 63;
+	uint32_t b = color & 31;
+	return glm::vec4((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 0.f);
+}
+
+// four color mode, two 565 endpoints and 2 bit indices
+static void encodeBC1Block(glm::vec4 texels[16], uint8_t* output)
+{
+	for (int i = 0; i < 16; i++) {
+		texels[i].a = 0.f;
+	}
+
+	glm::vec4 low, high;
+	fitEndpoints(texels, low, high);
+
+	uint16_t color0 = packRGB565(high);
+	uint16_t color1 = packRGB565(low);
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	glm::vec4 palette[4];
+	palette[0] = unpackRGB565(color0);
+	palette[1] = unpackRGB565(color1);
+	palette[2] = (2.f * palette[0] + palette[1]) / 3.f;
+	palette[3] = (palette[0] + 2.f * palette[1]) / 3.f;
+
+	// equal endpoints switch the block to the three color mode, index 0 still is the endpoint there
+	uint32_t indices = 0;
+	if (color0 != color1) {
+		for (uint32_t i = 0; i < 16; i++) {
+			uint32_t best = 0;
+			float bestError = std::numeric_limits<float>::max();
+			for (uint32_t j = 0; j < 4; j++) {
+				glm::vec4 difference = texels[i] - palette[j];
+				float error = glm::dot(difference, difference);
+				if (error < bestError) {
+					bestError = error;
+					best = j;
+				}
+			}
+			indices |= best << (2 * i);
+		}
+	}
+
+	output[0] = color0 & 0xff;
+	output[1] = color0 >> 8;
+	output[2] = color1 & 0xff;
+	output[3] = color1 >> 8;
+	for (int i = 0; i < 4; i++) {
+		output[4 + i] = (indices >> (8 * i)) & 0xff;
+	}
+}
+
+// eight value mode, the endpoints and six values evenly spaced between them with 3 bit indices
+static void encodeBC4Block(const uint8_t values[16], uint8_t* output)
+{
+	uint8_t high = *std::max_element(values, values + 16);
+	uint8_t low = *std::min_element(values, values + 16);
+
+	uint64_t indices = 0;
+	if (high > low) {
+		for (int i = 0; i < 16; i++) {
+			// sevenths of the range from high down to low, index 0 is high, 1 is low and 2 to 7 lie between
+			uint64_t step = static_cast<uint64_t>(std::lround(float(high - values[i]) * 7.f / float(high - low)));
+			uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+			indices |= index << (3 * i);
+		}
+	}
+
+	output[0] = high;
+	output[1] = low;
+	for (int i = 0; i < 6; i++) {
+		output[2 + i] = (indices >> (8 * i)) & 0xff;
+	}
+}
+
+// roughness from green into the first channel, metallic from blue into the second
+static void encodeBC5Block(const glm::vec4 texels[16], uint8_t* output)
+{
+	uint8_t roughness[16];
+	uint8_t metallic[16];
+	for (int i = 0; i < 16; i++) {
+		roughness[i] = static_cast<uint8_t>(texels[i].g);
+		metallic[i] = static_cast<uint8_t>(texels[i].b);
+	}
+
+	encodeBC4Block(roughness, output);
+	encodeBC4Block(metallic, output + 8);
+}
+
+// the 7 bit endpoint and the shared low bit that come closest to color
+static void quantizeBC7Endpoint(glm::vec4 color, glm::ivec4& quantized, uint32_t& lowBit)
+{
+	float bestError = std::numeric_limits<float>::max();
+	for (uint32_t bit = 0; bit < 2; bit++) {
+		glm::ivec4 candidate = glm::clamp(glm::ivec4(glm::round((color - float(bit)) / 2.f)), 0, 127);
+		glm::vec4 difference = glm::vec4(candidate * 2 + int(bit)) - color;
+		float error = glm::dot(difference, difference);
+		if (error < bestError) {
+			bestError = error;
+			quantized = candidate;
+			lowBit = bit;
+		}
+	}
+}
+
+// mode 6, one subset with 7 bit rgba endpoints, a low bit per endpoint and 4 bit indices
+static void encodeBC7Block(const glm::vec4 texels[16], uint8_t* output)
+{
+	glm::vec4 low, high;
+	fitEndpoints(texels, low, high);
+
+	glm::ivec4 endpoints[2];
+	uint32_t lowBits[2];
+	quantizeBC7Endpoint(low, endpoints[0], lowBits[0]);
+	quantizeBC7Endpoint(high, endpoints[1], lowBits[1]);
+
+	glm::ivec4 color0 = endpoints[0] * 2 + int(lowBits[0]);
+	glm::ivec4 color1 = endpoints[1] * 2 + int(lowBits[1]);
+	glm::vec4 palette[16];
+	for (int i = 0; i < 16; i++) {
+		palette[i] = glm::vec4(((64 - BC7_WEIGHTS[i]) * color0 + BC7_WEIGHTS[i] * color1 + 32) / 64);
+	}
+
+	uint32_t indices[16];
+	for (int i = 0; i < 16; i++) {
+		float bestError = std::numeric_limits<float>::max();
+		for (uint32_t j = 0; j < 16; j++) {
+			glm::vec4 difference = texels[i] - palette[j];
+			float error = glm::dot(difference, difference);
+			if (error < bestError) {
+				bestError = error;
+				indices[i] = j;
+			}
+		}
+	}
+
+	// the first index is stored without its top bit, swapping the endpoints clears it
+	if (indices[0] >= 8) {
+		std::swap(endpoints[0], endpoints[1]);
+		std::swap(lowBits[0], lowBits[1]);
+		for (int i = 0; i < 16; i++) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	std::fill(output, output + 16, 0);
+	BlockWriter block{ output };
+	block.write(1 << 6, 7);
+	for (int channel = 0; channel < 4; channel++) {
+		block.write(endpoints[0][channel], 7);
+		block.write(endpoints[1][channel], 7);
+	}
+	block.write(lowBits[0], 1);
+	block.write(lowBits[1], 1);
+	block.write(indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		block.write(indices[i], 4);
+	}
+}
+
+// 2x2 box filter, odd sizes repeat the last row and column
+static std::vector<uint8_t> downsample(const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height)
+{
+	uint32_t halfWidth = std::max(width / 2, 1u);
+	uint32_t halfHeight = std::max(height / 2, 1u);
+	std::vector<uint8_t> result(static_cast<size_t>(halfWidth) * halfHeight * 4);
+
+	for (uint32_t y = 0; y < halfHeight; y++) {
+		for (uint32_t x = 0; x < halfWidth; x++) {
+			uint32_t x0 = std::min(2 * x, width - 1);
+			uint32_t x1 = std::min(2 * x + 1, width - 1);
+			uint32_t y0 = std::min(2 * y, height - 1);
+			uint32_t y1 = std::min(2 * y + 1, height - 1);
+
+			for (uint32_t channel = 0; channel < 4; channel++) {
+				uint32_t sum = rgba[4 * (static_cast<size_t>(y0) * width + x0) + channel]
+					+ rgba[4 * (static_cast<size_t>(y0) * width + x1) + channel]
+					+ rgba[4 * (static_cast<size_t>(y1) * width + x0) + channel]
+					+ rgba[4 * (static_cast<size_t>(y1) * width + x1) + channel];
+				result[4 * (static_cast<size_t>(y) * halfWidth + x) + channel] = static_cast<uint8_t>((sum + 2) / 4);
+			}
+		}
+	}
+
+	return result;
+}
+
+TextureData encodeTexture(const uint8_t* rgba, uint32_t width, uint32_t height, TextureEncoding encoding)
+{
+	if (encoding == TextureEncoding::RGBA8) {
+		throw std::runtime_error("rgba8 textures are not block compressed");
+	}
+
+	TextureData texture{
+		.format = textureFormat(encoding),
+		.extent = { width, height },
+		.components = textureComponents(encoding),
+	};
+
+	size_t blockBytes = encoding == TextureEncoding::BC1 ? 8 : 16;
+	std::vector<uint8_t> level(rgba, rgba + static_cast<size_t>(width) * height * 4);
+
+	while (true) {
+		uint32_t blocksX = (width + 3) / 4;
+		uint32_t blocksY = (height + 3) / 4;
+		size_t levelOffset = texture.data.size();
+		texture.levelOffsets.push_back(levelOffset);
+		texture.data.resize(levelOffset + blocksX * blocksY * blockBytes);
+
+		for (uint32_t blockY = 0; blockY < blocksY; blockY++) {
+			for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+				glm::vec4 texels[16];
+				readBlock(level.data(), width, height, blockX, blockY, texels);
+
+				uint8_t* output = texture.data.data() + levelOffset + (static_cast<size_t>(blockY) * blocksX + blockX) * blockBytes;
+				switch (encoding) {
+				case TextureEncoding::BC1:
+					encodeBC1Block(texels, output);
+					break;
+				case TextureEncoding::BC5:
+					encodeBC5Block(texels, output);
+					break;
+				default:
+					encodeBC7Block(texels, output);
+					break;
+				}
+			}
+		}
+
+		if (width == 1 && height == 1) {
+			break;
+		}
+
+		level = downsample(level, width, height);
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+
+	return texture;
+}
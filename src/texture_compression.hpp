@@ -0,0 +1,39 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+#include <optional>
+
+// how a loaded texture is stored on the GPU
+enum class TextureEncoding {
+	// uncompressed, the mip chain is blitted on the GPU
+	RGBA8,
+	// opaque color, 8 bytes per 4x4 block
+	BC1,
+	// roughness and metallic of a glTF metallic roughness texture, 16 bytes per block
+	BC5,
+	// color with alpha, 16 bytes per block
+	BC7,
+};
+
+// a texture with every mip level prepared on the CPU
+struct TextureData {
+	VkFormat format;
+	VkExtent2D extent;
+	// all levels back to back, levelOffsets[0] is the largest one
+	std::vector<uint8_t> data;
+	std::vector<VkDeviceSize> levelOffsets;
+	VkComponentMapping components{};
+	// mean of the source texels, unknown for textures that were never decoded to rgba8
+	std::optional<glm::vec4> average;
+};
+
+VkFormat textureFormat(TextureEncoding encoding);
+// tightly packed bytes of a mip level, nothing for formats whose size is not known here
+std::optional<VkDeviceSize> textureLevelSize(VkFormat format, VkExtent2D extent, uint32_t level);
+// BC5 keeps green and blue of the source in red and green, the image view moves them back
+VkComponentMapping textureComponents(TextureEncoding encoding);
+
+// block compresses the rgba8 texels and the box filtered mip chain below them, encoding is one of the
+// BC formats
+TextureData encodeTexture(const uint8_t* rgba, uint32_t width, uint32_t height, TextureEncoding encoding);
@@ -0,0 +1,112 @@
+#include "tile_scheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+bool TileScheduler::resize(VkExtent2D newExtent)
+{
+	if (newExtent.width == extent.width && newExtent.height == extent.height) {
+		return false;
+	}
+	extent = newExtent;
+
+	int tilesX = static_cast<int>((extent.width + TRACER_TILE_SIZE - 1) / TRACER_TILE_SIZE);
+	int tilesY = static_cast<int>((extent.height + TRACER_TILE_SIZE - 1) / TRACER_TILE_SIZE);
+
+	struct SpiralTile {
+		glm::uvec2 origin;
+		// square ring around the center tile and the angle inside the ring
+		int ring;
+		float angle;
+	};
+
+	std::vector<SpiralTile> tiles;
+	tiles.reserve(tilesX * tilesY);
+
+	glm::vec2 center = glm::vec2(tilesX - 1, tilesY - 1) * 0.5f;
+	for (int y = 0; y < tilesY; y++) {
+		for (int x = 0; x < tilesX; x++) {
+			glm::vec2 offset = glm::vec2(x, y) - center;
+			tiles.push_back(SpiralTile{
+				.origin = glm::uvec2(x, y) * TRACER_TILE_SIZE,
+				.ring = static_cast<int>(std::round(std::max(std::abs(offset.x), std::abs(offset.y)))),
+				.angle = std::atan2(offset.y, offset.x),
+			});
+		}
+	}
+
+	std::sort(tiles.begin(), tiles.end(), [](const SpiralTile& a, const SpiralTile& b) {
+		return a.ring != b.ring ? a.ring < b.ring : a.angle < b.angle;
+	});
+
+	order.clear();
+	for (const SpiralTile& tile : tiles) {
+		order.push_back(tile.origin);
+	}
+
+	tileBudget = std::clamp(tileBudget, 1u, tileCount());
+	restart();
+	return true;
+}
+
+void TileScheduler::restart()
+{
+	cursor = 0;
+	completedPasses = 0;
+	generation++;
+
+	tileConverged.assign(order.size(), false);
+	convergedTiles = 0;
+}
+
+std::span<const glm::uvec2> TileScheduler::nextTiles()
+{
+	frameTiles.clear();
+	frameIndices.clear();
+
+	uint32_t activeTiles = adaptive ? tileCount() - convergedTiles : tileCount();
+	uint32_t count = std::min(tileBudget, activeTiles);
+
+	// never more than the active tiles, so wrapping around cannot repeat a tile
+	while (frameTiles.size() < count && !finished()) {
+		if (!adaptive || !tileConverged[cursor]) {
+			frameTiles.push_back(order[cursor]);
+			frameIndices.push_back(cursor);
+		}
+
+		if (++cursor == order.size()) {
+			cursor = 0;
+			completedPasses++;
+		}
+	}
+
+	return frameTiles;
+}
+
+void TileScheduler::updateBudget(float gpuMilliseconds, uint32_t tileCount)
+{
+	if (tileCount == 0 || gpuMilliseconds <= 0.f) {
+		return;
+	}
+
+	// smoothed, so a single slow frame does not make the budget jump around
+	float measured = gpuMilliseconds / tileCount;
+	tileMilliseconds = tileMilliseconds == 0.f ? measured : glm::mix(tileMilliseconds, measured, 0.2f);
+
+	uint32_t affordable = static_cast<uint32_t>(targetMilliseconds / tileMilliseconds);
+	tileBudget = std::clamp(affordable, 1u, std::max(1u, this->tileCount()));
+}
+
+void TileScheduler::updateErrors(uint32_t tileGeneration, std::span<const uint32_t> tiles, std::span<const float> errors)
+{
+	if (tileGeneration != generation) {
+		return;
+	}
+
+	for (size_t i = 0; i < tiles.size(); i++) {
+		if (!tileConverged[tiles[i]] && errors[i] < errorThreshold) {
+			tileConverged[tiles[i]] = true;
+			convergedTiles++;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+// edge length of a path tracer tile in pixels, a multiple of the 16x16 workgroups of the tiled stages
+constexpr uint32_t TRACER_TILE_SIZE = 64;
+
+// splits the draw extent into tiles and hands out as many per frame as fit into a GPU time budget.
+// Tiles are visited in a spiral from the center, so the middle of the image converges first.
+// With adaptive sampling, tiles whose estimated error fell below the threshold are skipped.
+struct TileScheduler {
+	// GPU time the path tracer may use per frame
+	float targetMilliseconds = 12.f;
+	// smoothed GPU cost of a single tile, 0 until the first measurement
+	float tileMilliseconds = 0.f;
+	uint32_t tileBudget = 1;
+	// number of times the tile order has been walked since the last restart
+	uint32_t completedPasses = 0;
+	// no tiles are handed out once this many passes completed, 0 keeps tracing forever
+	uint32_t maxPasses = 0;
+
+	bool adaptive = true;
+	// relative standard error of the pixel means, averaged over a tile
+	float errorThreshold = 0.02f;
+	// pixels report no error estimate before this many samples
+	uint32_t minSamples = 16;
+	// bumped by every restart, error estimates of older generations are ignored
+	uint32_t generation = 0;
+
+	// returns true if the tiling changed, which also restarts it
+	bool resize(VkExtent2D extent);
+	void restart();
+
+	// origins of the tiles to trace this frame, no tile is returned twice within a frame
+	std::span<const glm::uvec2> nextTiles();
+	// indices of the tiles returned by the last nextTiles call
+	std::span<const uint32_t> frameTileIndices() const { return frameIndices; }
+	// feeds back the measured GPU time of a frame that traced tileCount tiles
+	void updateBudget(float gpuMilliseconds, uint32_t tileCount);
+	// feeds back the error estimates of tiles traced during the given generation
+	void updateErrors(uint32_t tileGeneration, std::span<const uint32_t> tiles, std::span<const float> errors);
+
+	uint32_t tileCount() const { return static_cast<uint32_t>(order.size()); }
+	uint32_t convergedCount() const { return convergedTiles; }
+	bool converged() const { return adaptive && convergedTiles == tileCount(); }
+	bool finished() const { return converged() || (maxPasses != 0 && completedPasses >= maxPasses); }
+
+private:
+	VkExtent2D extent{ 0, 0 };
+	std::vector<glm::uvec2> order;
+	std::vector<bool> tileConverged;
+	uint32_t convergedTiles = 0;
+	std::vector<glm::uvec2> frameTiles;
+	std::vector<uint32_t> frameIndices;
+	uint32_t cursor = 0;
+};
@@ -0,0 +1,26 @@
+#include "tracer_queues.hpp"
+
+#include "engine.hpp"
+
+void TracerQueues::create(Engine* engine, uint32_t pixelCount)
+{
+	capacity = pixelCount;
+
+	// the queues never leave the GPU
+	counterBuffer = engine->createBuffer(sizeof(TracerQueueCounters),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	pathBuffer = engine->createBuffer(2 * capacity * sizeof(TracerPath), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	hitBuffer = engine->createBuffer(capacity * sizeof(TracerHit), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	shadowRayBuffer = engine->createBuffer(capacity * sizeof(TracerShadowRay), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	radianceBuffer = engine->createBuffer(capacity * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+}
+
+void TracerQueues::destroy(Engine* engine)
+{
+	engine->destroyBuffer(counterBuffer);
+	engine->destroyBuffer(pathBuffer);
+	engine->destroyBuffer(hitBuffer);
+	engine->destroyBuffer(shadowRayBuffer);
+	engine->destroyBuffer(radianceBuffer);
+	capacity = 0;
+}
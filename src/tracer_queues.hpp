@@ -0,0 +1,69 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+struct Engine;
+
+// same layouts as the queue entries in shaders/pt_common.glsl (std430)
+struct TracerPath {
+	glm::vec3 origin;
+	// index of the pixel the path contributes to
+	uint32_t pixel;
+	glm::vec3 direction;
+	uint32_t depth;
+	glm::vec3 throughput;
+	// pixel sample the path belongs to, seeds the low discrepancy sampler
+	uint32_t sampleIndex;
+	float bsdfPdf;
+	uint32_t padding[3];
+};
+
+struct TracerHit {
+	float t;
+	uint32_t instance;
+	uint32_t primitive;
+	uint32_t padding;
+	glm::vec2 barycentrics;
+};
+
+struct TracerShadowRay {
+	glm::vec3 origin;
+	uint32_t pixel;
+	glm::vec3 direction;
+	float tMax;
+	// radiance added to the pixel if nothing blocks the ray
+	glm::vec3 contribution;
+	uint32_t padding;
+};
+
+struct TracerQueueCounters {
+	// a bounce consumes one ray queue and appends the continued paths to the other
+	uint32_t rayCount[2];
+	uint32_t shadowRayCount;
+	uint32_t padding;
+	// written on the GPU from the counts above, read by vkCmdDispatchIndirect
+	VkDispatchIndirectCommand extendDispatch;
+	VkDispatchIndirectCommand shadowDispatch;
+};
+
+// what the dispatch kernel prepares, see pt_dispatch.comp
+enum TracerDispatchPass {
+	PrepareExtend,
+	PrepareConnect,
+};
+
+// storage shared by the wavefront stages, every queue has room for one entry per pixel of the draw image
+struct TracerQueues {
+	uint32_t capacity = 0;
+
+	AllocatedBuffer counterBuffer;
+	// two ray queues back to back
+	AllocatedBuffer pathBuffer;
+	AllocatedBuffer hitBuffer;
+	AllocatedBuffer shadowRayBuffer;
+	// radiance of the current sample per pixel
+	AllocatedBuffer radianceBuffer;
+
+	void create(Engine* engine, uint32_t pixelCount);
+	void destroy(Engine* engine);
+};
@@ -0,0 +1,187 @@
+#include "tracer_scene.hpp"
+
+#include "engine.hpp"
+
+void TracerScene::build(const std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>>& scenes, const MaterialTable& materials, JobSystem& jobs)
+{
+	vertices.clear();
+	indices.clear();
+	instances.clear();
+	nodes.clear();
+	primitives.clear();
+	bottomLevels.clear();
+	instanceBounds.clear();
+	triangleCount = 0;
+	triangleMaterials.clear();
+	materialTable = &materials;
+	lights.clear();
+	wideBottomLevels.clear();
+	instanceWideBottomLevels.clear();
+	// collects the bottom level data, the top level is prepended once all instances are known
+	for (auto& [_, scene] : scenes) {
+		for (auto& node : scene->topNodes) {
+			addNode(*node);
+		}
+	}
+
+	// the wide BVHs of the CPU tracer are independent of each other
+	std::vector<const MeshAsset*> wideMeshes(wideBottomLevels.size());
+	for (auto& [mesh, bottomLevel] : bottomLevels) {
+		wideMeshes[bottomLevel.wideIndex] = mesh;
+	}
+	jobs.parallelFor(static_cast<uint32_t>(wideMeshes.size()), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			wideBottomLevels[i].build(wideMeshes[i]->bvh, wideMeshes[i]->vertices, wideMeshes[i]->indices);
+		}
+	});
+
+	BVH topLevel;
+	topLevel.build(instanceBounds);
+
+	topLevelNodeCount = static_cast<uint32_t>(topLevel.nodes.size());
+	uint32_t topLevelPrimitiveCount = static_cast<uint32_t>(topLevel.primitiveIndices.size());
+
+	nodes.insert(nodes.begin(), topLevel.nodes.begin(), topLevel.nodes.end());
+	primitives.insert(primitives.begin(), topLevel.primitiveIndices.begin(), topLevel.primitiveIndices.end());
+
+	for (TracerInstance& instance : instances) {
+		instance.nodeOffset += topLevelNodeCount;
+		instance.primitiveOffset += topLevelPrimitiveCount;
+	}
+}
+
+const TracerScene::BottomLevel& TracerScene::addMesh(const MeshAsset& mesh)
+{
+	auto it = bottomLevels.find(&mesh);
+	if (it != bottomLevels.end()) {
+		return it->second;
+	}
+
+	// offsets are relative to the bottom level data until the top level is built
+	BottomLevel bottomLevel{
+		.nodeOffset = static_cast<uint32_t>(nodes.size()),
+		.primitiveOffset = static_cast<uint32_t>(primitives.size()),
+		.indexOffset = static_cast<uint32_t>(indices.size()),
+		.vertexOffset = static_cast<uint32_t>(vertices.size()),
+		.wideIndex = static_cast<uint32_t>(wideBottomLevels.size()),
+	};
+
+	vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+	indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+	nodes.insert(nodes.end(), mesh.bvh.nodes.begin(), mesh.bvh.nodes.end());
+	primitives.insert(primitives.end(), mesh.bvh.primitiveIndices.begin(), mesh.bvh.primitiveIndices.end());
+	triangleCount += static_cast<uint32_t>(mesh.indices.size() / 3);
+	// built once all meshes are known
+	wideBottomLevels.emplace_back();
+
+	// the surfaces cover the index buffer of the mesh in order
+	for (const GeoSurface& surface : mesh.surfaces) {
+		triangleMaterials.insert(triangleMaterials.end(), surface.count / 3, surface.material->tableIndex);
+	}
+
+	return bottomLevels[&mesh] = bottomLevel;
+}
+
+void TracerScene::addLights(const MeshAsset& mesh, const BottomLevel& bottomLevel, const glm::mat4& transform)
+{
+	uint32_t firstTriangle = bottomLevel.indexOffset / 3;
+	uint32_t meshTriangles = static_cast<uint32_t>(mesh.indices.size() / 3);
+
+	for (uint32_t triangle = 0; triangle < meshTriangles; triangle++) {
+		glm::vec3 emission = unpackEmission(materialTable->materials[triangleMaterials[firstTriangle + triangle]]);
+		float luminance = glm::dot(emission, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+		if (luminance <= 0.f) {
+			continue;
+		}
+
+		glm::vec3 v0 = glm::vec3(transform * glm::vec4(mesh.vertices[mesh.indices[3 * triangle + 0]].position, 1.f));
+		glm::vec3 v1 = glm::vec3(transform * glm::vec4(mesh.vertices[mesh.indices[3 * triangle + 1]].position, 1.f));
+		glm::vec3 v2 = glm::vec3(transform * glm::vec4(mesh.vertices[mesh.indices[3 * triangle + 2]].position, 1.f));
+
+		float area = 0.5f * glm::length(glm::cross(v1 - v0, v2 - v0));
+		if (area <= 0.f) {
+			continue;
+		}
+
+		float previousPower = lights.empty() ? 0.f : lights.back().cumulativePower;
+		lights.push_back(TracerLight{
+			.v0 = v0,
+			.cumulativePower = previousPower + area * luminance,
+			.v1 = v1,
+			.v2 = v2,
+			.emission = emission,
+		});
+	}
+}
+
+void TracerScene::addNode(const Node& node)
+{
+	if (const MeshNode* meshNode = dynamic_cast<const MeshNode*>(&node)) {
+		const MeshAsset& mesh = *meshNode->mesh;
+		const BottomLevel& bottomLevel = addMesh(mesh);
+
+		const glm::mat4& transform = node.globalTransform;
+		instances.push_back(TracerInstance{
+			.objectToWorld = transform,
+			.worldToObject = glm::inverse(transform),
+			.nodeOffset = bottomLevel.nodeOffset,
+			.primitiveOffset = bottomLevel.primitiveOffset,
+			.indexOffset = bottomLevel.indexOffset,
+			.vertexOffset = bottomLevel.vertexOffset,
+			.positionOrigin = mesh.compressed.quantization.origin,
+			.vertexFlags = mesh.vertexFlags,
+			.positionExtent = mesh.compressed.quantization.extent,
+			.colorOffset = static_cast<uint32_t>(mesh.meshBuffers.colors.offset / sizeof(uint32_t)),
+			.vertexDataOffset = static_cast<uint32_t>(mesh.meshBuffers.vertices.offset / sizeof(uint32_t)),
+			.poolIndexOffset = mesh.meshBuffers.firstIndex,
+		});
+		instanceWideBottomLevels.push_back(bottomLevel.wideIndex);
+
+		// world space bounds of the transformed bottom level root box
+		const BVHNode& root = mesh.bvh.nodes[0];
+		AABB bounds;
+		if (root.aabbMin.x <= root.aabbMax.x) {
+			for (int corner = 0; corner < 8; corner++) {
+				glm::vec3 point{
+					corner & 1 ? root.aabbMax.x : root.aabbMin.x,
+					corner & 2 ? root.aabbMax.y : root.aabbMin.y,
+					corner & 4 ? root.aabbMax.z : root.aabbMin.z,
+				};
+				bounds.grow(glm::vec3(transform * glm::vec4(point, 1.f)));
+			}
+		}
+		instanceBounds.push_back(bounds);
+
+		addLights(mesh, bottomLevel, transform);
+	}
+
+	for (auto& child : node.children) {
+		addNode(*child);
+	}
+}
+
+void TracerScene::upload(Engine* engine)
+{
+	nodeBuffer = engine->uploadBuffer(nodes.data(), nodes.size() * sizeof(BVHNode), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	primitiveBuffer = engine->uploadBuffer(primitives.data(), primitives.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	instanceBuffer = engine->uploadBuffer(instances.data(), instances.size() * sizeof(TracerInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	triangleMaterialBuffer = engine->uploadBuffer(triangleMaterials.data(), triangleMaterials.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	lightBuffer = engine->uploadBuffer(lights.data(), lights.size() * sizeof(TracerLight), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	uploaded = true;
+}
+
+void TracerScene::clear(Engine* engine)
+{
+	if (!uploaded) {
+		return;
+	}
+
+	engine->destroyBuffer(nodeBuffer);
+	engine->destroyBuffer(primitiveBuffer);
+	engine->destroyBuffer(instanceBuffer);
+	engine->destroyBuffer(triangleMaterialBuffer);
+	engine->destroyBuffer(lightBuffer);
+
+	uploaded = false;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "vk_types.hpp"
+#include "vk_loader.hpp"
+#include "bvh.hpp"
+#include "bvh8.hpp"
+#include "job_system.hpp"
+#include "material_table.hpp"
+
+struct Engine;
+
+// same layout as TracerInstance in the tracer shaders (std430)
+struct TracerInstance {
+	glm::mat4 objectToWorld;
+	glm::mat4 worldToObject;
+	// root of the bottom level BVH in the node buffer, its child indices are relative to it
+	uint32_t nodeOffset;
+	// start of the bottom level primitive indices, its leaf ranges are relative to it
+	uint32_t primitiveOffset;
+	// first index of the mesh in the CPU index list, also the first triangle material times 3
+	uint32_t indexOffset;
+	// added to the mesh local indices in the CPU vertex list
+	uint32_t vertexOffset;
+	// position dequantization and vertex flags of the mesh
+	glm::vec3 positionOrigin;
+	uint32_t vertexFlags;
+	glm::vec3 positionExtent;
+	// first word of the vertex colors of a compressed mesh in the geometry pool vertex arena
+	uint32_t colorOffset;
+	// first word of the mesh in the vertex arena, which holds Vertex records or compressed streams
+	uint32_t vertexDataOffset;
+	// first index of the mesh in the geometry pool index arena
+	uint32_t poolIndexOffset;
+	uint32_t padding0;
+	uint32_t padding1;
+};
+
+// an emissive triangle in world space, same layout as TracerLight in the tracer shaders (std430)
+struct TracerLight {
+	glm::vec3 v0;
+	// emitted power of this and all previous lights, the last entry holds the total
+	float cumulativePower;
+	glm::vec3 v1;
+	float padding0;
+	glm::vec3 v2;
+	float padding1;
+	glm::vec3 emission;
+	float padding2;
+};
+
+// two level acceleration structure: one BVH per MeshAsset in object space and a top level BVH over
+// the mesh node instances, geometry shared by several instances is only stored once
+struct TracerScene {
+	// decoded vertices and indices for the CPU tracer, the GPU reads the geometry pool
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<TracerInstance> instances;
+
+	// the top level nodes come first, followed by the nodes of every bottom level BVH
+	std::vector<BVHNode> nodes;
+	std::vector<uint32_t> primitives;
+	uint32_t topLevelNodeCount = 0;
+	uint32_t triangleCount = 0;
+
+	// material table index of every triangle in the index buffer
+	std::vector<uint32_t> triangleMaterials;
+	// the table the scene was built against, the GPU stages read its buffer
+	const MaterialTable* materialTable = nullptr;
+	// emissive triangles of all instances, sampled proportionally to their power
+	std::vector<TracerLight> lights;
+
+	// 8-wide copies of the bottom level BVHs for the CPU tracer and the one used by every instance
+	std::vector<BVH8> wideBottomLevels;
+	std::vector<uint32_t> instanceWideBottomLevels;
+
+	AllocatedBuffer nodeBuffer;
+	AllocatedBuffer primitiveBuffer;
+	AllocatedBuffer instanceBuffer;
+	AllocatedBuffer triangleMaterialBuffer;
+	AllocatedBuffer lightBuffer;
+
+	void build(const std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>>& scenes, const MaterialTable& materials, JobSystem& jobs);
+	void upload(Engine* engine);
+	void clear(Engine* engine);
+
+	// before the first scene is loaded, after failed loads or for scenes without triangles
+	bool empty() const { return instances.empty() || triangleCount == 0; }
+
+private:
+	bool uploaded = false;
+
+	struct BottomLevel {
+		uint32_t nodeOffset;
+		uint32_t primitiveOffset;
+		uint32_t indexOffset;
+		uint32_t vertexOffset;
+		uint32_t wideIndex;
+	};
+	std::unordered_map<const MeshAsset*, BottomLevel> bottomLevels;
+	std::vector<AABB> instanceBounds;
+
+	void addNode(const Node& node);
+	const BottomLevel& addMesh(const MeshAsset& mesh);
+	void addLights(const MeshAsset& mesh, const BottomLevel& bottomLevel, const glm::mat4& transform);
+};
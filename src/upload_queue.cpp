@@ -0,0 +1,327 @@
+#include "upload_queue.hpp"
+
+#include "engine.hpp"
+#include "vk_images.hpp"
+#include "vk_initializers.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static void waitForTimeline(VkDevice device, VkSemaphore timeline, uint64_t value)
+{
+	VkSemaphoreWaitInfo waitInfo{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &timeline,
+		.pValues = &value,
+	};
+
+	VK_CHECK(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+}
+
+void UploadQueue::init(Engine* engine, VkQueue transferQueue, uint32_t transferQueueFamily, VkDeviceSize ringSize)
+{
+	this->engine = engine;
+	this->ringSize = ringSize;
+	queue = transferQueue;
+	queueFamily = transferQueueFamily;
+
+	VkSemaphoreTypeCreateInfo timelineInfo{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	VkSemaphoreCreateInfo semaphoreInfo = vkinit::semaphoreCreateInfo();
+	semaphoreInfo.pNext = &timelineInfo;
+	VK_CHECK(vkCreateSemaphore(engine->device, &semaphoreInfo, nullptr, &timeline));
+
+	VkCommandPoolCreateInfo poolInfo = vkinit::commandPoolCreateInfo(queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	VK_CHECK(vkCreateCommandPool(engine->device, &poolInfo, nullptr, &commandPool));
+
+	// blits need a graphics queue
+	if (queueFamily != engine->graphicsQueueFamily) {
+		VkCommandPoolCreateInfo mipPoolInfo = vkinit::commandPoolCreateInfo(engine->graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+		VK_CHECK(vkCreateCommandPool(engine->device, &mipPoolInfo, nullptr, &mipCommandPool));
+	}
+
+	ring = engine->createBuffer(ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+}
+
+void UploadQueue::destroy()
+{
+	// unsubmitted copies may target resources that are already gone, they are dropped
+	if (recordingStarted) {
+		VK_CHECK(vkEndCommandBuffer(recording.cmdBuffer));
+		recording.value = submittedValue;
+		recording.ringEnd = ringWritten;
+		inFlight.push_back(std::move(recording));
+		recordingStarted = false;
+	}
+	wait(submittedValue);
+
+	vkDestroyCommandPool(engine->device, commandPool, nullptr);
+	vkDestroyCommandPool(engine->device, mipCommandPool, nullptr);
+	engine->destroyBuffer(ring);
+	vkDestroySemaphore(engine->device, timeline, nullptr);
+}
+
+void UploadQueue::uploadBuffer(const void* data, size_t size, VkBuffer destination, VkDeviceSize destinationOffset)
+{
+	if (size == 0) {
+		return;
+	}
+
+	std::lock_guard lock(mutex);
+
+	auto [source, sourceOffset] = stage(data, size);
+
+	VkBufferCopy copy{
+		.srcOffset = sourceOffset,
+		.dstOffset = destinationOffset,
+		.size = size,
+	};
+
+	vkCmdCopyBuffer(recordingCommandBuffer(), source, destination, 1, &copy);
+}
+
+void UploadQueue::uploadImage(const void* data, size_t size, const AllocatedImage& image)
+{
+	std::lock_guard lock(mutex);
+
+	auto [source, sourceOffset] = stage(data, size);
+	VkCommandBuffer cmdBuffer = recordingCommandBuffer();
+
+	vkutil::transitionImage(cmdBuffer, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	VkBufferImageCopy copyRegion{
+		.bufferOffset = sourceOffset,
+		.imageSubresource{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.layerCount = 1,
+		},
+		.imageExtent = image.imageExtent,
+	};
+
+	vkCmdCopyBufferToImage(cmdBuffer, source, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+	if (image.mipLevels == 1) {
+		vkutil::transitionImage(cmdBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		return;
+	}
+
+	// images are shared concurrently by both families, the layout carries over to the graphics queue
+	VkCommandBuffer mipCmdBuffer = mipCommandPool != VK_NULL_HANDLE ? recordingMipCommandBuffer() : cmdBuffer;
+	VkExtent2D imageSize{ image.imageExtent.width, image.imageExtent.height };
+	vkutil::generateMipmaps(mipCmdBuffer, image.image, imageSize, image.mipLevels);
+}
+
+void UploadQueue::uploadImage(const void* data, size_t size, const AllocatedImage& image, std::span<const VkDeviceSize> levelOffsets)
+{
+	std::lock_guard lock(mutex);
+
+	auto [source, sourceOffset] = stage(data, size);
+	VkCommandBuffer cmdBuffer = recordingCommandBuffer();
+
+	vkutil::transitionImage(cmdBuffer, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	std::vector<VkBufferImageCopy> copyRegions;
+	for (uint32_t level = 0; level < levelOffsets.size(); level++) {
+		copyRegions.push_back(VkBufferImageCopy{
+			.bufferOffset = sourceOffset + levelOffsets[level],
+			.imageSubresource{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = level,
+				.layerCount = 1,
+			},
+			.imageExtent{
+				.width = std::max(image.imageExtent.width >> level, 1u),
+				.height = std::max(image.imageExtent.height >> level, 1u),
+				.depth = 1,
+			},
+		});
+	}
+
+	vkCmdCopyBufferToImage(cmdBuffer, source, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+	vkutil::transitionImage(cmdBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+uint64_t UploadQueue::flush()
+{
+	std::lock_guard lock(mutex);
+
+	return submitRecording();
+}
+
+void UploadQueue::wait(uint64_t value)
+{
+	std::lock_guard lock(mutex);
+
+	waitForTimeline(engine->device, timeline, value);
+	retire(value);
+}
+
+VkSemaphoreSubmitInfo UploadQueue::waitInfo(VkPipelineStageFlags2 stageMask)
+{
+	std::lock_guard lock(mutex);
+
+	return VkSemaphoreSubmitInfo{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+		.semaphore = timeline,
+		.value = submittedValue,
+		.stageMask = stageMask,
+	};
+}
+
+std::pair<VkBuffer, VkDeviceSize> UploadQueue::stage(const void* data, size_t size)
+{
+	// with at most half the ring per upload, an upload that skips the end of the ring still fits into an
+	// empty one
+	if (size > ringSize / 2) {
+		AllocatedBuffer staging = engine->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		memcpy(staging.info.pMappedData, data, size);
+		recording.dedicatedStaging.push_back(staging);
+		return { staging.buffer, 0 };
+	}
+
+	// a drained ring starts over at its beginning, batches that only used dedicated staging do not care
+	if (inFlight.empty() && ringWritten == ringReleased) {
+		ringWritten = 0;
+		ringReleased = 0;
+	}
+
+	// 16 byte steps keep every copy source aligned to the texel size of its format
+	VkDeviceSize reserved = (size + 15) & ~VkDeviceSize(15);
+	VkDeviceSize offset = ringWritten % ringSize;
+	// a reservation does not wrap around, the end of the ring is skipped instead
+	VkDeviceSize skipped = offset + reserved > ringSize ? ringSize - offset : 0;
+
+	while (ringWritten + skipped + reserved - ringReleased > ringSize) {
+		// the rest of the ring belongs to the recording batch, it has to go first
+		if (inFlight.empty()) {
+			submitRecording();
+		}
+		// only batches holding ring memory can free it
+		assert(!inFlight.empty());
+
+		uint64_t oldest = inFlight.front().value;
+		waitForTimeline(engine->device, timeline, oldest);
+		retire(oldest);
+	}
+
+	ringWritten += skipped;
+	offset = ringWritten % ringSize;
+	ringWritten += reserved;
+
+	memcpy(static_cast<char*>(ring.info.pMappedData) + offset, data, size);
+
+	return { ring.buffer, offset };
+}
+
+VkCommandBuffer UploadQueue::recordingCommandBuffer()
+{
+	if (recordingStarted) {
+		return recording.cmdBuffer;
+	}
+
+	uint64_t completedValue;
+	VK_CHECK(vkGetSemaphoreCounterValue(engine->device, timeline, &completedValue));
+	retire(completedValue);
+
+	if (freeCommandBuffers.empty()) {
+		VkCommandBufferAllocateInfo allocInfo = vkinit::commandBufferAllocateInfo(commandPool);
+		VK_CHECK(vkAllocateCommandBuffers(engine->device, &allocInfo, &recording.cmdBuffer));
+	}
+	else {
+		recording.cmdBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+		VK_CHECK(vkResetCommandBuffer(recording.cmdBuffer, 0));
+	}
+
+	VkCommandBufferBeginInfo beginInfo = vkinit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	VK_CHECK(vkBeginCommandBuffer(recording.cmdBuffer, &beginInfo));
+	recordingStarted = true;
+
+	return recording.cmdBuffer;
+}
+
+VkCommandBuffer UploadQueue::recordingMipCommandBuffer()
+{
+	if (recording.mipCmdBuffer != VK_NULL_HANDLE) {
+		return recording.mipCmdBuffer;
+	}
+
+	if (freeMipCommandBuffers.empty()) {
+		VkCommandBufferAllocateInfo allocInfo = vkinit::commandBufferAllocateInfo(mipCommandPool);
+		VK_CHECK(vkAllocateCommandBuffers(engine->device, &allocInfo, &recording.mipCmdBuffer));
+	}
+	else {
+		recording.mipCmdBuffer = freeMipCommandBuffers.back();
+		freeMipCommandBuffers.pop_back();
+		VK_CHECK(vkResetCommandBuffer(recording.mipCmdBuffer, 0));
+	}
+
+	VkCommandBufferBeginInfo beginInfo = vkinit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	VK_CHECK(vkBeginCommandBuffer(recording.mipCmdBuffer, &beginInfo));
+
+	return recording.mipCmdBuffer;
+}
+
+uint64_t UploadQueue::submitRecording()
+{
+	if (!recordingStarted) {
+		return submittedValue;
+	}
+
+	VK_CHECK(vkEndCommandBuffer(recording.cmdBuffer));
+
+	recording.ringEnd = ringWritten;
+
+	std::lock_guard queueLock(engine->queueMutex);
+
+	VkCommandBufferSubmitInfo cmdInfo = vkinit::commandBufferSubmitInfo(recording.cmdBuffer);
+	VkSemaphoreSubmitInfo signalInfo = vkinit::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timeline);
+	signalInfo.value = ++submittedValue;
+	VkSubmitInfo2 submit = vkinit::submitInfo(&cmdInfo, &signalInfo, nullptr);
+
+	VK_CHECK(vkQueueSubmit2(queue, 1, &submit, VK_NULL_HANDLE));
+
+	// the mip chains start once the copies are done and signal the value after theirs
+	if (recording.mipCmdBuffer != VK_NULL_HANDLE) {
+		VK_CHECK(vkEndCommandBuffer(recording.mipCmdBuffer));
+
+		VkCommandBufferSubmitInfo mipCmdInfo = vkinit::commandBufferSubmitInfo(recording.mipCmdBuffer);
+		VkSemaphoreSubmitInfo copiesInfo = vkinit::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, timeline);
+		copiesInfo.value = submittedValue;
+		VkSemaphoreSubmitInfo mipSignalInfo = vkinit::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timeline);
+		mipSignalInfo.value = ++submittedValue;
+		VkSubmitInfo2 mipSubmit = vkinit::submitInfo(&mipCmdInfo, &mipSignalInfo, &copiesInfo);
+
+		VK_CHECK(vkQueueSubmit2(engine->graphicsQueue, 1, &mipSubmit, VK_NULL_HANDLE));
+	}
+
+	recording.value = submittedValue;
+
+	inFlight.push_back(std::move(recording));
+	recording = {};
+	recordingStarted = false;
+
+	return submittedValue;
+}
+
+void UploadQueue::retire(uint64_t completedValue)
+{
+	while (!inFlight.empty() && inFlight.front().value <= completedValue) {
+		Batch& batch = inFlight.front();
+		ringReleased = batch.ringEnd;
+		for (const AllocatedBuffer& staging : batch.dedicatedStaging) {
+			engine->destroyBuffer(staging);
+		}
+		freeCommandBuffers.push_back(batch.cmdBuffer);
+		if (batch.mipCmdBuffer != VK_NULL_HANDLE) {
+			freeMipCommandBuffers.push_back(batch.mipCmdBuffer);
+		}
+		inFlight.pop_front();
+	}
+}
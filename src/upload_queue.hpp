@@ -0,0 +1,75 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+#include <mutex>
+
+struct Engine;
+
+// staging memory shared by all uploads in flight, uploads over half its size get a staging buffer of their own
+constexpr VkDeviceSize UPLOAD_RING_BYTES = 64ull << 20;
+
+// copies data into buffers and images on the transfer queue without waiting for it. Uploads are staged in
+// a persistently mapped ring buffer and recorded into one command buffer until the next flush, every flush
+// signals the next value of a timeline semaphore. Mip chains are blitted on the graphics queue when the
+// transfer queue is a family of its own, after the copies of the same flush. Uploads may be recorded from
+// any thread.
+struct UploadQueue {
+	VkQueue queue;
+	uint32_t queueFamily;
+	VkSemaphore timeline;
+
+	void init(Engine* engine, VkQueue transferQueue, uint32_t transferQueueFamily, VkDeviceSize ringSize);
+	void destroy();
+
+	void uploadBuffer(const void* data, size_t size, VkBuffer destination, VkDeviceSize destinationOffset = 0);
+	// fills the first mip level from tightly packed texels, generates the others from it and leaves the
+	// image in SHADER_READ_ONLY_OPTIMAL
+	void uploadImage(const void* data, size_t size, const AllocatedImage& image);
+	// fills every mip level from data, level i starts at levelOffsets[i]. Leaves the image in
+	// SHADER_READ_ONLY_OPTIMAL
+	void uploadImage(const void* data, size_t size, const AllocatedImage& image, std::span<const VkDeviceSize> levelOffsets);
+
+	// submits the recorded uploads, returns the timeline value signalled once they are done
+	uint64_t flush();
+	// blocks until the timeline reaches value
+	void wait(uint64_t value);
+	// for a submission on another queue that reads the uploaded data, waits for everything flushed so far
+	VkSemaphoreSubmitInfo waitInfo(VkPipelineStageFlags2 stageMask);
+
+private:
+	struct Batch {
+		VkCommandBuffer cmdBuffer;
+		// mip generation on the graphics queue, none if the batch has no mipmapped image or shares the queue
+		VkCommandBuffer mipCmdBuffer = VK_NULL_HANDLE;
+		uint64_t value;
+		// ring write position after the last byte staged by the batch
+		uint64_t ringEnd;
+		std::vector<AllocatedBuffer> dedicatedStaging;
+	};
+
+	Engine* engine;
+	VkCommandPool commandPool;
+	VkCommandPool mipCommandPool = VK_NULL_HANDLE;
+	AllocatedBuffer ring;
+	VkDeviceSize ringSize;
+	// total bytes ever reserved and released, their difference is the part of the ring in use
+	uint64_t ringWritten = 0;
+	uint64_t ringReleased = 0;
+
+	std::mutex mutex;
+	uint64_t submittedValue = 0;
+	Batch recording{};
+	bool recordingStarted = false;
+	std::deque<Batch> inFlight;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+	std::vector<VkCommandBuffer> freeMipCommandBuffers;
+
+	// copies data into staging memory of the recording batch, returns the buffer and offset to copy from
+	std::pair<VkBuffer, VkDeviceSize> stage(const void* data, size_t size);
+	VkCommandBuffer recordingCommandBuffer();
+	VkCommandBuffer recordingMipCommandBuffer();
+	uint64_t submitRecording();
+	// releases the ring memory and command buffers of batches the GPU finished
+	void retire(uint64_t completedValue);
+};
@@ -0,0 +1,100 @@
+#include "vertex_compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/packing.hpp>
+
+namespace {
+
+glm::vec2 signNotZero(glm::vec2 v)
+{
+	return glm::vec2(v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f);
+}
+
+// projects the unit sphere onto an octahedron and unfolds its lower half into the corners of the square
+glm::vec2 octahedralEncode(glm::vec3 normal)
+{
+	glm::vec2 projected = glm::vec2(normal) / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+	if (normal.z < 0.f) {
+		projected = (1.f - glm::abs(glm::vec2(projected.y, projected.x))) * signNotZero(projected);
+	}
+	return projected;
+}
+
+glm::vec3 octahedralDecode(glm::vec2 encoded)
+{
+	glm::vec3 normal(encoded, 1.f - std::abs(encoded.x) - std::abs(encoded.y));
+	float fold = std::max(-normal.z, 0.f);
+	normal.x += normal.x >= 0.f ? -fold : fold;
+	normal.y += normal.y >= 0.f ? -fold : fold;
+	return glm::normalize(normal);
+}
+
+}
+
+CompressedMesh compressVertices(std::span<const Vertex> vertices, bool withColors)
+{
+	CompressedMesh mesh;
+	if (vertices.empty()) {
+		return mesh;
+	}
+
+	glm::vec3 boundsMin = vertices[0].position;
+	glm::vec3 boundsMax = vertices[0].position;
+	for (const Vertex& vertex : vertices) {
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+	mesh.quantization.origin = boundsMin;
+	mesh.quantization.extent = boundsMax - boundsMin;
+
+	// flat axes keep a zero extent and quantize to 0
+	glm::vec3 inverseExtent = glm::vec3(
+		mesh.quantization.extent.x > 0.f ? 1.f / mesh.quantization.extent.x : 0.f,
+		mesh.quantization.extent.y > 0.f ? 1.f / mesh.quantization.extent.y : 0.f,
+		mesh.quantization.extent.z > 0.f ? 1.f / mesh.quantization.extent.z : 0.f);
+
+	mesh.vertices.reserve(vertices.size());
+	for (const Vertex& vertex : vertices) {
+		glm::vec3 normalized = glm::clamp((vertex.position - boundsMin) * inverseExtent, 0.f, 1.f);
+		glm::vec3 normal = glm::length(vertex.normal) > 0.f ? glm::normalize(vertex.normal) : glm::vec3(0.f, 0.f, 1.f);
+
+		mesh.vertices.push_back(CompressedVertex{
+			.position = {
+				glm::packUnorm1x16(normalized.x),
+				glm::packUnorm1x16(normalized.y),
+				glm::packUnorm1x16(normalized.z),
+			},
+			.padding = 0,
+			.normal = glm::packSnorm2x16(octahedralEncode(normal)),
+			.uv = glm::packHalf2x16(glm::vec2(vertex.uv_x, vertex.uv_y)),
+		});
+	}
+
+	if (withColors) {
+		mesh.colors.reserve(vertices.size());
+		for (const Vertex& vertex : vertices) {
+			mesh.colors.push_back(glm::packUnorm4x8(vertex.color));
+		}
+	}
+
+	return mesh;
+}
+
+Vertex decompressVertex(const CompressedVertex& vertex, uint32_t color, const PositionQuantization& quantization)
+{
+	glm::vec3 normalized(
+		glm::unpackUnorm1x16(vertex.position[0]),
+		glm::unpackUnorm1x16(vertex.position[1]),
+		glm::unpackUnorm1x16(vertex.position[2]));
+	glm::vec2 uv = glm::unpackHalf2x16(vertex.uv);
+
+	return Vertex{
+		.position = quantization.origin + normalized * quantization.extent,
+		.uv_x = uv.x,
+		.normal = octahedralDecode(glm::unpackSnorm2x16(vertex.normal)),
+		.uv_y = uv.y,
+		.color = glm::unpackUnorm4x8(color),
+	};
+}
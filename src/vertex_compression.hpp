@@ -0,0 +1,14 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+// the streams of a compressed mesh, the rgba8 colors are only kept when the mesh has vertex colors
+struct CompressedMesh {
+	std::vector<CompressedVertex> vertices;
+	std::vector<uint32_t> colors;
+	PositionQuantization quantization;
+};
+
+CompressedMesh compressVertices(std::span<const Vertex> vertices, bool withColors);
+// decodes like the shaders, so geometry built from decoded vertices matches what the GPU sees
+Vertex decompressVertex(const CompressedVertex& vertex, uint32_t color, const PositionQuantization& quantization);
@@ -1,11 +1,11 @@
 #include "vk_descriptors.hpp"
 
-void DescriptorLayoutBuilder::addBinding(uint32_t binding, VkDescriptorType type)
+void DescriptorLayoutBuilder::addBinding(uint32_t binding, VkDescriptorType type, uint32_t count)
 {
 	VkDescriptorSetLayoutBinding newBinding{
 		.binding = binding,
 		.descriptorType = type,
-		.descriptorCount = 1,
+		.descriptorCount = count,
 	};
 
 	bindings.push_back(newBinding);
@@ -151,7 +151,7 @@ VkDescriptorPool DescriptorAllocator::createPool(VkDevice device, uint32_t setCo
 	return newPool;
 }
 
-void DescriptorWriter::writeImage(uint32_t binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type)
+void DescriptorWriter::writeImage(uint32_t binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type, uint32_t arrayElement)
 {
 	VkDescriptorImageInfo& info = imageInfos.emplace_back(VkDescriptorImageInfo{
 		.sampler = sampler,
@@ -163,6 +163,7 @@ void DescriptorWriter::writeImage(uint32_t binding, VkImageView image, VkSampler
 		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 		.dstSet = VK_NULL_HANDLE,
 		.dstBinding = binding,
+		.dstArrayElement = arrayElement,
 		.descriptorCount = 1,
 		.descriptorType = type,
 		.pImageInfo = &info,
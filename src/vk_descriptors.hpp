@@ -4,7 +4,7 @@
 struct DescriptorLayoutBuilder {
 	std::vector<VkDescriptorSetLayoutBinding> bindings;
 
-	void addBinding(uint32_t binding, VkDescriptorType type);
+	void addBinding(uint32_t binding, VkDescriptorType type, uint32_t count = 1);
 	void clear();
 	VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags shaderStages, void* pNext = nullptr, VkDescriptorSetLayoutCreateFlags flags = 0);
 };
@@ -36,7 +36,7 @@ struct DescriptorWriter {
 	std::deque<VkDescriptorBufferInfo> bufferInfos;
 	std::vector<VkWriteDescriptorSet> writes;
 
-	void writeImage(uint32_t binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type);
+	void writeImage(uint32_t binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type, uint32_t arrayElement = 0);
 	void writeBuffer(uint32_t binding, VkBuffer buffer, size_t size, size_t offset, VkDescriptorType type);
 	void clear();
 	void updateSet(VkDevice device, VkDescriptorSet set);
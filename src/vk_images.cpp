@@ -1,6 +1,8 @@
 #include "vk_images.hpp"
 #include "vk_initializers.hpp"
 
+#include <algorithm>
+
 // TODO these settings are ok but not optimal. Specific options would be better. 
 // see https://vkguide.dev/docs/new_chapter_1/vulkan_mainloop_code/
 
@@ -59,3 +61,74 @@ void vkutil::copyImagetoImage(VkCommandBuffer cmdBuffer, VkImage source, VkImage
 
 	vkCmdBlitImage2(cmdBuffer, &blitInfo);
 }
+
+void vkutil::generateMipmaps(VkCommandBuffer cmdBuffer, VkImage image, VkExtent2D imageSize, uint32_t mipLevels) {
+	for (uint32_t mip = 0; mip < mipLevels; mip++) {
+		VkImageMemoryBarrier2 imageBarrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.image = image,
+			.subresourceRange{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = mip,
+				.levelCount = 1,
+				.layerCount = 1,
+			},
+		};
+
+		VkDependencyInfo depInfo{
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+			.imageMemoryBarrierCount = 1,
+			.pImageMemoryBarriers = &imageBarrier,
+		};
+
+		vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+
+		if (mip + 1 == mipLevels) {
+			break;
+		}
+
+		VkExtent2D halfSize{ std::max(imageSize.width / 2, 1u), std::max(imageSize.height / 2, 1u) };
+
+		VkImageBlit2 blitRegion{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2
+		};
+		blitRegion.srcOffsets[1].x = imageSize.width;
+		blitRegion.srcOffsets[1].y = imageSize.height;
+		blitRegion.srcOffsets[1].z = 1;
+
+		blitRegion.dstOffsets[1].x = halfSize.width;
+		blitRegion.dstOffsets[1].y = halfSize.height;
+		blitRegion.dstOffsets[1].z = 1;
+
+		blitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blitRegion.srcSubresource.mipLevel = mip;
+		blitRegion.srcSubresource.layerCount = 1;
+
+		blitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blitRegion.dstSubresource.mipLevel = mip + 1;
+		blitRegion.dstSubresource.layerCount = 1;
+
+		VkBlitImageInfo2 blitInfo{
+			.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
+			.srcImage = image,
+			.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.dstImage = image,
+			.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.regionCount = 1,
+			.pRegions = &blitRegion,
+			.filter = VK_FILTER_LINEAR,
+		};
+
+		vkCmdBlitImage2(cmdBuffer, &blitInfo);
+
+		imageSize = halfSize;
+	}
+
+	transitionImage(cmdBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
@@ -5,4 +5,7 @@
 namespace vkutil {
 	void transitionImage(VkCommandBuffer cmdBuffer, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
 	void copyImagetoImage(VkCommandBuffer cmdBuffer, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize);
+	// fills every level below the first by blitting down from the one above, all levels start in
+	// TRANSFER_DST_OPTIMAL and end in SHADER_READ_ONLY_OPTIMAL
+	void generateMipmaps(VkCommandBuffer cmdBuffer, VkImage image, VkExtent2D imageSize, uint32_t mipLevels);
 }
@@ -8,11 +8,44 @@
 #include <stb_image.h>
 
 #include "engine.hpp"
+#include "ktx2.hpp"
+#include "scene_cache.hpp"
 
-std::optional<AllocatedImage> loadImage(Engine* engine, fastgltf::Asset& asset, fastgltf::Image& image)
+#include <cstdio>
+#include <fstream>
+
+// mean of the decoded RGBA8 pixels, the path tracer uses it in place of textures it cannot sample yet
+static glm::vec4 averageColor(const unsigned char* data, int width, int height)
 {
-	AllocatedImage newImage{};
-	int width, height, nrChannels;
+	glm::dvec4 sum{ 0.0 };
+	size_t pixelCount = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < pixelCount; i++) {
+		sum += glm::dvec4(data[4 * i + 0], data[4 * i + 1], data[4 * i + 2], data[4 * i + 3]);
+	}
+	return glm::vec4(sum / (255.0 * std::max<size_t>(pixelCount, 1)));
+}
+
+// bumped when the encoders change, files of older encoders are no longer found
+static constexpr uint8_t TEXTURE_CACHE_VERSION = 1;
+
+static std::vector<uint8_t> readFile(const std::filesystem::path& path)
+{
+	std::vector<uint8_t> bytes;
+
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (file) {
+		bytes.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+	}
+
+	return bytes;
+}
+
+// the encoded png, jpeg or KTX2 bytes of an image, empty if its source cannot be read
+static std::vector<uint8_t> readImageSource(fastgltf::Asset& asset, fastgltf::Image& image)
+{
+	std::vector<uint8_t> source;
 
 	std::visit(
 		fastgltf::visitor{
@@ -22,89 +55,151 @@ std::optional<AllocatedImage> loadImage(Engine* engine, fastgltf::Asset& asset,
 				assert(filePath.uri.isLocalPath());
 
 				const std::string path(filePath.uri.path().begin(), filePath.uri.path().end());
-				unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
-				if (data) {
-					VkExtent3D imagesize;
-					imagesize.width = width;
-					imagesize.height = height;
-					imagesize.depth = 1;
-
-					newImage = engine->createImage(data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-					stbi_image_free(data);
-				}
+				source = readFile(path);
 			},
 			[&](fastgltf::sources::Vector& vector) {
-				unsigned char* data = stbi_load_from_memory(
-					reinterpret_cast<const stbi_uc*>(vector.bytes.data()), 
-					static_cast<int>(vector.bytes.size()) , 
-					&width, &height, &nrChannels, 4);
-				if (data) {
-					VkExtent3D imagesize;
-					imagesize.width = width;
-					imagesize.height = height;
-					imagesize.depth = 1;
-
-					newImage = engine->createImage(data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-					stbi_image_free(data);
-				}
+				const uint8_t* bytes = reinterpret_cast<const uint8_t*>(vector.bytes.data());
+				source.assign(bytes, bytes + vector.bytes.size());
 			},
 			[&](fastgltf::sources::BufferView& view) {
 				auto& bufferView = asset.bufferViews[view.bufferViewIndex];
 				auto& buffer = asset.buffers[bufferView.bufferIndex];
 
 				std::visit(fastgltf::visitor {
-					[](std::monostate& arg) {
-					},
-					[](fastgltf::sources::BufferView& arg) {
-					},
-					[](fastgltf::sources::URI& arg) {
-					},
+					[](auto& arg) {},
 					[&](fastgltf::sources::Array& arg) {
-						unsigned char* data = stbi_load_from_memory(
-							reinterpret_cast<const stbi_uc*>(arg.bytes.data() + bufferView.byteOffset),
-							static_cast<int>(bufferView.byteLength),
-							&width, &height, &nrChannels, 4);
-						if (data) {
-							VkExtent3D imagesize;
-							imagesize.width = width;
-							imagesize.height = height;
-							imagesize.depth = 1;
-
-							newImage = engine->createImage(data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-							stbi_image_free(data);
-						}
-					},
-					[](fastgltf::sources::CustomBuffer& arg) {
-					},
-					[](fastgltf::sources::ByteView& arg) {
-					},
-					[](fastgltf::sources::Fallback& arg) {
+						const uint8_t* bytes = reinterpret_cast<const uint8_t*>(arg.bytes.data() + bufferView.byteOffset);
+						source.assign(bytes, bytes + bufferView.byteLength);
 					},
 					[&](fastgltf::sources::Vector& vector) {
-						unsigned char* data = stbi_load_from_memory(
-							reinterpret_cast<const stbi_uc*>(vector.bytes.data() + bufferView.byteOffset),
-							static_cast<int>(bufferView.byteLength),
-							&width, &height, &nrChannels, 4);
-						if (data) {
-							VkExtent3D imagesize;
-							imagesize.width = width;
-							imagesize.height = height;
-							imagesize.depth = 1;
-
-							newImage = engine->createImage(data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-							stbi_image_free(data);
-						}
-					} 
+						const uint8_t* bytes = reinterpret_cast<const uint8_t*>(vector.bytes.data() + bufferView.byteOffset);
+						source.assign(bytes, bytes + bufferView.byteLength);
+					}
 				}, buffer.data);
 			},
 		}, image.data);
 
-	if (newImage.image == VK_NULL_HANDLE) {
+	return source;
+}
+
+// FNV-1a of the source bytes, the encoding and the cache version names the file of an encoded image
+static std::filesystem::path textureCachePath(const std::filesystem::path& cacheDirectory, std::span<const uint8_t> source, TextureEncoding encoding)
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto addByte = [&](uint8_t byte) {
+		hash = (hash ^ byte) * 1099511628211ull;
+	};
+
+	for (uint8_t byte : source) {
+		addByte(byte);
+	}
+	addByte(static_cast<uint8_t>(encoding));
+	addByte(TEXTURE_CACHE_VERSION);
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ktx2", static_cast<unsigned long long>(hash));
+	return cacheDirectory / name;
+}
+
+// KTX2 sources are uploaded as they are. Png and jpeg sources are either uploaded as rgba8 or block
+// compressed, compressed images are read from the cache when an earlier load already encoded them.
+// uploaded receives the texels of the image when it is not null
+std::optional<AllocatedImage> loadImage(Engine* engine, fastgltf::Asset& asset, fastgltf::Image& image, TextureEncoding encoding,
+	const std::filesystem::path& cacheDirectory, glm::vec4& average, TextureData* uploaded)
+{
+	std::vector<uint8_t> source = readImageSource(asset, image);
+	if (source.empty()) {
 		return {};
 	}
-	else {
+
+	if (isKTX2(source)) {
+		std::optional<TextureData> texture = readKTX2(source);
+		if (!texture || !engine->formatSampleable(texture->format)) {
+			return {};
+		}
+
+		average = texture->average.value_or(glm::vec4(1.f));
+		AllocatedImage newImage = engine->createImage(*texture, VK_IMAGE_USAGE_SAMPLED_BIT);
+		if (uploaded) {
+			*uploaded = std::move(*texture);
+		}
 		return newImage;
 	}
+
+	std::filesystem::path cacheFile;
+	if (encoding != TextureEncoding::RGBA8) {
+		cacheFile = textureCachePath(cacheDirectory, source, encoding);
+
+		std::optional<TextureData> cached = readKTX2(readFile(cacheFile));
+		if (cached && cached->format == textureFormat(encoding) && cached->average) {
+			cached->components = textureComponents(encoding);
+			average = *cached->average;
+			AllocatedImage newImage = engine->createImage(*cached, VK_IMAGE_USAGE_SAMPLED_BIT);
+			if (uploaded) {
+				*uploaded = std::move(*cached);
+			}
+			return newImage;
+		}
+	}
+
+	int width, height, nrChannels;
+	unsigned char* data = stbi_load_from_memory(source.data(), static_cast<int>(source.size()), &width, &height, &nrChannels, 4);
+	if (!data) {
+		return {};
+	}
+
+	average = averageColor(data, width, height);
+
+	AllocatedImage newImage;
+	if (encoding == TextureEncoding::RGBA8) {
+		VkExtent3D imagesize;
+		imagesize.width = width;
+		imagesize.height = height;
+		imagesize.depth = 1;
+
+		newImage = engine->createImage(data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true);
+		if (uploaded) {
+			*uploaded = TextureData{
+				.format = VK_FORMAT_R8G8B8A8_UNORM,
+				.extent = { imagesize.width, imagesize.height },
+				.data = std::vector<uint8_t>(data, data + size_t(4) * width * height),
+				.levelOffsets = { 0 },
+			};
+		}
+	}
+	else {
+		TextureData texture = encodeTexture(data, width, height, encoding);
+		texture.average = average;
+		if (!writeKTX2(cacheFile, texture)) {
+			std::cout << "failed to write texture cache " << cacheFile << std::endl;
+		}
+
+		newImage = engine->createImage(texture, VK_IMAGE_USAGE_SAMPLED_BIT);
+		if (uploaded) {
+			*uploaded = std::move(texture);
+		}
+	}
+
+	stbi_image_free(data);
+	return newImage;
+}
+
+// KHR_texture_basisu images take the place of the png or jpeg source when they load without a transcoder.
+// Basis Universal payloads fall back to the png or jpeg source
+static size_t textureImage(Engine* engine, fastgltf::Asset& asset, const fastgltf::Texture& texture)
+{
+	if (!texture.basisuImageIndex) {
+		return texture.imageIndex.value();
+	}
+
+	size_t basisuImage = texture.basisuImageIndex.value();
+	// without a fallback the image fails to load and the material gets the error texture
+	if (!texture.imageIndex) {
+		return basisuImage;
+	}
+
+	std::optional<VkFormat> format = ktx2Format(readImageSource(asset, asset.images[basisuImage]));
+	return format && engine->formatSampleable(*format) ? basisuImage : texture.imageIndex.value();
 }
 
 static VkFilter extractFilter(fastgltf::Filter filter)
@@ -137,15 +232,138 @@ static VkSamplerMipmapMode extractMipmapMode(fastgltf::Filter filter)
 	}
 }
 
-std::optional<std::shared_ptr<LoadedGLTF>> loadGLTF(Engine* engine, std::filesystem::path filePath)
+// converts the primitives of a mesh into one vertex and index list, uploads it and builds its BVH
+// false if the geometry pool has no room for the mesh
+static bool loadMesh(Engine* engine, fastgltf::Asset& gltf, fastgltf::Mesh& mesh, std::span<const std::shared_ptr<GLTFMaterial>> materials, MeshAsset& newMesh)
 {
+	std::vector<uint32_t>& indices = newMesh.indices;
+	std::vector<Vertex>& vertices = newMesh.vertices;
+	bool hasColors = false;
+
+	for (auto&& primitive : mesh.primitives) {
+		GeoSurface newSurface{
+			.startIndex = static_cast<uint32_t>(indices.size()),
+			.count = static_cast<uint32_t>(gltf.accessors[primitive.indicesAccessor.value()].count)
+		};
+
+		size_t initialVtx = vertices.size();
+
+		{
+			fastgltf::Accessor& indexaccessor = gltf.accessors[primitive.indicesAccessor.value()];
+			indices.reserve(indices.size() + indexaccessor.count);
+
+			fastgltf::iterateAccessor<uint32_t>(gltf, indexaccessor,
+				[&](uint32_t index) {
+					indices.push_back(initialVtx + index);
+				});
+		}
+
+		{
+			fastgltf::Accessor& posAccessor = gltf.accessors[primitive.findAttribute("POSITION")->accessorIndex];
+			vertices.resize(vertices.size() + posAccessor.count);
+
+			fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, posAccessor,
+				[&](glm::vec3 pos, size_t index) {
+					Vertex newVtx{
+						.position = pos,
+						.normal = { 1, 0, 0 },
+						.color = glm::vec4{ 1.f },
+					};
+					vertices[initialVtx + index] = newVtx;
+				});
+		}
+
+		auto normals = primitive.findAttribute("NORMAL");
+		if (normals != primitive.attributes.end()) {
+			fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, gltf.accessors[normals->accessorIndex],
+				[&](glm::vec3 normal, size_t index) {
+					vertices[initialVtx + index].normal = normal;
+				});
+		}
+
+		auto uv = primitive.findAttribute("TEXCOORD_0");
+		if (uv != primitive.attributes.end()) {
+			fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf, gltf.accessors[uv->accessorIndex],
+				[&](glm::vec2 uv, size_t index) {
+					vertices[initialVtx + index].uv_x = uv.x;
+					vertices[initialVtx + index].uv_y = uv.y;
+				});
+		}
+
+		auto colors = primitive.findAttribute("COLOR_0");
+		if (colors != primitive.attributes.end()) {
+			fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf, gltf.accessors[colors->accessorIndex],
+				[&](glm::vec4 color, size_t index) {
+					vertices[initialVtx + index].color = color;
+				});
+			hasColors = true;
+		}
+
+		if (primitive.materialIndex.has_value()) {
+			newSurface.material = materials[primitive.materialIndex.value()];
+		}
+		else {
+			newSurface.material = materials[0];
+		}
+
+		newMesh.surfaces.push_back(newSurface);
+	}
+
+	std::optional<GPUMeshBuffers> meshBuffers;
+	if (engine->options.compressVertices && !vertices.empty()) {
+		newMesh.vertexFlags = VERTEX_COMPRESSED | (hasColors ? VERTEX_COLORS : 0);
+		newMesh.compressed = compressVertices(vertices, hasColors);
+
+		const CompressedMesh& compressed = newMesh.compressed;
+		for (size_t i = 0; i < vertices.size(); i++) {
+			uint32_t color = hasColors ? compressed.colors[i] : 0xffffffff;
+			vertices[i] = decompressVertex(compressed.vertices[i], color, compressed.quantization);
+		}
+
+		meshBuffers = engine->uploadMesh(indices, compressed);
+	}
+	else {
+		meshBuffers = engine->uploadMesh(indices, vertices);
+	}
+
+	if (!meshBuffers) {
+		return false;
+	}
+	newMesh.meshBuffers = *meshBuffers;
+
+	for (GeoSurface& surface : newMesh.surfaces) {
+		if (surface.count == 0) {
+			continue;
+		}
+
+		AABB box;
+		for (uint32_t i = surface.startIndex; i < surface.startIndex + surface.count; i++) {
+			box.grow(vertices[indices[i]].position);
+		}
+
+		glm::vec3 extents = (box.max - box.min) * 0.5f;
+		surface.bounds = Bounds{ .origin = box.center(), .sphereRadius = glm::length(extents), .extents = extents };
+	}
+
+	newMesh.bvh.buildTriangles(vertices, indices);
+	return true;
+}
+
+void loadGLTF(Engine* engine, GLTFLoad& load)
+{
+	const std::filesystem::path& filePath = load.path;
 	std::cout << "Loading glTF: " << filePath << std::endl;
 
+	SceneCacheKey cacheKey = sceneCacheKey(engine, filePath);
+	if (engine->options.sceneCache && loadSceneCache(engine, load, cacheKey)) {
+		return;
+	}
+
 	std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
 	scene->creator = engine;
 	LoadedGLTF& file = *scene.get();
 
-	fastgltf::Parser parser{};
+	fastgltf::Parser parser{ fastgltf::Extensions::KHR_texture_basisu };
 	fastgltf::Asset gltf;
 
 	constexpr auto gltfOptions = fastgltf::Options::DontRequireValidAssetMember 
@@ -156,217 +374,160 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGLTF(Engine* engine, std::filesys
 	auto data = fastgltf::GltfDataBuffer::FromPath(filePath);
 	if (!data) {
 		std::cout << "Failed to read glTF: " << fastgltf::to_underlying(data.error()) << std::endl;
-		return {};
+		load.finished = true;
+		return;
 	}
 
 	fastgltf::GltfType type = fastgltf::determineGltfFileType(data.get());
 
 	if (type == fastgltf::GltfType::glTF) {
-		auto load = parser.loadGltf(data.get(), filePath.parent_path(), gltfOptions);
-		if (load) {
-			gltf = std::move(load.get());
+		auto result = parser.loadGltf(data.get(), filePath.parent_path(), gltfOptions);
+		if (result) {
+			gltf = std::move(result.get());
 		}
 		else {
-			std::cout << "Failed to load glTF: " << fastgltf::to_underlying(load.error()) << std::endl;
-			return {};
+			std::cout << "Failed to load glTF: " << fastgltf::to_underlying(result.error()) << std::endl;
+			load.finished = true;
+			return;
 		}
 	}
 	else if (type == fastgltf::GltfType::GLB) {
-		auto load = parser.loadGltfBinary(data.get(), filePath.parent_path(), gltfOptions);
-		if (load) {
-			gltf = std::move(load.get());
+		auto result = parser.loadGltfBinary(data.get(), filePath.parent_path(), gltfOptions);
+		if (result) {
+			gltf = std::move(result.get());
 		}
 		else {
-			std::cout << "Failed to load glTF: " << fastgltf::to_underlying(load.error()) << std::endl;
-			return {};
+			std::cout << "Failed to load glTF: " << fastgltf::to_underlying(result.error()) << std::endl;
+			load.finished = true;
+			return;
 		}
 	}
 	else {
 		std::cout << "Failed loading GLTF: Unsupported type!" << std::endl;
+		load.finished = true;
+		return;
 	}
 
-	std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 },
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 }
-	};
-
-	if (gltf.materials.size() > 0) {
-		file.descriptorPool.init(engine->device, gltf.materials.size(), sizes);
-	}
+	// the scene is written to its cache as it loads, the next load of the file maps it instead
+	SceneCacheWriter cacheWriter;
+	bool writeCache = engine->options.sceneCache && cacheWriter.open(sceneCachePath(filePath), cacheKey);
 
+	std::vector<VkSamplerCreateInfo> samplerInfos;
 	for (fastgltf::Sampler& sampler : gltf.samplers) {
+		// filters left open by the file get the trilinear default
+		fastgltf::Filter minFilter = sampler.minFilter.value_or(fastgltf::Filter::LinearMipMapLinear);
+		bool mipmapped = minFilter != fastgltf::Filter::Nearest && minFilter != fastgltf::Filter::Linear;
+
 		VkSamplerCreateInfo samplerInfo{
 			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-			.magFilter = extractFilter(sampler.magFilter.value_or(fastgltf::Filter::Nearest)),
-			.minFilter = extractFilter(sampler.minFilter.value_or(fastgltf::Filter::Nearest)),
-			.mipmapMode = extractMipmapMode(sampler.minFilter.value_or(fastgltf::Filter::Nearest)),
-			.maxLod = VK_LOD_CLAMP_NONE,
+			.magFilter = extractFilter(sampler.magFilter.value_or(fastgltf::Filter::Linear)),
+			.minFilter = extractFilter(minFilter),
+			.mipmapMode = extractMipmapMode(minFilter),
+			// min filters without a mipmap mode only read the first level
+			.maxLod = mipmapped ? VK_LOD_CLAMP_NONE : 0.0f,
 		};
 
 		VkSampler newSampler;
 		vkCreateSampler(engine->device, &samplerInfo, nullptr, &newSampler);
 		file.samplers.push_back(newSampler);
+		samplerInfos.push_back(samplerInfo);
+	}
+
+	// the image sampled by every texture, decided once since it may read the image source
+	std::vector<size_t> textureImages;
+	for (fastgltf::Texture& texture : gltf.textures) {
+		textureImages.push_back(textureImage(engine, gltf, texture));
 	}
 
 	std::vector<std::shared_ptr<MeshAsset>> meshes;
 	std::vector<std::shared_ptr<Node>> nodes;
-	std::vector<AllocatedImage> images;
 	std::vector<std::shared_ptr<GLTFMaterial>> materials;
+	std::vector<std::string> materialNames;
+	std::vector<std::string> nodeNames;
 
-	for (fastgltf::Image& image : gltf.images) {
-		auto allocImage = loadImage(engine, gltf, image);
-
-		if (allocImage.has_value()) {
-			images.push_back(*allocImage);
-			file.images[image.name.c_str()] = *allocImage;
-		}
-		else {
-			images.push_back(engine->missingTextureImage);
-			std::cout << "failed to load texture " << image.name << " from gltf" << std::endl;
-		}
-	}
-
-	if (gltf.materials.size() > 0) {
-		file.materialDataBuffer = engine->createBuffer(
-			sizeof(GLTFMetallicRoughness::MaterialConstants) * gltf.materials.size(),
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-	}
-	else {
+	if (gltf.materials.size() == 0) {
 		materials.push_back(std::make_shared<GLTFMaterial>());
+		materialNames.push_back({});
 	}
-	int dataIndex = 0;
-	auto sceneMaterialConstants = (GLTFMetallicRoughness::MaterialConstants*)file.materialDataBuffer.info.pMappedData;
 
+	// texture slots stay empty until the images are decoded, the material factors stand in for them
 	for (fastgltf::Material& material : gltf.materials) {
 		std::shared_ptr<GLTFMaterial> newMaterial = std::make_shared<GLTFMaterial>();
 		materials.push_back(newMaterial);
+		materialNames.push_back(material.name.c_str());
 		file.materials[material.name.c_str()] = newMaterial;
 
-		GLTFMetallicRoughness::MaterialConstants constants{
-			.colorFactors = {
-				material.pbrData.baseColorFactor[0],
-				material.pbrData.baseColorFactor[1],
-				material.pbrData.baseColorFactor[2],
-				material.pbrData.baseColorFactor[3]
-			},
-			.metalRoughFactors{
-				material.pbrData.metallicFactor,
-				material.pbrData.roughnessFactor,
-				0, 0
-			}
-		};
-		sceneMaterialConstants[dataIndex] = constants;
-
 		MaterialPass passType = MaterialPass::Opaque;
 		if (material.alphaMode == fastgltf::AlphaMode::Blend) {
 			passType = MaterialPass::Transparent;
 		}
 
-		GLTFMetallicRoughness::MaterialResources materialResources;
-
-		materialResources.dataBuffer = file.materialDataBuffer.buffer;
-		materialResources.dataBufferOffset = dataIndex * sizeof(GLTFMetallicRoughness::MaterialConstants);
+		newMaterial->data = engine->metalRoughMaterial.createInstance(passType);
 
-		materialResources.colorImage = engine->whiteImage;
-		materialResources.colorSampler = engine->defaultSamplerLinear;
-		materialResources.metalRoughImage = engine->whiteImage;
-		materialResources.metalRoughSampler = engine->defaultSamplerLinear;
+		newMaterial->baseColor = glm::vec4(
+			material.pbrData.baseColorFactor[0],
+			material.pbrData.baseColorFactor[1],
+			material.pbrData.baseColorFactor[2],
+			material.pbrData.baseColorFactor[3]);
+		newMaterial->metallic = material.pbrData.metallicFactor;
+		newMaterial->roughness = material.pbrData.roughnessFactor;
 
 		if (material.pbrData.baseColorTexture.has_value()) {
 			fastgltf::Texture texture = gltf.textures[material.pbrData.baseColorTexture.value().textureIndex];
-			size_t img = texture.imageIndex.value();
-			size_t sampler = texture.samplerIndex.value();
+			file.textureReferences.push_back(LoadedGLTF::TextureReference{
+				.material = newMaterial,
+				.use = LoadedGLTF::TextureUse::BaseColor,
+				.image = textureImages[material.pbrData.baseColorTexture.value().textureIndex],
+			});
+			newMaterial->baseColorSampler = texture.samplerIndex ? file.samplers[texture.samplerIndex.value()] : engine->defaultSamplerLinear;
+		}
 
-			materialResources.colorImage = images[img];
-			materialResources.colorSampler = file.samplers[sampler];
+		if (material.pbrData.metallicRoughnessTexture.has_value()) {
+			fastgltf::Texture texture = gltf.textures[material.pbrData.metallicRoughnessTexture.value().textureIndex];
+			file.textureReferences.push_back(LoadedGLTF::TextureReference{
+				.material = newMaterial,
+				.use = LoadedGLTF::TextureUse::MetalRough,
+				.image = textureImages[material.pbrData.metallicRoughnessTexture.value().textureIndex],
+			});
+			newMaterial->metalRoughSampler = texture.samplerIndex ? file.samplers[texture.samplerIndex.value()] : engine->defaultSamplerLinear;
 		}
 
-		newMaterial->data = engine->metalRoughMaterial.writeMaterial(engine->device, passType, materialResources, file.descriptorPool);
+		newMaterial->emission = glm::vec3(material.emissiveFactor[0], material.emissiveFactor[1], material.emissiveFactor[2])
+			* static_cast<float>(material.emissiveStrength);
 
-		dataIndex++;
+		if (material.emissiveTexture.has_value()) {
+			fastgltf::Texture texture = gltf.textures[material.emissiveTexture.value().textureIndex];
+			file.textureReferences.push_back(LoadedGLTF::TextureReference{
+				.material = newMaterial,
+				.use = LoadedGLTF::TextureUse::Emission,
+				.image = textureImages[material.emissiveTexture.value().textureIndex],
+			});
+		}
 	}
 
-	std::vector<uint32_t> indices;
-	std::vector<Vertex> vertices;
 	for (fastgltf::Mesh& mesh : gltf.meshes) {
 		std::shared_ptr<MeshAsset> newMesh = std::make_shared<MeshAsset>();
 		meshes.push_back(newMesh);
 		file.meshes[mesh.name.c_str()] = newMesh;
 		newMesh->name = mesh.name;
+	}
 
-		vertices.clear();
-		indices.clear();
-
-		for (auto&& primitive : mesh.primitives) {
-			GeoSurface newSurface{
-				.startIndex = static_cast<uint32_t>(indices.size()),
-				.count = static_cast<uint32_t>(gltf.accessors[primitive.indicesAccessor.value()].count)
-			};
-
-			size_t initialVtx = vertices.size();
-
-			{
-				fastgltf::Accessor& indexaccessor = gltf.accessors[primitive.indicesAccessor.value()];
-				indices.reserve(indices.size() + indexaccessor.count);
-
-				fastgltf::iterateAccessor<uint32_t>(gltf, indexaccessor,
-					[&](uint32_t index) {
-						indices.push_back(initialVtx + index);
-					});
-			}
-
-			{
-				fastgltf::Accessor& posAccessor = gltf.accessors[primitive.findAttribute("POSITION")->accessorIndex];
-				vertices.resize(vertices.size() + posAccessor.count);
-
-				fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, posAccessor,
-					[&](glm::vec3 pos, size_t index) {
-						Vertex newVtx{
-							.position = pos,
-							.normal = { 1, 0, 0 },
-							.color = glm::vec4{ 1.f },
-						};
-						vertices[initialVtx + index] = newVtx;
-					});
-			}
-
-			auto normals = primitive.findAttribute("NORMAL");
-			if (normals != primitive.attributes.end()) {
-				fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, gltf.accessors[normals->accessorIndex],
-					[&](glm::vec3 normal, size_t index) {
-						vertices[initialVtx + index].normal = normal;
-					});
-			}
-
-			auto uv = primitive.findAttribute("TEXCOORD_0");
-			if (uv != primitive.attributes.end()) {
-				fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf, gltf.accessors[uv->accessorIndex],
-					[&](glm::vec2 uv, size_t index) {
-						vertices[initialVtx + index].uv_x = uv.x;
-						vertices[initialVtx + index].uv_y = uv.y;
-					});
-			}
-
-			auto colors = primitive.findAttribute("COLOR_0");
-			if (colors != primitive.attributes.end()) {
-				fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf, gltf.accessors[colors->accessorIndex],
-					[&](glm::vec4 color, size_t index) {
-						vertices[initialVtx + index].color = color;
-					});
-			}
-
-			if (primitive.materialIndex.has_value()) {
-				newSurface.material = materials[primitive.materialIndex.value()];
-			}
-			else {
-				newSurface.material = materials[0];
+	// meshes are independent of each other, the engine's geometry pool and upload queue take them from any thread
+	std::atomic<bool> geometryFits = true;
+	engine->jobs.parallelFor(static_cast<uint32_t>(meshes.size()), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			if (!loadMesh(engine, gltf, gltf.meshes[i], materials, *meshes[i])) {
+				geometryFits = false;
 			}
-
-			newMesh->surfaces.push_back(newSurface);
 		}
-
-		newMesh->meshBuffers = engine->uploadMesh(indices, vertices);
+	});
+
+	if (!geometryFits) {
+		std::cout << "Failed to load glTF: the geometry pool is full" << std::endl;
+		// the scene gives back the ranges of the meshes that did fit, once their copies are done
+		engine->uploads.wait(engine->uploads.flush());
+		load.finished = true;
+		return;
 	}
 
 	for (fastgltf::Node& node : gltf.nodes) {
@@ -381,6 +542,7 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGLTF(Engine* engine, std::filesys
 		}
 
 		nodes.push_back(newNode);
+		nodeNames.push_back(node.name.c_str());
 		file.nodes[node.name.c_str()] = newNode;
 
 		std::visit(fastgltf::visitor{
@@ -418,9 +580,130 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGLTF(Engine* engine, std::filesys
 		}
 	}
 
+	// the block format of an image follows what the materials use it for
+	bool compressTextures = engine->options.compressTextures && engine->textureCompressionBC;
+	if (engine->options.compressTextures && !engine->textureCompressionBC) {
+		std::cout << "BC formats are not supported, textures stay uncompressed" << std::endl;
+	}
+
+	std::vector<TextureEncoding> encodings(gltf.images.size(), compressTextures ? TextureEncoding::BC1 : TextureEncoding::RGBA8);
+	if (compressTextures) {
+		for (const LoadedGLTF::TextureReference& reference : file.textureReferences) {
+			TextureEncoding& encoding = encodings[reference.image];
+			if (reference.use == LoadedGLTF::TextureUse::BaseColor) {
+				encoding = TextureEncoding::BC7;
+			}
+			else if (reference.use == LoadedGLTF::TextureUse::MetalRough && encoding != TextureEncoding::BC7) {
+				encoding = TextureEncoding::BC5;
+			}
+		}
+	}
+
+	std::filesystem::path cacheDirectory = filePath.parent_path() / "texture_cache";
+	if (compressTextures) {
+		std::error_code error;
+		std::filesystem::create_directories(cacheDirectory, error);
+	}
+
+	std::vector<std::string> imageNames;
+	for (fastgltf::Image& image : gltf.images) {
+		imageNames.push_back(image.name.c_str());
+	}
+
+	if (writeCache) {
+		cacheWriter.writeScene(SceneCacheContents{
+			.samplerInfos = samplerInfos,
+			.samplers = file.samplers,
+			.materials = materials,
+			.materialNames = materialNames,
+			.textureReferences = file.textureReferences,
+			.meshes = meshes,
+			.nodes = nodes,
+			.nodeNames = nodeNames,
+			.imageNames = imageNames,
+		});
+	}
+
+	// the scene can be drawn while the images decode, the first frame waits for the geometry on the GPU
+	engine->uploads.flush();
+	load.scene = scene;
+	load.geometryReady = true;
+
+	std::cout << "Loaded glTF geometry, decoding " << gltf.images.size() << " images" << std::endl;
+
+	// the engine reads the published scene from here on, the images only go into decodedImages. Encoding
+	// runs on the job system with the decoding
+	file.decodedImages.resize(gltf.images.size());
+	engine->jobs.parallelFor(static_cast<uint32_t>(gltf.images.size()), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			LoadedGLTF::DecodedImage& decoded = file.decodedImages[i];
+			decoded.name = imageNames[i];
+			TextureData uploaded;
+			auto allocImage = loadImage(engine, gltf, gltf.images[i], encodings[i], cacheDirectory, decoded.average, writeCache ? &uploaded : nullptr);
+
+			if (allocImage.has_value()) {
+				decoded.image = *allocImage;
+			}
+			else {
+				decoded.image = engine->missingTextureImage;
+				std::cout << "failed to load texture " << gltf.images[i].name << " from gltf" << std::endl;
+			}
+
+			if (writeCache) {
+				cacheWriter.writeImage(i, allocImage ? &uploaded : nullptr, decoded.average);
+			}
+		}
+	});
+
+	engine->uploads.flush();
+	load.finished = true;
+
+	if (writeCache && !cacheWriter.finish()) {
+		std::cout << "failed to write scene cache for " << filePath << std::endl;
+	}
+
 	std::cout << "Finished loading GLTF" << std::endl;
+}
+
+std::optional<std::shared_ptr<LoadedGLTF>> loadGLTF(Engine* engine, std::filesystem::path filePath)
+{
+	GLTFLoad load;
+	load.path = filePath;
+	loadGLTF(engine, load);
+
+	if (!load.scene) {
+		return {};
+	}
 
-	return scene;
+	load.scene->applyTextures();
+	return load.scene;
+}
+
+void LoadedGLTF::applyTextures()
+{
+	for (const TextureReference& reference : textureReferences) {
+		const DecodedImage& decoded = decodedImages[reference.image];
+		switch (reference.use) {
+		case TextureUse::BaseColor:
+			reference.material->baseColorImage = decoded.image.imageView;
+			break;
+		case TextureUse::MetalRough:
+			reference.material->metalRoughImage = decoded.image.imageView;
+			break;
+		case TextureUse::Emission:
+			reference.material->emission *= glm::vec3(decoded.average);
+			break;
+		}
+	}
+
+	for (DecodedImage& decoded : decodedImages) {
+		if (decoded.image.image != creator->missingTextureImage.image) {
+			images[decoded.name] = decoded.image;
+		}
+	}
+
+	textureReferences.clear();
+	decodedImages.clear();
 }
 
 void LoadedGLTF::draw(const glm::mat4& topMatrix, DrawContext& context)
@@ -433,12 +716,9 @@ void LoadedGLTF::draw(const glm::mat4& topMatrix, DrawContext& context)
 void LoadedGLTF::clearAll()
 {
 	VkDevice device = creator->device;
-	descriptorPool.destroyPools(device);
-	creator->destroyBuffer(materialDataBuffer);
 
 	for (auto& [_, v] : meshes) {
-		creator->destroyBuffer(v->meshBuffers.indexBuffer);
-		creator->destroyBuffer(v->meshBuffers.vertexBuffer);
+		creator->geometryPool.free(v->meshBuffers);
 	}
 
 	for (auto& [_, v] : images) {
@@ -446,6 +726,12 @@ void LoadedGLTF::clearAll()
 		creator->destroyImage(v);
 	}
 
+	// decoded but never applied
+	for (auto& decoded : decodedImages) {
+		if (decoded.image.image == VK_NULL_HANDLE || decoded.image.image == creator->missingTextureImage.image) continue;
+		creator->destroyImage(decoded.image);
+	}
+
 	for (auto& sampler : samplers) {
 		vkDestroySampler(device, sampler, nullptr);
 	}
@@ -1,32 +1,56 @@
 #pragma once
+#include <atomic>
 #include <filesystem>
 #include <unordered_map>
 
 #include "vk_descriptors.hpp"
 #include "vk_types.hpp"
+#include "bvh.hpp"
+#include "vertex_compression.hpp"
 
 struct Engine;
 
-struct Bounds {
-	glm::vec3 origin;
-	float sphereRadius;
-	glm::vec3 extents;
-};
-
 struct GLTFMaterial {
 	MaterialInstance data;
+
+	// metallic roughness factors and textures, packed into the engine's material table
+	glm::vec4 baseColor{ 1.f };
+	float metallic = 1.f;
+	float roughness = 1.f;
+	VkImageView baseColorImage = VK_NULL_HANDLE;
+	VkSampler baseColorSampler = VK_NULL_HANDLE;
+	VkImageView metalRoughImage = VK_NULL_HANDLE;
+	VkSampler metalRoughSampler = VK_NULL_HANDLE;
+	// emission is reduced to a constant so the path tracer can sample emissive triangles as lights
+	glm::vec3 emission{ 0.f };
+
+	// index in the material table, 0 is the default material
+	uint32_t tableIndex = 0;
 };
 
 struct GeoSurface {
 	uint32_t startIndex;
 	uint32_t count;
 	std::shared_ptr<GLTFMaterial> material;
+	// object space bounds of the vertices of the surface
+	Bounds bounds;
 };
 
 struct MeshAsset {
 	std::string name;
 	std::vector<GeoSurface> surfaces;
 	GPUMeshBuffers meshBuffers;
+
+	// cpu side copy of the uploaded geometry, used to build the path tracer scene. Compressed meshes
+	// keep their decoded vertices here
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	// bottom level acceleration structure over the triangles in object space
+	BVH bvh;
+
+	// VERTEX_COMPRESSED meshes upload the compressed streams instead of vertices
+	uint32_t vertexFlags = 0;
+	CompressedMesh compressed;
 };
 
 struct LoadedGLTF : Renderable {
@@ -39,18 +63,54 @@ struct LoadedGLTF : Renderable {
 
 	std::vector<VkSampler> samplers;
 
-	DescriptorAllocator descriptorPool;
-
-	AllocatedBuffer materialDataBuffer;
-
 	Engine* creator;
 
+	enum class TextureUse {
+		BaseColor,
+		MetalRough,
+		// only the average color of the image is used
+		Emission,
+	};
+
+	// a material texture that waits for its image
+	struct TextureReference {
+		std::shared_ptr<GLTFMaterial> material;
+		TextureUse use;
+		// index into decodedImages
+		size_t image;
+	};
+
+	struct DecodedImage {
+		std::string name;
+		AllocatedImage image{};
+		glm::vec4 average{ 1.f };
+	};
+
+	// filled by the loader, the materials are untextured until applyTextures hands the images to them
+	std::vector<TextureReference> textureReferences;
+	std::vector<DecodedImage> decodedImages;
+
 	~LoadedGLTF() { clearAll(); };
 
 	virtual void draw(const glm::mat4& topMatrix, DrawContext& context) override;
+	// moves the decoded images into images and the materials, not while anything reads the materials
+	void applyTextures();
 
 private:
 	void clearAll();
 };
 
+// a glTF file loading on another thread. The scene can be drawn once geometryReady is set, its images are
+// decoded when finished is set and LoadedGLTF::applyTextures has to run before they show up.
+struct GLTFLoad {
+	std::filesystem::path path;
+	// set before geometryReady, stays null if the file could not be loaded
+	std::shared_ptr<LoadedGLTF> scene;
+	std::atomic<bool> geometryReady = false;
+	std::atomic<bool> finished = false;
+};
+
+// meshes and images are converted in parallel on the engine's job system
+void loadGLTF(Engine* engine, GLTFLoad& load);
+// blocks until everything is loaded, textures included
 std::optional<std::shared_ptr<LoadedGLTF>> loadGLTF(Engine* engine, std::filesystem::path filePath);
\ No newline at end of file
@@ -28,6 +28,7 @@ struct AllocatedImage {
     VmaAllocation allocation;
     VkExtent3D imageExtent;
     VkFormat imageFormat;
+    uint32_t mipLevels = 1;
     VkImageLayout currentLayout;
 };
 
@@ -45,15 +46,53 @@ struct Vertex {
     glm::vec4 color;
 };
 
+// vertex flags of a mesh, same as in vertex_format.glsl
+constexpr uint32_t VERTEX_COMPRESSED = 1;
+constexpr uint32_t VERTEX_COLORS = 2;
+
+// 16 byte vertex of a compressed mesh, same layout as CompressedVertex in vertex_format.glsl (std430)
+struct CompressedVertex {
+    // unorm16 position inside the bounds of the mesh
+    uint16_t position[3];
+    uint16_t padding;
+    // octahedral unit normal, snorm16 x and y
+    uint32_t normal;
+    // half float u and v
+    uint32_t uv;
+};
+
+// maps the unorm16 positions of a compressed mesh back to object space: origin + position * extent
+struct PositionQuantization {
+    glm::vec3 origin{ 0.f };
+    glm::vec3 extent{ 0.f };
+};
+
+// bytes of one of the geometry pool arenas
+struct GeometryRange {
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+};
+
+// where a mesh lives in the geometry pool
 struct GPUMeshBuffers {
-    AllocatedBuffer indexBuffer;
-    AllocatedBuffer vertexBuffer;
+    GeometryRange vertices;
+    // rgba8 colors of a compressed mesh with vertex colors, empty otherwise
+    GeometryRange colors;
+    GeometryRange indices;
     VkDeviceAddress vertexBufferAddress;
+    VkDeviceAddress colorBufferAddress = 0;
+    // of the mesh indices in the pool index buffer, added to the surface start indices
+    uint32_t firstIndex;
 };
 
 struct GPUDrawPushConstants {
     glm::mat4 worldMatrix;
     VkDeviceAddress vertexBuffer;
+    VkDeviceAddress colorBuffer;
+    glm::vec3 positionOrigin;
+    uint32_t vertexFlags;
+    glm::vec3 positionExtent;
+    uint32_t materialIndex;
 };
 
 enum MaterialPass {
@@ -68,18 +107,31 @@ struct MaterialPipeline {
 
 struct MaterialInstance {
     MaterialPipeline* pipeline;
-    VkDescriptorSet materialSet;
     MaterialPass passType;
 };
 
+// box of half size extents around origin, sphereRadius is the length of extents
+struct Bounds {
+    glm::vec3 origin;
+    float sphereRadius;
+    glm::vec3 extents;
+};
+
 struct RenderObject {
     uint32_t indexCount;
+    // in the geometry pool index buffer
     uint32_t firstIndex;
-    VkBuffer indexBuffer;
 
     MaterialInstance* material;
+    // index in the material table
+    uint32_t materialIndex;
     glm::mat4 transform;
     VkDeviceAddress vertexBufferAddress;
+    VkDeviceAddress colorBufferAddress;
+    uint32_t vertexFlags;
+    PositionQuantization quantization;
+    // world space, for culling
+    Bounds bounds;
 };
 
 struct GPUSceneData {
@@ -94,6 +146,9 @@ struct GPUSceneData {
 struct DrawContext {
     std::vector<RenderObject> opaqueSurfaces;
     std::vector<RenderObject> transparentSurfaces;
+    // indices of the surfaces in draw order, filled by Engine::updateScene
+    std::vector<uint32_t> opaqueOrder;
+    std::vector<uint32_t> transparentOrder;
 };
 
 struct Renderable {